@@ -0,0 +1,277 @@
+/** \file
+ * Bounding volume hierarchy, built with a binned surface area
+ * heuristic.
+ *
+ * At each node the item centroids are sorted into bins along each
+ * axis and the split between bins that minimizes the surface area
+ * weighted item counts of the two children is taken, unless keeping
+ * the items in a leaf would be cheaper.
+ */
+#include "bvh.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BVH_BINS 16
+#define BVH_LEAF_MAX 8
+
+typedef struct
+{
+	const bvh_box_t * boxes;
+	real_t (*centroid)[3];
+	bvh_t * bvh;
+} bvh_builder_t;
+
+
+static real_t
+bvh_box_area(
+	const bvh_box_t * const box
+)
+{
+	const real_t dx = box->max[0] - box->min[0];
+	const real_t dy = box->max[1] - box->min[1];
+	const real_t dz = box->max[2] - box->min[2];
+	return 2 * (dx*dy + dy*dz + dz*dx);
+}
+
+
+static void
+bvh_box_merge(
+	bvh_box_t * const box,
+	const bvh_box_t * const other
+)
+{
+	bvh_box_add(box, other->min);
+	bvh_box_add(box, other->max);
+}
+
+
+static int
+bvh_box_overlap(
+	const bvh_box_t * const a,
+	const bvh_box_t * const b
+)
+{
+	for (int c = 0 ; c < 3 ; c++)
+		if (a->max[c] < b->min[c] || b->max[c] < a->min[c])
+			return 0;
+	return 1;
+}
+
+
+static int
+bvh_bin(
+	const real_t x,
+	const real_t min,
+	const real_t scale
+)
+{
+	const int b = (x - min) * scale;
+	if (b < 0)
+		return 0;
+	if (b >= BVH_BINS)
+		return BVH_BINS - 1;
+	return b;
+}
+
+
+static void
+bvh_build_node(
+	bvh_builder_t * const b,
+	const int node_index,
+	const int first,
+	const int count
+)
+{
+	bvh_t * const bvh = b->bvh;
+	int * const index = bvh->index;
+
+	bvh_box_t box = bvh_box_empty();
+	bvh_box_t centroids = bvh_box_empty();
+	for (int i = first ; i < first + count ; i++)
+	{
+		bvh_box_merge(&box, &b->boxes[index[i]]);
+		bvh_box_add(&centroids, b->centroid[index[i]]);
+	}
+
+	bvh->node[node_index] = (bvh_node_t) {
+		.box	= box,
+		.first	= first,
+		.count	= count,
+	};
+
+	if (count <= 2)
+		return;
+
+	// find the cheapest split over all three axes
+	real_t best_cost = INFINITY;
+	int best_axis = -1;
+	int best_bin = 0;
+
+	for (int axis = 0 ; axis < 3 ; axis++)
+	{
+		const real_t min = centroids.min[axis];
+		const real_t extent = centroids.max[axis] - min;
+		if (extent <= 0)
+			continue;
+		const real_t scale = BVH_BINS / extent;
+
+		int bin_count[BVH_BINS] = { 0 };
+		bvh_box_t bin_box[BVH_BINS];
+		for (int k = 0 ; k < BVH_BINS ; k++)
+			bin_box[k] = bvh_box_empty();
+
+		for (int i = first ; i < first + count ; i++)
+		{
+			const int k = bvh_bin(b->centroid[index[i]][axis], min, scale);
+			bin_count[k]++;
+			bvh_box_merge(&bin_box[k], &b->boxes[index[i]]);
+		}
+
+		// sweep from the right to get the cost of each right side
+		real_t right_cost[BVH_BINS];
+		bvh_box_t right = bvh_box_empty();
+		int right_count = 0;
+		for (int k = BVH_BINS - 1 ; k > 0 ; k--)
+		{
+			bvh_box_merge(&right, &bin_box[k]);
+			right_count += bin_count[k];
+			right_cost[k] = right_count ? right_count * bvh_box_area(&right) : 0;
+		}
+
+		bvh_box_t left = bvh_box_empty();
+		int left_count = 0;
+		for (int k = 0 ; k < BVH_BINS - 1 ; k++)
+		{
+			bvh_box_merge(&left, &bin_box[k]);
+			left_count += bin_count[k];
+			if (left_count == 0 || left_count == count)
+				continue;
+
+			const real_t cost = left_count * bvh_box_area(&left)
+				+ right_cost[k + 1];
+			if (cost >= best_cost)
+				continue;
+
+			best_cost = cost;
+			best_axis = axis;
+			best_bin = k;
+		}
+	}
+
+	// all of the centroids are in the same place
+	if (best_axis < 0)
+		return;
+
+	// a leaf is cheaper if every item would be tested anyway
+	if (count <= BVH_LEAF_MAX && best_cost >= count * bvh_box_area(&box))
+		return;
+
+	// partition the items around the split
+	const real_t min = centroids.min[best_axis];
+	const real_t scale = BVH_BINS / (centroids.max[best_axis] - min);
+	int mid = first;
+	for (int i = first ; i < first + count ; i++)
+	{
+		const real_t x = b->centroid[index[i]][best_axis];
+		if (bvh_bin(x, min, scale) > best_bin)
+			continue;
+
+		const int tmp = index[i];
+		index[i] = index[mid];
+		index[mid++] = tmp;
+	}
+
+	const int left_index = bvh->num_node;
+	bvh->num_node += 2;
+
+	bvh->node[node_index].first = left_index;
+	bvh->node[node_index].count = 0;
+
+	bvh_build_node(b, left_index + 0, first, mid - first);
+	bvh_build_node(b, left_index + 1, mid, first + count - mid);
+}
+
+
+bvh_t *
+bvh_build(
+	const bvh_box_t * const boxes,
+	const int n
+)
+{
+	bvh_t * const bvh = calloc(1, sizeof(*bvh));
+	bvh->node = calloc(2 * n + 1, sizeof(*bvh->node));
+	bvh->index = calloc(n + 1, sizeof(*bvh->index));
+	bvh->num_node = 1;
+
+	bvh_builder_t b = {
+		.boxes		= boxes,
+		.centroid	= calloc(n + 1, sizeof(*b.centroid)),
+		.bvh		= bvh,
+	};
+
+	for (int i = 0 ; i < n ; i++)
+	{
+		bvh->index[i] = i;
+		for (int c = 0 ; c < 3 ; c++)
+			b.centroid[i][c] = (boxes[i].min[c] + boxes[i].max[c]) / 2;
+	}
+
+	bvh_build_node(&b, 0, 0, n);
+
+	free(b.centroid);
+	return bvh;
+}
+
+
+void
+bvh_free(
+	bvh_t * const bvh
+)
+{
+	if (!bvh)
+		return;
+	free(bvh->node);
+	free(bvh->index);
+	free(bvh);
+}
+
+
+static int
+bvh_query_node(
+	const bvh_t * const bvh,
+	const int node_index,
+	const bvh_box_t * const box,
+	const bvh_query_fn fn,
+	void * const arg
+)
+{
+	const bvh_node_t * const node = &bvh->node[node_index];
+	if (!bvh_box_overlap(&node->box, box))
+		return 0;
+
+	if (node->count == 0)
+		return bvh_query_node(bvh, node->first + 0, box, fn, arg)
+		||     bvh_query_node(bvh, node->first + 1, box, fn, arg);
+
+	for (int i = node->first ; i < node->first + node->count ; i++)
+		if (fn(arg, bvh->index[i]))
+			return 1;
+
+	return 0;
+}
+
+
+void
+bvh_query(
+	const bvh_t * const bvh,
+	const bvh_box_t * const box,
+	const bvh_query_fn fn,
+	void * const arg
+)
+{
+	// an empty tree has only a root with no items
+	if (bvh->num_node == 1 && bvh->node[0].count == 0)
+		return;
+
+	bvh_query_node(bvh, 0, box, fn, arg);
+}
@@ -0,0 +1,101 @@
+/** \file
+ * Bounding volume hierarchy.
+ *
+ * A binary tree of axis aligned boxes, split with the surface area
+ * heuristic, for finding which of a set of objects might touch a
+ * query box without testing every one of them.
+ */
+#ifndef _papercraft_bvh_h_
+#define _papercraft_bvh_h_
+
+#include "v3.h"
+
+typedef struct
+{
+	real_t min[3];
+	real_t max[3];
+} bvh_box_t;
+
+
+/** A leaf holds items [first, first + count) of the index array;
+ * an interior node has count == 0 and its children are at first
+ * and first + 1.
+ */
+typedef struct
+{
+	bvh_box_t box;
+	int first;
+	int count;
+} bvh_node_t;
+
+
+typedef struct
+{
+	int num_node;
+	bvh_node_t * node;
+	int * index;
+} bvh_t;
+
+
+/** Called for every item whose box overlaps the query box.
+ * Returning non-zero stops the search.
+ */
+typedef int (*bvh_query_fn)(
+	void * arg,
+	int item
+);
+
+
+/** Build a tree over n boxes, in O(n log n). */
+bvh_t *
+bvh_build(
+	const bvh_box_t * boxes,
+	int n
+);
+
+
+void
+bvh_free(
+	bvh_t * bvh
+);
+
+
+/** Call fn on every item whose box overlaps box.
+ * Safe to call from several threads at once.
+ */
+void
+bvh_query(
+	const bvh_t * bvh,
+	const bvh_box_t * box,
+	bvh_query_fn fn,
+	void * arg
+);
+
+
+/** Grow box to include the point p. */
+static inline void
+bvh_box_add(
+	bvh_box_t * const box,
+	const real_t p[3]
+)
+{
+	for (int c = 0 ; c < 3 ; c++)
+	{
+		if (p[c] < box->min[c]) box->min[c] = p[c];
+		if (p[c] > box->max[c]) box->max[c] = p[c];
+	}
+}
+
+
+/** A box that contains nothing, for starting bvh_box_add(). */
+static inline bvh_box_t
+bvh_box_empty(void)
+{
+	bvh_box_t box = {
+		.min = { INFINITY, INFINITY, INFINITY },
+		.max = { -INFINITY, -INFINITY, -INFINITY },
+	};
+	return box;
+}
+
+#endif
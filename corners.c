@@ -14,9 +14,11 @@
 #include <assert.h>
 #include "v3.h"
 #include "stl_3d.h"
+#include "pool.h"
+#include "orient.h"
 
-
-static v3_t avg_x, avg_y, avg_z;
+// how far out from the vertex the printed connector reaches
+#define CORNER_REACH 24
 
 static void
 print_multmatrix(
@@ -42,6 +44,99 @@ print_multmatrix(
 }
 
 
+/** The half-edges leaving a vertex, in face order so that the
+ * output does not depend on where the ring starts.
+ */
+static int *
+vertex_ring(
+	const stl_3d_t * const stl,
+	const stl_vertex_t * const v,
+	int * const num_he_out
+)
+{
+	int num_he = 0;
+	int max_he = 8;
+	int * he = calloc(max_he, sizeof(*he));
+
+	stl_ring_t ring;
+	for (int h = stl_ring_start(&ring, stl, v - stl->vertex) ; h >= 0 ; h = stl_ring_next(&ring))
+	{
+		if (num_he == max_he)
+			he = realloc(he, (max_he *= 2) * sizeof(*he));
+
+		int k = num_he++;
+		for ( ; k > 0 && he[k-1] > h ; k--)
+			he[k] = he[k-1];
+		he[k] = h;
+	}
+
+	*num_he_out = num_he;
+	return he;
+}
+
+
+/** Describe the plates of the connector at v for the orientation
+ * search: the corner of each face polygon out to CORNER_REACH.
+ */
+static void
+corner_part(
+	const stl_3d_t * const stl,
+	const stl_vertex_t * const v,
+	const double thickness,
+	orient_part_t * const part
+)
+{
+	int * const face_used = calloc(sizeof(*face_used), stl->num_face);
+	const stl_vertex_t ** const vertex_list = calloc(sizeof(**vertex_list), stl->num_vertex);
+	int num_he;
+	int * const he = vertex_ring(stl, v, &num_he);
+
+	for (int j = 0 ; j < num_he ; j++)
+	{
+		const stl_face_t * const f = &stl->face[stl_he_face(he[j])];
+		if (face_used[f - stl->face])
+			continue;
+
+		const int vertex_count = stl_trace_face(
+			stl,
+			f,
+			vertex_list,
+			face_used,
+			he[j] % 3
+		);
+
+		// the trace ends back at v, so its neighbors on the
+		// polygon are the first and second to last points.
+		if (vertex_count < 3)
+			continue;
+
+		v3_t p[2];
+		const stl_vertex_t * const next[2] = {
+			vertex_list[0],
+			vertex_list[vertex_count - 2],
+		};
+		for (int k = 0 ; k < 2 ; k++)
+		{
+			const v3_t d = v3_sub(next[k]->p, v->p);
+			const double len = v3_mag(d);
+			p[k] = v3_add(v->p, v3_scale(d,
+				len < CORNER_REACH ? 1 : CORNER_REACH / len));
+		}
+
+		orient_plate(part,
+			v3_sub(v->p, v->p),
+			v3_sub(p[0], v->p),
+			v3_sub(p[1], v->p),
+			2 * thickness
+		);
+	}
+
+	free(he);
+	free(face_used);
+	free(vertex_list);
+}
+
+
 static void
 make_faces(
 	const stl_3d_t * const stl,
@@ -59,14 +154,18 @@ make_faces(
 	// generate all of the coplanar polygons at this vertex
 	const stl_vertex_t ** const vertex_list = calloc(sizeof(**vertex_list), stl->num_vertex);
 
-	for (int j = 0 ; j < v->num_face; j++)
+	int num_he;
+	int * const he = vertex_ring(stl, v, &num_he);
+
+	for (int j = 0 ; j < num_he ; j++)
 	{
 		// generate the polygon face for this vertex
-		const stl_face_t * const f = v->face[j];
-		if (face_used[f - stl->face])
+		const int fi = stl_he_face(he[j]);
+		const stl_face_t * const f = &stl->face[fi];
+		if (face_used[fi])
 			continue;
 
-		const int start_vertex = v->face_num[j];
+		const int start_vertex = he[j] % 3;
 		const int vertex_count = stl_trace_face(
 			stl,
 			f,
@@ -77,15 +176,11 @@ make_faces(
 
 		refframe_t ref;
 		refframe_init(&ref,
-			f->vertex[(start_vertex+0) % 3]->p,
-			f->vertex[(start_vertex+1) % 3]->p,
-			f->vertex[(start_vertex+2) % 3]->p
+			stl_face_vertex(stl, fi, (start_vertex+0) % 3)->p,
+			stl_face_vertex(stl, fi, (start_vertex+1) % 3)->p,
+			stl_face_vertex(stl, fi, (start_vertex+2) % 3)->p
 		);
 
-		avg_x = v3_add(avg_x, ref.x);
-		avg_y = v3_add(avg_y, ref.y);
-		avg_z = v3_add(avg_z, ref.z);
-
 		// use the transpose of the rotation matrix,
 		// which will rotate from (x,y) to the correct
 		// orientation relative to this connector node.
@@ -137,15 +232,52 @@ make_faces(
 
 	free(face_used);
 	free(vertex_list);
+	free(he);
+}
+
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+"usage: corners [-j threads] [-c] [-z] < file.stl > file.scad\n"
+"\n"
+"-j N    Use N threads\n"
+"-c     Check the mesh for faces that pass through each other\n"
+"       and refuse to continue if there are any\n"
+"-z     Keep the mesh topology compressed, for very large meshes;\n"
+"       the vertices come out in a different order\n"
+	);
+	exit(EXIT_FAILURE);
 }
 
 
 int
-main(void)
+main(
+	int argc,
+	char ** argv
+)
 {
-	stl_3d_t * const stl = stl_3d_parse(STDIN_FILENO);
+	int check = 0;
+	int compact = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:cz")) != -1)
+	{
+		switch (opt)
+		{
+		case 'j': pool_init(atoi(optarg)); break;
+		case 'c': check = 1; break;
+		case 'z': compact = 1; break;
+		default: usage();
+		}
+	}
+
+	stl_3d_t * const stl = stl_3d_parse(STDIN_FILENO, compact);
 	if (!stl)
 		return EXIT_FAILURE;
+
+	if (check)
+		stl_3d_check(stl);
 	const double thickness = 3;
 	const double inset_dist = 2;
 	const double hole_dist = 5;
@@ -165,10 +297,6 @@ main(void)
 			"{\n",
 			origin.p[0], origin.p[1], origin.p[2], i);
 
-		avg_x.p[0] = avg_x.p[1] = avg_x.p[2] = 0;
-		avg_y.p[0] = avg_y.p[1] = avg_y.p[2] = 0;
-		avg_z.p[0] = avg_z.p[1] = avg_z.p[2] = 0;
-		
 		//printf("render() intersection() {\n");
 		printf("union() {\n");
 		make_faces(stl, v, thickness, -thickness, 0, 0, 0, 0);
@@ -189,12 +317,23 @@ main(void)
 
 		printf("}\n");
 
-		refframe_t avg;
-		refframe_init(&avg, avg_x, avg_y, avg_z);
+		// print it in the orientation that needs the least support,
+		// clipped to 12mm either side of the vertex and with the
+		// lowest point that is left on the bed.
+		orient_part_t part;
+		orient_part_init(&part);
+		corner_part(stl, v, thickness, &part);
+		orient_t o = orient_best(&part);
+		orient_part_free(&part);
+
+		fprintf(stderr, "orient: support %.0f mm^3, height %.0f mm\n",
+			o.support, o.height);
+
+		const double lift = o.min < -12 ? 12 : -o.min;
+		o.min = 0;
 
-		printf("translate([0,0,12]) render() intersection() {\n");
-		printf("rotate([0,-90,0])");
-		print_multmatrix(&avg, 1);
+		printf("translate([0,0,%f]) render() intersection() {\n", lift);
+		orient_multmatrix(stdout, &o, 0, 0);
 		printf("vertex_%d();\n", i);
 		printf("cube([100,100,24], center=true);\n");
 		printf("}\n");
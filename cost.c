@@ -0,0 +1,423 @@
+/** \file
+ * Laser job cost estimate.
+ */
+#include "cost.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+#define 	M_PI   3.1415926535897932384
+#endif
+
+// lines closer than this are one continuous path
+#define COST_JOIN 0.001
+
+static const char * const cost_class_name[COST_CLASSES] = {
+	[COST_CUT]	= "cut",
+	[COST_MOUNTAIN]	= "mountain",
+	[COST_VALLEY]	= "valley",
+	[COST_LABEL]	= "label",
+};
+
+
+void
+cost_profile_default(
+	cost_profile_t * const profile
+)
+{
+	*profile = (cost_profile_t) {
+		.name		= "default",
+		.speed		= {
+			[COST_CUT]	= 20,
+			[COST_MOUNTAIN]	= 60,
+			[COST_VALLEY]	= 60,
+			[COST_LABEL]	= 100,
+		},
+		.travel_speed	= 300,
+		.pierce_time	= 0.05,
+	};
+}
+
+
+int
+cost_profile_load(
+	cost_profile_t * const profile,
+	const char * const filename
+)
+{
+	FILE * const f = fopen(filename, "r");
+	if (!f)
+		return -1;
+
+	char line[256];
+	char key[64];
+	double value;
+
+	while (fgets(line, sizeof(line), f))
+	{
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		if (sscanf(line, "name %63s", profile->name) == 1)
+			continue;
+
+		if (sscanf(line, "%63s %lf", key, &value) != 2)
+		{
+			fprintf(stderr, "%s: unable to parse '%s'\n", filename, line);
+			continue;
+		}
+
+		if (strcmp(key, "cut_speed") == 0)
+			profile->speed[COST_CUT] = value;
+		else
+		if (strcmp(key, "mountain_speed") == 0)
+			profile->speed[COST_MOUNTAIN] = value;
+		else
+		if (strcmp(key, "valley_speed") == 0)
+			profile->speed[COST_VALLEY] = value;
+		else
+		if (strcmp(key, "label_speed") == 0)
+			profile->speed[COST_LABEL] = value;
+		else
+		if (strcmp(key, "travel_speed") == 0)
+			profile->travel_speed = value;
+		else
+		if (strcmp(key, "pierce_time") == 0)
+			profile->pierce_time = value;
+		else
+		if (strcmp(key, "sheet_width") == 0)
+			profile->sheet_width = value;
+		else
+		if (strcmp(key, "sheet_height") == 0)
+			profile->sheet_height = value;
+		else
+			fprintf(stderr, "%s: unknown key '%s'\n", filename, key);
+	}
+
+	fclose(f);
+	return 0;
+}
+
+
+void
+cost_sheet_init(
+	cost_sheet_t * const sheet
+)
+{
+	memset(sheet, 0, sizeof(*sheet));
+	sheet->min[0] = sheet->min[1] = INFINITY;
+	sheet->max[0] = sheet->max[1] = -INFINITY;
+}
+
+
+static double
+cost_dist(
+	const double * const p1,
+	const double * const p2
+)
+{
+	const double dx = p2[0] - p1[0];
+	const double dy = p2[1] - p1[1];
+	return sqrt(dx*dx + dy*dy);
+}
+
+
+static void
+cost_bbox(
+	cost_sheet_t * const sheet,
+	const double * const p
+)
+{
+	for (int c = 0 ; c < 2 ; c++)
+	{
+		if (p[c] < sheet->min[c]) sheet->min[c] = p[c];
+		if (p[c] > sheet->max[c]) sheet->max[c] = p[c];
+	}
+}
+
+
+/** Join the path b on to the end of path a. */
+static void
+cost_path_merge(
+	cost_path_t * const a,
+	const cost_path_t * const b
+)
+{
+	if (b->lines == 0)
+		return;
+
+	if (a->lines == 0)
+	{
+		*a = *b;
+		return;
+	}
+
+	const double gap = cost_dist(a->last, b->first);
+
+	a->length += b->length;
+	a->travel += b->travel;
+	a->pierces += b->pierces;
+	a->lines += b->lines;
+
+	// no need to pierce again if b continues where a stopped
+	if (gap < COST_JOIN)
+		a->pierces--;
+	else
+		a->travel += gap;
+
+	a->last[0] = b->last[0];
+	a->last[1] = b->last[1];
+}
+
+
+void
+cost_line(
+	cost_sheet_t * const sheet,
+	const cost_class_t cls,
+	const double x1,
+	const double y1,
+	const double x2,
+	const double y2
+)
+{
+	const double p1[2] = { x1 + sheet->offset[0], y1 + sheet->offset[1] };
+	const double p2[2] = { x2 + sheet->offset[0], y2 + sheet->offset[1] };
+	const cost_path_t line = {
+		.length		= cost_dist(p1, p2),
+		.pierces	= 1,
+		.lines		= 1,
+		.first		= { p1[0], p1[1] },
+		.last		= { p2[0], p2[1] },
+	};
+
+	cost_path_merge(&sheet->path[cls], &line);
+	cost_bbox(sheet, p1);
+	cost_bbox(sheet, p2);
+}
+
+
+void
+cost_circle(
+	cost_sheet_t * const sheet,
+	const cost_class_t cls,
+	const double x,
+	const double y,
+	const double r
+)
+{
+	const double p[2] = { x + r + sheet->offset[0], y + sheet->offset[1] };
+	const cost_path_t line = {
+		.length		= 2 * M_PI * r,
+		.pierces	= 1,
+		.lines		= 1,
+		.first		= { p[0], p[1] },
+		.last		= { p[0], p[1] },
+	};
+
+	cost_path_merge(&sheet->path[cls], &line);
+
+	const double p0[2] = { p[0] - 2*r, p[1] - r };
+	const double p1[2] = { p[0], p[1] + r };
+	cost_bbox(sheet, p0);
+	cost_bbox(sheet, p1);
+}
+
+
+void
+cost_part(
+	cost_sheet_t * const sheet,
+	const double area
+)
+{
+	sheet->parts++;
+	sheet->part_area += area;
+}
+
+
+void
+cost_sheet_merge(
+	cost_sheet_t * const dst,
+	const cost_sheet_t * const src
+)
+{
+	for (int i = 0 ; i < COST_CLASSES ; i++)
+		cost_path_merge(&dst->path[i], &src->path[i]);
+
+	dst->parts += src->parts;
+	dst->part_area += src->part_area;
+
+	if (src->min[0] <= src->max[0])
+	{
+		cost_bbox(dst, src->min);
+		cost_bbox(dst, src->max);
+	}
+}
+
+
+static double
+cost_time(
+	const cost_profile_t * const profile,
+	const cost_class_t cls,
+	const cost_path_t * const path
+)
+{
+	return path->length / profile->speed[cls]
+		+ path->travel / profile->travel_speed
+		+ path->pierces * profile->pierce_time;
+}
+
+
+void
+cost_json(
+	FILE * const out,
+	const cost_profile_t * const profile,
+	const cost_sheet_t * const sheets,
+	const int num_sheets
+)
+{
+	double total_time = 0;
+
+	fprintf(out, "{\n\t\"profile\": \"%s\",\n\t\"sheets\": [\n",
+		profile->name);
+
+	for (int s = 0 ; s < num_sheets ; s++)
+	{
+		const cost_sheet_t * const sheet = &sheets[s];
+		const int empty = sheet->min[0] > sheet->max[0];
+		double width = profile->sheet_width;
+		double height = profile->sheet_height;
+		if (width <= 0 || height <= 0)
+		{
+			width = empty ? 0 : sheet->max[0] - sheet->min[0];
+			height = empty ? 0 : sheet->max[1] - sheet->min[1];
+		}
+
+		const double sheet_area = width * height;
+		double sheet_time = 0;
+
+		fprintf(out, "\t\t{\n"
+			"\t\t\t\"sheet\": %d,\n"
+			"\t\t\t\"width\": %.3f,\n"
+			"\t\t\t\"height\": %.3f,\n"
+			"\t\t\t\"parts\": %d,\n"
+			"\t\t\t\"part_area\": %.3f,\n"
+			"\t\t\t\"utilization\": %.4f,\n"
+			"\t\t\t\"classes\": {\n",
+			s,
+			width,
+			height,
+			sheet->parts,
+			sheet->part_area,
+			sheet_area > 0 ? sheet->part_area / sheet_area : 0
+		);
+
+		for (int i = 0 ; i < COST_CLASSES ; i++)
+		{
+			const cost_path_t * const path = &sheet->path[i];
+			const double time = cost_time(profile, i, path);
+			sheet_time += time;
+
+			fprintf(out, "\t\t\t\t\"%s\": { "
+				"\"length\": %.3f, "
+				"\"pierces\": %d, "
+				"\"travel\": %.3f, "
+				"\"time\": %.3f }%s\n",
+				cost_class_name[i],
+				path->length,
+				path->pierces,
+				path->travel,
+				time,
+				i == COST_CLASSES - 1 ? "" : ","
+			);
+		}
+
+		total_time += sheet_time;
+
+		fprintf(out, "\t\t\t},\n"
+			"\t\t\t\"time\": %.3f\n"
+			"\t\t}%s\n",
+			sheet_time,
+			s == num_sheets - 1 ? "" : ","
+		);
+	}
+
+	fprintf(out, "\t],\n\t\"time\": %.3f\n}\n", total_time);
+}
+
+
+/** Skip the spaces and then the character c.
+ * \return the rest of the string, or NULL if c was not next.
+ */
+static const char *
+cost_json_expect(
+	const char * s,
+	const char c
+)
+{
+	while (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r')
+		s++;
+	return *s == c ? s + 1 : NULL;
+}
+
+
+int
+cost_json_length(
+	FILE * const in,
+	const cost_class_t cls,
+	double * const length
+)
+{
+	char * buf = NULL;
+	size_t size = 0;
+	size_t len = 0;
+	while (1)
+	{
+		if (len + 1 >= size)
+		{
+			size = size ? 2 * size : 4096;
+			buf = realloc(buf, size);
+			if (!buf)
+				return -1;
+		}
+		const size_t n = fread(buf + len, 1, size - len - 1, in);
+		if (n == 0)
+			break;
+		len += n;
+	}
+	buf[len] = '\0';
+
+	// "name" : { ... "length" : number ... }
+	char name[80];
+	snprintf(name, sizeof(name), "\"%s\"", cost_class_name[cls]);
+
+	int count = 0;
+	*length = 0;
+	for (const char * s = strstr(buf, name) ; s ; s = strstr(s, name))
+	{
+		s += strlen(name);
+		const char * p = cost_json_expect(s, ':');
+		if (p)
+			p = cost_json_expect(p, '{');
+		if (!p)
+			continue;
+
+		const char * const end = strchr(p, '}');
+		const char * key = strstr(p, "\"length\"");
+		if (!end || !key || key > end)
+			continue;
+		if (!(p = cost_json_expect(key + strlen("\"length\""), ':')))
+			continue;
+
+		char * num_end;
+		const double value = strtod(p, &num_end);
+		if (num_end == p)
+			continue;
+
+		*length += value;
+		count++;
+	}
+
+	free(buf);
+	return count ? count : -1;
+}
@@ -0,0 +1,156 @@
+/** \file
+ * Laser job cost estimate.
+ *
+ * The tools report each line they draw, in the order they draw them,
+ * and this accumulates the path length, number of pierces and the
+ * rapid travel between lines for each class of line.  A material
+ * profile turns those into machine time, and the part area into the
+ * material utilization of the sheet.
+ *
+ * The laser is assumed to run each class of line as a separate pass
+ * in the order that the lines appear in the SVG, piercing wherever a
+ * line does not start where the previous one ended.
+ */
+#ifndef _papercraft_cost_h_
+#define _papercraft_cost_h_
+
+#include <stdio.h>
+
+typedef enum
+{
+	COST_CUT,
+	COST_MOUNTAIN,
+	COST_VALLEY,
+	COST_LABEL,
+	COST_CLASSES
+} cost_class_t;
+
+
+/** Speeds are in mm/s and times in seconds. */
+typedef struct
+{
+	char name[64];
+	double speed[COST_CLASSES];
+	double travel_speed;
+	double pierce_time;
+	double sheet_width;	// 0 for the bounding box of the parts
+	double sheet_height;
+} cost_profile_t;
+
+
+/** The path of one class of line; these can be built separately
+ * and joined with cost_sheet_merge() as long as the order is kept.
+ */
+typedef struct
+{
+	double length;
+	double travel;
+	int pierces;
+	int lines;
+	double first[2];
+	double last[2];
+} cost_path_t;
+
+
+typedef struct
+{
+	cost_path_t path[COST_CLASSES];
+	int parts;
+	double part_area;
+	double min[2];
+	double max[2];
+
+	// added to every point, for groups drawn with a translation
+	double offset[2];
+} cost_sheet_t;
+
+
+/** Fill in the default profile, with typical speeds for card. */
+void
+cost_profile_default(
+	cost_profile_t * profile
+);
+
+
+/** Read "key value" lines from a profile file over the defaults.
+ * \return 0 on success, -1 if the file could not be read.
+ */
+int
+cost_profile_load(
+	cost_profile_t * profile,
+	const char * filename
+);
+
+
+void
+cost_sheet_init(
+	cost_sheet_t * sheet
+);
+
+
+/** Add a line from (x1,y1) to (x2,y2) to the path of class cls. */
+void
+cost_line(
+	cost_sheet_t * sheet,
+	cost_class_t cls,
+	double x1,
+	double y1,
+	double x2,
+	double y2
+);
+
+
+/** Add a closed circle, which is cut in one pass starting and
+ * ending at its rightmost point.
+ */
+void
+cost_circle(
+	cost_sheet_t * sheet,
+	cost_class_t cls,
+	double x,
+	double y,
+	double r
+);
+
+
+/** Add a part of the given area to the sheet. */
+void
+cost_part(
+	cost_sheet_t * sheet,
+	double area
+);
+
+
+/** Append the lines and parts of src to dst, as if they were drawn
+ * on dst right after the ones already there.
+ */
+void
+cost_sheet_merge(
+	cost_sheet_t * dst,
+	const cost_sheet_t * src
+);
+
+
+/** Write the estimate for the sheets as JSON. */
+void
+cost_json(
+	FILE * out,
+	const cost_profile_t * profile,
+	const cost_sheet_t * sheets,
+	int num_sheets
+);
+
+
+/** Add up the length of one class of line over every sheet of an
+ * estimate written by cost_json().  Only the keys are matched, so
+ * the spacing of the file does not matter.
+ * \return the number of sheets, or -1 if there were none.
+ */
+int
+cost_json_length(
+	FILE * in,
+	cost_class_t cls,
+	double * length
+);
+
+#endif
@@ -0,0 +1,157 @@
+/** \file
+ * One dimensional clustering of strut lengths.
+ */
+#include "cutlist.h"
+#include <stdlib.h>
+#include <math.h>
+
+typedef struct
+{
+	double len;
+	int index;
+} cutlist_strut_t;
+
+
+static int
+cutlist_cmp(
+	const void * const a_ptr,
+	const void * const b_ptr
+)
+{
+	const cutlist_strut_t * const a = a_ptr;
+	const cutlist_strut_t * const b = b_ptr;
+	if (a->len != b->len)
+		return a->len < b->len ? -1 : 1;
+	return a->index - b->index;
+}
+
+
+int
+cutlist_cluster(
+	const double * const len,
+	const int n,
+	const double tol,
+	int * const bin,
+	cutlist_bin_t ** const bins_out
+)
+{
+	cutlist_strut_t * const s = calloc(n + 1, sizeof(*s));
+	for (int i = 0 ; i < n ; i++)
+		s[i] = (cutlist_strut_t) { len[i], i };
+	qsort(s, n, sizeof(*s), cutlist_cmp);
+
+	// prefix sums for the mean and squared error of any run
+	double * const sum = calloc(n + 1, sizeof(*sum));
+	double * const sum2 = calloc(n + 1, sizeof(*sum2));
+	for (int i = 0 ; i < n ; i++)
+	{
+		sum[i+1] = sum[i] + s[i].len;
+		sum2[i+1] = sum2[i] + s[i].len * s[i].len;
+	}
+
+	// best[j] is the fewest bins for the first j lengths, with
+	// err[j] the least squared error for that many bins and
+	// start[j] the first length in the last bin.
+	int * const best = calloc(n + 1, sizeof(*best));
+	double * const err = calloc(n + 1, sizeof(*err));
+	int * const start = calloc(n + 1, sizeof(*start));
+
+	for (int j = 1 ; j <= n ; j++)
+	{
+		best[j] = n + 1;
+		err[j] = INFINITY;
+
+		// any bin wider than 2*tol can not have every length
+		// within tol of its mean
+		for (int i = j - 1 ; i >= 0 ; i--)
+		{
+			if (s[j-1].len - s[i].len > 2 * tol)
+				break;
+
+			const int k = j - i;
+			const double mean = (sum[j] - sum[i]) / k;
+			if (mean - s[i].len > tol || s[j-1].len - mean > tol)
+				continue;
+
+			const double sse = (sum2[j] - sum2[i]) - k * mean * mean;
+			const int count = best[i] + 1;
+			const double total = err[i] + (sse > 0 ? sse : 0);
+
+			if (count < best[j]
+			|| (count == best[j] && total < err[j]))
+			{
+				best[j] = count;
+				err[j] = total;
+				start[j] = i;
+			}
+		}
+
+		// a single length always fits, so this is never reached
+		if (best[j] > n)
+		{
+			best[j] = best[j-1] + 1;
+			err[j] = err[j-1];
+			start[j] = j - 1;
+		}
+	}
+
+	const int num_bins = n ? best[n] : 0;
+	cutlist_bin_t * const bins = calloc(num_bins + 1, sizeof(*bins));
+
+	for (int j = n, b = num_bins - 1 ; j > 0 ; j = start[j], b--)
+	{
+		const int i = start[j];
+		bins[b] = (cutlist_bin_t) {
+			.length	= (sum[j] - sum[i]) / (j - i),
+			.min	= s[i].len,
+			.max	= s[j-1].len,
+			.count	= j - i,
+		};
+
+		for (int k = i ; k < j ; k++)
+			bin[s[k].index] = b;
+	}
+
+	free(s);
+	free(sum);
+	free(sum2);
+	free(best);
+	free(err);
+	free(start);
+
+	*bins_out = bins;
+	return num_bins;
+}
+
+
+void
+cutlist_print(
+	FILE * const out,
+	const cutlist_bin_t * const bins,
+	const int num_bins,
+	const double tol,
+	const double allowance
+)
+{
+	int total = 0;
+	for (int b = 0 ; b < num_bins ; b++)
+		total += bins[b].count;
+
+	fprintf(out,
+		"# %d struts, %d lengths, tolerance %.2f mm\n"
+		"# cut length is center to center less %.2f mm for the sockets\n"
+		"length_mm\tcount\tmin_mm\tmax_mm\n",
+		total,
+		num_bins,
+		tol,
+		allowance
+	);
+
+	for (int b = 0 ; b < num_bins ; b++)
+		fprintf(out, "%.2f\t%d\t%.2f\t%.2f\n",
+			bins[b].length,
+			bins[b].count,
+			bins[b].min,
+			bins[b].max
+		);
+}
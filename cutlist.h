@@ -0,0 +1,51 @@
+/** \file
+ * Strut cut list.
+ *
+ * Groups the strut lengths into as few distinct lengths as possible
+ * with every strut within a tolerance of the length it is cut to,
+ * so that the saw stop has to be moved as few times as possible.
+ */
+#ifndef _papercraft_cutlist_h_
+#define _papercraft_cutlist_h_
+
+#include <stdio.h>
+
+typedef struct
+{
+	double length;		// the length to cut, the mean of the bin
+	double min;
+	double max;
+	int count;
+} cutlist_bin_t;
+
+
+/** Cluster the n lengths.
+ *
+ * Of the clusterings with the fewest bins where every length is
+ * within tol of its bin's mean, the one with the least total squared
+ * adjustment is found by dynamic programming over the sorted lengths.
+ * bin[i] is set to the bin of len[i].  The bins are in order of
+ * length in the malloc'ed *bins_out.
+ * \return the number of bins.
+ */
+int
+cutlist_cluster(
+	const double * len,
+	int n,
+	double tol,
+	int * bin,
+	cutlist_bin_t ** bins_out
+);
+
+
+/** Write the bins as a tab separated bill of materials. */
+void
+cutlist_print(
+	FILE * out,
+	const cutlist_bin_t * bins,
+	int num_bins,
+	double tol,
+	double allowance
+);
+
+#endif
@@ -12,74 +12,475 @@
 #include <assert.h>
 #include "v3.h"
 #include "stl_3d.h"
+#include "pool.h"
+#include "progress.h"
+#include "cost.h"
+#include "pieces.h"
+#include "thumb.h"
+#include "v3_batch.h"
+
+// space between the polygons when they are set out for the estimate
+#define FACES_GAP 3.0
 
 static const char * stroke_string
 	= "stroke-width=\"0.1px\" fill=\"none\"";
 
 static void
 svg_line(
-	const refframe_t * const ref,
-	const v3_t p1,
-	const v3_t p2
+	FILE * const out,
+	cost_sheet_t * const sheet,
+	const double x1,
+	const double y1,
+	const double x2,
+	const double y2
 )
 {
-	// project p1 and p2 into the plane
-	double x1, y1, x2, y2;
-
-	v3_project(ref, p1, &x1, &y1);
-	v3_project(ref, p2, &x2, &y2);
 	const char * color = "#FF0000";
 
-	printf("<line x1=\"%f\" y1=\"%f\" x2=\"%f\" y2=\"%f\" stroke=\"%s\" %s/>\n",
+	fprintf(out, "<line x1=\"%f\" y1=\"%f\" x2=\"%f\" y2=\"%f\" stroke=\"%s\" %s/>\n",
 		x1, y1,
 		x2, y2,
 		color,
 		stroke_string
 	);
+
+	if (sheet)
+		cost_line(sheet, COST_CUT, x1, y1, x2, y2);
 }
 
 
 static void
 svg_circle(
+	FILE * const out,
+	cost_sheet_t * const sheet,
 	const double x,
 	const double y,
 	const double rad,
 	const char * const color
 )
 {
-	printf("<circle cx=\"%f\" cy=\"%f\" r=\"%f\" stroke=\"%s\" %s/>\n",
+	fprintf(out, "<circle cx=\"%f\" cy=\"%f\" r=\"%f\" stroke=\"%s\" %s/>\n",
 		x,
 		y,
 		rad,
 		color,
 		stroke_string
 	);
+
+	if (sheet)
+		cost_circle(sheet, COST_CUT, x, y, rad);
+}
+
+
+/** A coplanar polygon traced from the mesh, ready to be drawn. */
+typedef struct
+{
+	int face;
+	int vertex_count;
+	const stl_vertex_t ** vertex_list;
+} polygon_t;
+
+typedef struct
+{
+	const stl_3d_t * stl;
+	const polygon_t * polys;
+	const refframe_t * refs;
+	double inset_distance;
+	double hole_radius;
+
+	// one per polygon if an estimate was requested, since they
+	// are drawn in parallel and merged in order afterwards
+	cost_sheet_t * sheets;
+} faces_print_t;
+
+
+/** Project polygon n into the plane of its first face.
+ * \return the malloc'ed x coordinates followed by the y coordinates.
+ */
+static real_t *
+polygon_project(
+	const faces_print_t * const fp,
+	const int n
+)
+{
+	const polygon_t * const poly = &fp->polys[n];
+	const int vertex_count = poly->vertex_count;
+	const refframe_t * const ref = &fp->refs[n];
+
+	v3_soa_t p = v3_soa_alloc(vertex_count);
+	real_t * const px = calloc(2 * vertex_count + 1, sizeof(*px));
+	real_t * const py = px + vertex_count;
+	for (int j = 0 ; j < vertex_count ; j++)
+		v3_soa_set(&p, j, poly->vertex_list[j]->p);
+	v3_batch_project(vertex_count, &ref->origin, &ref->x, &ref->y, &p, px, py);
+	v3_soa_free(&p);
+
+	return px;
+}
+
+
+static void
+polygon_print(
+	void * const arg,
+	const int n,
+	FILE * const out
+)
+{
+	const faces_print_t * const fp = arg;
+	const polygon_t * const poly = &fp->polys[n];
+	const int i = poly->face;
+	const int vertex_count = poly->vertex_count;
+	cost_sheet_t * const sheet = fp->sheets ? &fp->sheets[n] : NULL;
+
+	real_t * const px = polygon_project(fp, n);
+	real_t * const py = px + vertex_count;
+
+	if (sheet)
+	{
+		double area = 0;
+		for (int j = 0 ; j < vertex_count ; j++)
+		{
+			const int j1 = (j+1) % vertex_count;
+			area += px[j] * py[j1] - px[j1] * py[j];
+		}
+		cost_part(sheet, fabs(area) / 2);
+	}
+
+	fprintf(out, "<!-- face %d --><g>\n", i);
+
+	// generate the polygon outline (should be one path?)
+	for (int j = 0 ; j < vertex_count ; j++)
+	{
+		const int j1 = (j+1) % vertex_count;
+		svg_line(out, sheet, px[j], py[j], px[j1], py[j1]);
+	}
+
+	// generate the inset mounting holes
+	for (int j = 0 ; j < vertex_count ; j++)
+	{
+		const int j1 = (j+1) % vertex_count;
+		const int j2 = (j+2) % vertex_count;
+		double x, y;
+		v2_inset(fp->inset_distance, &x, &y,
+			px[j], py[j],
+			px[j1], py[j1],
+			px[j2], py[j2]
+		);
+		svg_circle(out, sheet, x, y, fp->hole_radius, "#00ff00");
+	}
+
+	free(px);
+	fprintf(out, "</g>\n");
+}
+
+
+/** Write polygon n to a piece file; fp must not have cost sheets,
+ * since the polygon has already been counted when it was drawn.
+ */
+static void
+polygon_piece(
+	void * const arg,
+	const int n,
+	FILE * const out
+)
+{
+	const faces_print_t * const fp = arg;
+	const int vertex_count = fp->polys[n].vertex_count;
+
+	char * svg = NULL;
+	size_t svg_len = 0;
+	FILE * const svg_out = open_memstream(&svg, &svg_len);
+	polygon_print(arg, n, svg_out);
+	fclose(svg_out);
+
+	real_t * const px = polygon_project(fp, n);
+	double * const p = calloc(2 * vertex_count, sizeof(*p));
+	for (int j = 0 ; j < vertex_count ; j++)
+	{
+		p[2*j+0] = px[j];
+		p[2*j+1] = px[vertex_count + j];
+	}
+
+	pieces_write(out, n, p, vertex_count, svg, svg_len);
+	free(px);
+	free(p);
+	free(svg);
+}
+
+
+/** Set the polygons out in rows on a sheet about as wide as it is
+ * tall, tallest first, and store where each one is moved to.
+ * \return the width and height of the sheet in size.
+ */
+static void
+faces_layout(
+	const faces_print_t * const fp,
+	const int num_polys,
+	double (* const offset)[2],
+	double size[2]
+)
+{
+	double (* const box)[2] = calloc(num_polys + 1, sizeof(*box));
+	int * const order = calloc(num_polys + 1, sizeof(*order));
+	double area = 0;
+	double widest = 0;
+
+	for (int j = 0 ; j < num_polys ; j++)
+	{
+		const int n = fp->polys[j].vertex_count;
+		real_t * const px = polygon_project(fp, j);
+		double lo[2] = { 0, 0 };
+		double hi[2] = { 0, 0 };
+		for (int k = 0 ; k < n ; k++)
+			for (int c = 0 ; c < 2 ; c++)
+			{
+				if (k == 0 || px[c * n + k] < lo[c]) lo[c] = px[c * n + k];
+				if (k == 0 || px[c * n + k] > hi[c]) hi[c] = px[c * n + k];
+			}
+		free(px);
+
+		offset[j][0] = -lo[0];
+		offset[j][1] = -lo[1];
+		box[j][0] = hi[0] - lo[0] + FACES_GAP;
+		box[j][1] = hi[1] - lo[1] + FACES_GAP;
+		area += box[j][0] * box[j][1];
+		widest = fmax(widest, box[j][0]);
+		order[j] = j;
+	}
+
+	// tallest first, so that each row wastes little above
+	// the shorter polygons
+	for (int j = 1 ; j < num_polys ; j++)
+	{
+		const int o = order[j];
+		int k = j;
+		for ( ; k > 0 && box[order[k-1]][1] < box[o][1] ; k--)
+			order[k] = order[k-1];
+		order[k] = o;
+	}
+
+	const double width = fmax(widest, sqrt(area));
+	double x = 0;
+	double y = 0;
+	double row = 0;
+	size[0] = size[1] = 0;
+
+	for (int i = 0 ; i < num_polys ; i++)
+	{
+		const int j = order[i];
+		if (x + box[j][0] > width)
+		{
+			x = 0;
+			y += row;
+			row = 0;
+		}
+
+		offset[j][0] += x;
+		offset[j][1] += y;
+		x += box[j][0];
+		row = fmax(row, box[j][1]);
+		size[0] = fmax(size[0], x);
+		size[1] = fmax(size[1], y + row);
+	}
+
+	free(order);
+	free(box);
+}
+
+
+/** Draw the mesh colored by coplanar polygon next to the cut
+ * polygons, which are set out in rows.
+ */
+static void
+faces_thumb(
+	const char * const filename,
+	const faces_print_t * const fp,
+	const int num_polys
+)
+{
+	const stl_3d_t * const stl = fp->stl;
+	thumb_t * const thumb = thumb_alloc(2);
+
+	// number the polygons by flooding across the flat edges, so a
+	// polygon has the same color in the mesh and in the rows.
+	int * const poly_of = calloc(stl->num_face + 1, sizeof(*poly_of));
+	int * const queue = calloc(stl->num_face + 1, sizeof(*queue));
+	for (int i = 0 ; i < stl->num_face ; i++)
+		poly_of[i] = -1;
+
+	int count = 0;
+	for (int i = 0 ; i < stl->num_face ; i++)
+	{
+		if (poly_of[i] >= 0)
+			continue;
+
+		int head = 0;
+		int tail = 0;
+		poly_of[i] = count;
+		queue[tail++] = i;
+
+		while (head < tail)
+		{
+			const int f = queue[head++];
+			for (int k = 0 ; k < 3 ; k++)
+			{
+				const int h = 3 * f + k;
+				if (stl_he_boundary(stl, h))
+					continue;
+				const int f2 = stl_he_face(stl_he_twin(stl, h));
+				if (poly_of[f2] >= 0)
+					continue;
+				poly_of[f2] = count;
+				queue[tail++] = f2;
+			}
+		}
+
+		count++;
+	}
+
+	double min[3] = { INFINITY, INFINITY, INFINITY };
+	double max[3] = { -INFINITY, -INFINITY, -INFINITY };
+	for (int v = 0 ; v < stl->num_vertex ; v++)
+		for (int c = 0 ; c < 3 ; c++)
+		{
+			min[c] = fmin(min[c], stl->vertex[v].p.p[c]);
+			max[c] = fmax(max[c], stl->vertex[v].p.p[c]);
+		}
+
+	thumb_view_t view;
+	thumb_view(&view, 0, 1, min, max);
+	for (int i = 0 ; i < stl->num_face ; i++)
+	{
+		double p[3][3];
+		for (int k = 0 ; k < 3 ; k++)
+		{
+			const v3_t * const q = &stl_face_vertex(stl, i, k)->p;
+			const double x[3] = { q->p[0], q->p[1], q->p[2] };
+			thumb_project(&view, x, p[k]);
+		}
+		thumb_triangle(thumb, p, thumb_color(poly_of[i]));
+	}
+
+	double (* const offset)[2] = calloc(num_polys + 1, sizeof(*offset));
+	double size[2];
+	faces_layout(fp, num_polys, offset, size);
+	const double gmin[3] = { 0, 0, 0 };
+	const double gmax[3] = { size[0], size[1], 0 };
+	thumb_view(&view, 1, 0, gmin, gmax);
+
+	for (int j = 0 ; j < num_polys ; j++)
+	{
+		const int n = fp->polys[j].vertex_count;
+		real_t * const px = polygon_project(fp, j);
+		double * const xy = calloc(2 * n + 1, sizeof(*xy));
+		for (int k = 0 ; k < n ; k++)
+		{
+			const double q[3] = {
+				px[k] + offset[j][0],
+				px[n + k] + offset[j][1],
+				0,
+			};
+			double out[3];
+			thumb_project(&view, q, out);
+			xy[2*k+0] = out[0];
+			xy[2*k+1] = out[1];
+		}
+
+		thumb_polygon(thumb, xy, n, thumb_color(poly_of[fp->polys[j].face]));
+		for (int k = 0 ; k < n ; k++)
+			thumb_line(thumb, &xy[2*k], &xy[2*((k+1) % n)], 1, 0xC00000);
+
+		free(xy);
+		free(px);
+	}
+
+	if (thumb_write(thumb, filename) < 0)
+		err(EXIT_FAILURE, "%s", filename);
+
+	free(offset);
+	free(queue);
+	free(poly_of);
+	thumb_free(thumb);
+}
+
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+"usage: faces [-j threads] [-c] [-z] [-o pieces] [-t thumb.png] [-e estimate.json [-m profile]] < file.stl > file.svg\n"
+"\n"
+"-j N          Use N threads\n"
+"-c            Check the mesh for faces that pass through each other\n"
+"              and refuse to continue if there are any\n"
+"-z            Keep the mesh topology compressed, for very large meshes;\n"
+"              the polygons come out in a different order\n"
+"-o file       Write the outline and drawing of each piece for nest\n"
+"-t file       Draw a PNG thumbnail of the mesh and the polygons\n"
+"-e file       Write the laser time and material estimate as JSON\n"
+"-m profile    Material and machine speeds for the estimate\n"
+	);
+	exit(EXIT_FAILURE);
 }
 
 
 int
-main(void)
+main(
+	int argc,
+	char ** argv
+)
 {
-	stl_3d_t * const stl = stl_3d_parse(STDIN_FILENO);
+	int check = 0;
+	int compact = 0;
+	const char * estimate_file = NULL;
+	const char * pieces_file = NULL;
+	const char * thumb_file = NULL;
+	cost_profile_t profile;
+	cost_profile_default(&profile);
+
+	int opt;
+	while ((opt = getopt(argc, argv, "j:czo:t:e:m:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'j': pool_init(atoi(optarg)); break;
+		case 'c': check = 1; break;
+		case 'z': compact = 1; break;
+		case 'o': pieces_file = optarg; break;
+		case 't': thumb_file = optarg; break;
+		case 'e': estimate_file = optarg; break;
+		case 'm':
+			if (cost_profile_load(&profile, optarg) < 0)
+				err(EXIT_FAILURE, "%s", optarg);
+			break;
+		default: usage();
+		}
+	}
+
+	stl_3d_t * const stl = stl_3d_parse(STDIN_FILENO, compact);
 	if (!stl)
 		return EXIT_FAILURE;
-	const double inset_distance = 6;
-	const double hole_radius = 3.0/2;
 
-	int * const face_used = calloc(sizeof(*face_used), stl->num_face);
+	if (check)
+		stl_3d_check(stl);
 
-	// for each vertex, find the coplanar triangles
-	// \todo: do coplanar bits
-	printf("<svg xmlns=\"http://www.w3.org/2000/svg\">\n");
-	printf("<g transform=\"scale(3.543307)\"><!-- scale to mm -->\n");
+	int * const face_used = calloc(sizeof(*face_used), stl->num_face);
+	polygon_t * const polys = calloc(sizeof(*polys), stl->num_face);
+	int num_polys = 0;
 
+	// for each vertex, find the coplanar triangles.  the tracing
+	// marks faces as used, so it has to be done in order, but the
+	// polygons can then be drawn in parallel.
 	const stl_vertex_t ** const vertex_list = calloc(sizeof(*vertex_list), stl->num_vertex);
 
+	progress_start("trace", stl->num_face);
 	for(int i = 0 ; i < stl->num_face ; i++)
 	{
+		progress_add(1);
 		if (face_used[i])
 			continue;
 
+		progress_clear();
 		const stl_face_t * const f = &stl->face[i];
 		const int vertex_count = stl_trace_face(
 			stl,
@@ -91,39 +492,97 @@ main(void)
 
 		fprintf(stderr, "%d: %d vertices\n", i, vertex_count);
 
-		// generate a refernce frame based on this face
-		refframe_t ref;
-		refframe_init(&ref,
-			f->vertex[0]->p,
-			f->vertex[1]->p,
-			f->vertex[2]->p
-		);
-		printf("<!-- face %d --><g>\n", i);
-
-		// generate the polygon outline (should be one path?)
+		polygon_t * const poly = &polys[num_polys++];
+		poly->face = i;
+		poly->vertex_count = vertex_count;
+		poly->vertex_list = calloc(sizeof(*vertex_list), vertex_count);
 		for (int j = 0 ; j < vertex_count ; j++)
-			svg_line(
-				&ref,
-				vertex_list[(j+0) % vertex_count]->p,
-				vertex_list[(j+1) % vertex_count]->p
-			);
+			poly->vertex_list[j] = vertex_list[j];
+	}
 
-		// generate the inset mounting holes
-		for (int j = 0 ; j < vertex_count ; j++)
+	printf("<svg xmlns=\"http://www.w3.org/2000/svg\">\n");
+	printf("<g transform=\"scale(3.543307)\"><!-- scale to mm -->\n");
+
+	// generate a reference frame for each polygon based on its
+	// first face, all in one batch.
+	refframe_t * const refs = calloc(num_polys + 1, sizeof(*refs));
+	v3_soa_t p[3];
+	for (int k = 0 ; k < 3 ; k++)
+	{
+		p[k] = v3_soa_alloc(num_polys);
+		for (int j = 0 ; j < num_polys ; j++)
+			v3_soa_set(&p[k], j, stl_face_vertex(stl, polys[j].face, k)->p);
+	}
+	refframe_init_batch(refs, num_polys, p);
+	for (int k = 0 ; k < 3 ; k++)
+		v3_soa_free(&p[k]);
+
+	faces_print_t fp = {
+		.stl		= stl,
+		.polys		= polys,
+		.refs		= refs,
+		.inset_distance	= 6,
+		.hole_radius	= 3.0/2,
+		.sheets		= NULL,
+	};
+
+	if (estimate_file)
+	{
+		// costed as set out in the thumbnail; the svg has every
+		// polygon at its own origin, which would make the sheet
+		// far smaller than the parts on it.
+		double (* const offset)[2] = calloc(num_polys + 1, sizeof(*offset));
+		double size[2];
+		faces_layout(&fp, num_polys, offset, size);
+
+		fp.sheets = calloc(num_polys + 1, sizeof(*fp.sheets));
+		for (int j = 0 ; j < num_polys ; j++)
 		{
-			double x, y;
-			refframe_inset(&ref, inset_distance, &x, &y,
-				vertex_list[(j+0) % vertex_count]->p,
-				vertex_list[(j+1) % vertex_count]->p,
-				vertex_list[(j+2) % vertex_count]->p
-			);
-			svg_circle(x, y, hole_radius, "#00ff00");
+			cost_sheet_init(&fp.sheets[j]);
+			fp.sheets[j].offset[0] = offset[j][0];
+			fp.sheets[j].offset[1] = offset[j][1];
 		}
-
-		printf("</g>\n");
+		free(offset);
 	}
 
+	progress_start("polygons", num_polys);
+	pool_print(num_polys, polygon_print, &fp, stdout);
+	progress_end();
+
 	printf("</g></svg>\n");
 
+	if (pieces_file)
+	{
+		FILE * const f = fopen(pieces_file, "w");
+		if (!f)
+			err(EXIT_FAILURE, "%s", pieces_file);
+
+		faces_print_t fp_pieces = fp;
+		fp_pieces.sheets = NULL;
+		pieces_header(f);
+		progress_start("pieces", num_polys);
+		pool_print(num_polys, polygon_piece, &fp_pieces, f);
+		progress_end();
+		fclose(f);
+	}
+
+	if (thumb_file)
+		faces_thumb(thumb_file, &fp, num_polys);
+
+	if (estimate_file)
+	{
+		cost_sheet_t sheet;
+		cost_sheet_init(&sheet);
+		for (int j = 0 ; j < num_polys ; j++)
+			cost_sheet_merge(&sheet, &fp.sheets[j]);
+		free(fp.sheets);
+
+		FILE * const f = fopen(estimate_file, "w");
+		if (!f)
+			err(EXIT_FAILURE, "%s", estimate_file);
+		cost_json(f, &profile, &sheet, 1);
+		fclose(f);
+	}
+
 	return 0;
 }
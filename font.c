@@ -0,0 +1,146 @@
+/** \file
+ * Single stroke font.
+ *
+ * Each glyph is a string of strokes separated by spaces, and each
+ * stroke is a run of points written as two digits, x then y.
+ */
+#include "font.h"
+#include <string.h>
+
+static const char * const font_glyph[128] = {
+	['-'] = "0343",
+	['0'] = "103041453616050110 4105",
+	['1'] = "112026 0646",
+	['2'] = "01103041420646",
+	['3'] = "01103041423313 334445361605",
+	['4'] = "36300444",
+	['5'] = "4000033344453606",
+	['6'] = "30100105163645443303",
+	['7'] = "004016",
+	['8'] = "130201103041423313 1304051636454433",
+	['9'] = "43130201103041453616",
+	['A'] = "0602204246 0444",
+	['B'] = "00063645443303 3342413000",
+	['C'] = "4130100105163645",
+	['D'] = "00063645413000",
+	['E'] = "40000646 0333",
+	['F'] = "400006 0333",
+	['G'] = "41301001051636454323",
+	['H'] = "0006 4046 0343",
+	['I'] = "1030 2026 1636",
+	['J'] = "1040 3035261605",
+	['K'] = "0006 4004 1346",
+	['L'] = "000646",
+	['M'] = "0600224046",
+	['N'] = "06004640",
+	['O'] = "103041453616050110",
+	['P'] = "06003041423303",
+	['Q'] = "103041453616050110 2446",
+	['R'] = "06003041423303 2346",
+	['S'] = "413010010213334445361605",
+	['T'] = "0040 2026",
+	['U'] = "000516364540",
+	['V'] = "002640",
+	['W'] = "0016233640",
+	['X'] = "0046 4006",
+	['Y'] = "002340 2326",
+	['Z'] = "00400646",
+};
+
+
+int
+font_has(
+	const int c
+)
+{
+	return 0 <= c && c < 128 && font_glyph[c] != NULL;
+}
+
+
+int
+font_lines(
+	const int c,
+	const font_line_fn fn,
+	void * const arg
+)
+{
+	if (!font_has(c))
+		return 0;
+
+	const char * s = font_glyph[c];
+	int count = 0;
+
+	while (*s)
+	{
+		if (*s == ' ')
+		{
+			s++;
+			continue;
+		}
+
+		// the first point of the stroke, then a line to each
+		// of the following ones
+		int x = s[0] - '0';
+		int y = s[1] - '0';
+		s += 2;
+
+		while (*s && *s != ' ')
+		{
+			const int x2 = s[0] - '0';
+			const int y2 = s[1] - '0';
+			s += 2;
+
+			fn(arg, x, y, x2, y2);
+			count++;
+			x = x2;
+			y = y2;
+		}
+	}
+
+	return count;
+}
+
+
+double
+font_width(
+	const char * const s
+)
+{
+	const size_t len = strlen(s);
+	if (len == 0)
+		return 0;
+
+	return (len - 1) * FONT_ADVANCE + FONT_WIDTH;
+}
+
+
+void
+font_path(
+	FILE * const out,
+	const int c,
+	const double scale
+)
+{
+	if (!font_has(c))
+		return;
+
+	for (const char * s = font_glyph[c] ; *s ; )
+	{
+		if (*s == ' ')
+		{
+			s++;
+			continue;
+		}
+
+		char cmd = 'M';
+		while (*s && *s != ' ')
+		{
+			fprintf(out, "%c%g %g", cmd,
+				(s[0] - '0') * scale,
+				(s[1] - '0' - FONT_HEIGHT) * scale
+			);
+			cmd = 'L';
+			s += 2;
+		}
+	}
+}
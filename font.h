@@ -0,0 +1,66 @@
+/** \file
+ * Built-in single stroke font for engraved labels.
+ *
+ * Each glyph is a few polylines on a grid FONT_WIDTH units wide and
+ * FONT_HEIGHT units tall, with y pointing down from the top of the
+ * cell, so that the laser can engrave it in one pass per stroke
+ * instead of tracing the outline of a filled font.  Only digits,
+ * upper case letters and '-' are defined.
+ */
+#ifndef _papercraft_font_h_
+#define _papercraft_font_h_
+
+#include <stdio.h>
+
+#define FONT_WIDTH	4
+#define FONT_HEIGHT	6
+#define FONT_ADVANCE	6
+
+
+typedef void (*font_line_fn)(
+	void * arg,
+	double x1,
+	double y1,
+	double x2,
+	double y2
+);
+
+
+/** Does the font have a glyph for c? */
+int
+font_has(
+	int c
+);
+
+
+/** Call fn for each line of the glyph for c, in grid units.
+ * \return the number of lines.
+ */
+int
+font_lines(
+	int c,
+	font_line_fn fn,
+	void * arg
+);
+
+
+/** Width of the string in grid units, from the left of the first
+ * glyph to the right of the last one.
+ */
+double
+font_width(
+	const char * s
+);
+
+
+/** Write the glyph for c as SVG path data, scaled by scale and
+ * moved up so that the baseline is at y=0.
+ */
+void
+font_path(
+	FILE * out,
+	int c,
+	double scale
+);
+
+#endif
@@ -0,0 +1,484 @@
+/** \file
+ * Remnant inventory file and free space tracking.
+ */
+#include "inventory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <err.h>
+#include <sys/file.h>
+
+#define INVENTORY_MAGIC		"papercraft-inventory"
+#define INVENTORY_VERSION	1
+
+
+static void
+region_set(
+	inventory_region_t * const r,
+	double * const p,
+	const int n
+)
+{
+	r->p = p;
+	r->num_points = n;
+	r->min[0] = r->min[1] = INFINITY;
+	r->max[0] = r->max[1] = -INFINITY;
+
+	double area = 0;
+	for (int i = 0 ; i < n ; i++)
+	{
+		const int j = (i + 1) % n;
+		area += p[2*i+0] * p[2*j+1] - p[2*j+0] * p[2*i+1];
+		for (int k = 0 ; k < 2 ; k++)
+		{
+			if (p[2*i+k] < r->min[k]) r->min[k] = p[2*i+k];
+			if (p[2*i+k] > r->max[k]) r->max[k] = p[2*i+k];
+		}
+	}
+
+	r->area = fabs(area) / 2;
+}
+
+
+static void
+sheet_free_regions(
+	inventory_sheet_t * const sheet
+)
+{
+	for (int i = 0 ; i < sheet->num_regions ; i++)
+		free(sheet->region[i].p);
+	free(sheet->region);
+	sheet->region = NULL;
+	sheet->num_regions = 0;
+}
+
+
+static int
+inventory_read(
+	inventory_t * const inv,
+	FILE * const in
+)
+{
+	int version;
+	char magic[32];
+	if (fscanf(in, "%31s %d %d", magic, &version, &inv->next_id) != 3
+	||  strcmp(magic, INVENTORY_MAGIC) != 0
+	||  version != INVENTORY_VERSION)
+		errx(EXIT_FAILURE, "%s: not an inventory file", inv->path);
+
+	char key[16];
+	while (fscanf(in, "%15s", key) == 1)
+	{
+		if (strcmp(key, "sheet") != 0)
+			errx(EXIT_FAILURE, "%s: unknown record '%s'", inv->path, key);
+
+		inv->sheet = realloc(inv->sheet,
+			(inv->num_sheets + 1) * sizeof(*inv->sheet));
+		inventory_sheet_t * const sheet = &inv->sheet[inv->num_sheets++];
+		*sheet = (inventory_sheet_t) { 0 };
+
+		int num_regions;
+		if (fscanf(in, "%d %lf %lf %d",
+			&sheet->id,
+			&sheet->width,
+			&sheet->height,
+			&num_regions
+		) != 4 || num_regions < 0)
+			errx(EXIT_FAILURE, "%s: bad sheet", inv->path);
+
+		sheet->region = calloc(num_regions + 1, sizeof(*sheet->region));
+		for (int i = 0 ; i < num_regions ; i++)
+		{
+			int n;
+			if (fscanf(in, "%15s %d", key, &n) != 2
+			||  strcmp(key, "region") != 0
+			||  n < 3)
+				errx(EXIT_FAILURE, "%s: bad region on sheet %d",
+					inv->path, sheet->id);
+
+			double * const p = calloc(2 * n, sizeof(*p));
+			for (int k = 0 ; k < 2 * n ; k++)
+				if (fscanf(in, "%lf", &p[k]) != 1)
+					errx(EXIT_FAILURE, "%s: bad point on sheet %d",
+						inv->path, sheet->id);
+
+			region_set(&sheet->region[sheet->num_regions++], p, n);
+		}
+	}
+
+	return 0;
+}
+
+
+int
+inventory_open(
+	inventory_t * const inv,
+	const char * const path
+)
+{
+	*inv = (inventory_t) {
+		.path		= strdup(path),
+		.lock_fd	= -1,
+		.next_id	= 1,
+	};
+
+	char * const lock_path = calloc(strlen(path) + 8, 1);
+	sprintf(lock_path, "%s.lock", path);
+	inv->lock_fd = open(lock_path, O_RDWR | O_CREAT, 0666);
+	free(lock_path);
+	if (inv->lock_fd < 0)
+		return -1;
+
+	// every worker waits here for its turn
+	if (flock(inv->lock_fd, LOCK_EX) < 0)
+		return -1;
+
+	FILE * const in = fopen(path, "r");
+	if (!in)
+		return errno == ENOENT ? 0 : -1;
+
+	inventory_read(inv, in);
+	fclose(in);
+	return 0;
+}
+
+
+int
+inventory_write(
+	const inventory_t * const inv
+)
+{
+	// written beside the old file and renamed over it, so that
+	// a crash part way through leaves the old inventory intact.
+	char * const tmp_path = calloc(strlen(inv->path) + 32, 1);
+	sprintf(tmp_path, "%s.%d.tmp", inv->path, (int) getpid());
+
+	FILE * const out = fopen(tmp_path, "w");
+	if (!out)
+	{
+		free(tmp_path);
+		return -1;
+	}
+
+	fprintf(out, "%s %d %d\n", INVENTORY_MAGIC, INVENTORY_VERSION, inv->next_id);
+	for (int s = 0 ; s < inv->num_sheets ; s++)
+	{
+		const inventory_sheet_t * const sheet = &inv->sheet[s];
+		fprintf(out, "sheet %d %f %f %d\n",
+			sheet->id,
+			sheet->width,
+			sheet->height,
+			sheet->num_regions
+		);
+
+		for (int i = 0 ; i < sheet->num_regions ; i++)
+		{
+			const inventory_region_t * const r = &sheet->region[i];
+			fprintf(out, "region %d\n", r->num_points);
+			for (int k = 0 ; k < r->num_points ; k++)
+				fprintf(out, "%f %f\n", r->p[2*k+0], r->p[2*k+1]);
+		}
+	}
+
+	int rc = 0;
+	if (fflush(out) != 0 || fsync(fileno(out)) != 0)
+		rc = -1;
+	if (fclose(out) != 0)
+		rc = -1;
+	if (rc == 0 && rename(tmp_path, inv->path) != 0)
+		rc = -1;
+	if (rc != 0)
+		unlink(tmp_path);
+
+	free(tmp_path);
+	return rc;
+}
+
+
+void
+inventory_close(
+	inventory_t * const inv
+)
+{
+	if (inv->lock_fd >= 0)
+		close(inv->lock_fd);
+
+	for (int s = 0 ; s < inv->num_sheets ; s++)
+		sheet_free_regions(&inv->sheet[s]);
+	free(inv->sheet);
+	free(inv->path);
+	*inv = (inventory_t) { .lock_fd = -1 };
+}
+
+
+int
+inventory_add(
+	inventory_t * const inv,
+	const double width,
+	const double height
+)
+{
+	inv->sheet = realloc(inv->sheet, (inv->num_sheets + 1) * sizeof(*inv->sheet));
+	inventory_sheet_t * const sheet = &inv->sheet[inv->num_sheets];
+	*sheet = (inventory_sheet_t) {
+		.id		= inv->next_id++,
+		.width		= width,
+		.height		= height,
+		.region		= calloc(1, sizeof(*sheet->region)),
+		.num_regions	= 1,
+	};
+
+	double * const p = calloc(8, sizeof(*p));
+	const double rect[8] = { 0, 0, width, 0, width, height, 0, height };
+	memcpy(p, rect, sizeof(rect));
+	region_set(&sheet->region[0], p, 4);
+
+	return inv->num_sheets++;
+}
+
+
+/** Mark the cells whose centers are inside the n point polygon p,
+ * by even-odd scanlines across the grid.
+ */
+static void
+grid_fill(
+	uint8_t * const grid,
+	const int nx,
+	const int ny,
+	const double * const p,
+	const int n,
+	const uint8_t value
+)
+{
+	double * const xs = calloc(n + 1, sizeof(*xs));
+
+	for (int j = 0 ; j < ny ; j++)
+	{
+		const double y = (j + 0.5) * INVENTORY_RES;
+		int count = 0;
+		for (int i = 0, k = n - 1 ; i < n ; k = i++)
+		{
+			const double yi = p[2*i+1];
+			const double yk = p[2*k+1];
+			if ((yi > y) == (yk > y))
+				continue;
+			const double xi = p[2*i+0];
+			const double xk = p[2*k+0];
+			xs[count++] = xi + (y - yi) * (xk - xi) / (yk - yi);
+		}
+
+		// insertion sort; there are only a few crossings per row
+		for (int a = 1 ; a < count ; a++)
+			for (int b = a ; b > 0 && xs[b-1] > xs[b] ; b--)
+			{
+				const double t = xs[b];
+				xs[b] = xs[b-1];
+				xs[b-1] = t;
+			}
+
+		for (int a = 0 ; a + 1 < count ; a += 2)
+		{
+			int i0 = ceil(xs[a] / INVENTORY_RES - 0.5);
+			int i1 = floor(xs[a+1] / INVENTORY_RES - 0.5);
+			if (i0 < 0) i0 = 0;
+			if (i1 >= nx) i1 = nx - 1;
+			for (int i = i0 ; i <= i1 ; i++)
+				grid[j * nx + i] = value;
+		}
+	}
+
+	free(xs);
+}
+
+
+/** Mark every cell that an edge of the polygon passes through. */
+static void
+grid_outline(
+	uint8_t * const grid,
+	const int nx,
+	const int ny,
+	const double * const p,
+	const int n
+)
+{
+	for (int i = 0 ; i < n ; i++)
+	{
+		const int i1 = (i + 1) % n;
+		const double dx = p[2*i1+0] - p[2*i+0];
+		const double dy = p[2*i1+1] - p[2*i+1];
+		const int steps = 2 * ceil(hypot(dx, dy) / INVENTORY_RES) + 1;
+
+		for (int k = 0 ; k <= steps ; k++)
+		{
+			const double t = (double) k / steps;
+			const int x = floor((p[2*i+0] + t * dx) / INVENTORY_RES);
+			const int y = floor((p[2*i+1] + t * dy) / INVENTORY_RES);
+			if (0 <= x && x < nx && 0 <= y && y < ny)
+				grid[y * nx + x] = 1;
+		}
+	}
+}
+
+
+/** Grow the used cells by r in every direction. */
+static void
+grid_dilate(
+	uint8_t * const grid,
+	const int nx,
+	const int ny,
+	const int r
+)
+{
+	uint8_t * const tmp = calloc(nx * ny, 1);
+
+	for (int j = 0 ; j < ny ; j++)
+		for (int i = 0 ; i < nx ; i++)
+			for (int k = -r ; k <= r && !tmp[j * nx + i] ; k++)
+				if (0 <= i + k && i + k < nx && grid[j * nx + i + k])
+					tmp[j * nx + i] = 1;
+
+	for (int j = 0 ; j < ny ; j++)
+		for (int i = 0 ; i < nx ; i++)
+		{
+			grid[j * nx + i] = 0;
+			for (int k = -r ; k <= r && !grid[j * nx + i] ; k++)
+				if (0 <= j + k && j + k < ny && tmp[(j + k) * nx + i])
+					grid[j * nx + i] = 1;
+		}
+
+	free(tmp);
+}
+
+
+/** The largest rectangle of free cells with both sides at least
+ * min cells, by the histogram method over the rows.
+ * \return its area in cells, or 0 if there is none.
+ */
+static int
+grid_largest(
+	const uint8_t * const grid,
+	const int nx,
+	const int ny,
+	const int min,
+	int * const rect
+)
+{
+	int * const height = calloc(nx + 1, sizeof(*height));
+	int * const stack = calloc(nx + 2, sizeof(*stack));
+	int best = 0;
+
+	for (int j = 0 ; j < ny ; j++)
+	{
+		for (int i = 0 ; i < nx ; i++)
+			height[i] = grid[j * nx + i] ? 0 : height[i] + 1;
+		height[nx] = 0;
+
+		// every maximal rectangle that ends on this row is the
+		// widest run of bars at least as tall as some bar
+		int top = 0;
+		for (int i = 0 ; i <= nx ; i++)
+		{
+			while (top > 0 && height[stack[top-1]] >= height[i])
+			{
+				const int h = height[stack[--top]];
+				const int left = top > 0 ? stack[top-1] + 1 : 0;
+				const int w = i - left;
+				if (h >= min && w >= min && w * h > best)
+				{
+					best = w * h;
+					rect[0] = left;
+					rect[1] = j - h + 1;
+					rect[2] = w;
+					rect[3] = h;
+				}
+			}
+			stack[top++] = i;
+		}
+	}
+
+	free(height);
+	free(stack);
+	return best;
+}
+
+
+void
+inventory_cut(
+	inventory_sheet_t * const sheet,
+	const double * const * const outline,
+	const int * const count,
+	const int n,
+	const double gap
+)
+{
+	const int nx = ceil(sheet->width / INVENTORY_RES);
+	const int ny = ceil(sheet->height / INVENTORY_RES);
+	uint8_t * const grid = calloc(nx * ny, 1);
+
+	// only what was free before can be free now
+	memset(grid, 1, nx * ny);
+	for (int i = 0 ; i < sheet->num_regions ; i++)
+		grid_fill(grid, nx, ny,
+			sheet->region[i].p, sheet->region[i].num_points, 0);
+
+	// used cells are 1 for the dilation, which only grows the pieces
+	uint8_t * const used = calloc(nx * ny, 1);
+	for (int i = 0 ; i < n ; i++)
+	{
+		grid_fill(used, nx, ny, outline[i], count[i], 1);
+		grid_outline(used, nx, ny, outline[i], count[i]);
+	}
+	grid_dilate(used, nx, ny, ceil(gap / INVENTORY_RES));
+	for (int k = 0 ; k < nx * ny ; k++)
+		grid[k] |= used[k];
+	free(used);
+
+	sheet_free_regions(sheet);
+	sheet->region = calloc(INVENTORY_MAX_REGIONS, sizeof(*sheet->region));
+
+	const int min = ceil(INVENTORY_MIN_SIDE / INVENTORY_RES);
+	int rect[4];
+	while (sheet->num_regions < INVENTORY_MAX_REGIONS
+	&&     grid_largest(grid, nx, ny, min, rect))
+	{
+		for (int j = rect[1] ; j < rect[1] + rect[3] ; j++)
+			memset(&grid[j * nx + rect[0]], 1, rect[2]);
+
+		const double x0 = rect[0] * INVENTORY_RES;
+		const double y0 = rect[1] * INVENTORY_RES;
+		const double x1 = (rect[0] + rect[2]) * INVENTORY_RES;
+		const double y1 = (rect[1] + rect[3]) * INVENTORY_RES;
+		double * const p = calloc(8, sizeof(*p));
+		const double corners[8] = { x0, y0, x1, y0, x1, y1, x0, y1 };
+		memcpy(p, corners, sizeof(corners));
+		region_set(&sheet->region[sheet->num_regions++], p, 4);
+	}
+
+	free(grid);
+}
+
+
+void
+inventory_prune(
+	inventory_t * const inv
+)
+{
+	int count = 0;
+	for (int s = 0 ; s < inv->num_sheets ; s++)
+	{
+		if (inv->sheet[s].num_regions == 0)
+		{
+			sheet_free_regions(&inv->sheet[s]);
+			continue;
+		}
+
+		inv->sheet[count++] = inv->sheet[s];
+	}
+
+	inv->num_sheets = count;
+}
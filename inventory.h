@@ -0,0 +1,119 @@
+/** \file
+ * Inventory of partly used sheets.
+ *
+ * The inventory file records every sheet that still has usable free
+ * space after a job, with the free space as polygons in the frame of
+ * the sheet, so that `nest -i` can fill the remnants before it opens
+ * new sheets.  The file is rewritten whole while a lock on a separate
+ * ".lock" file is held, so batch workers that share it see each other's
+ * updates in turn and never a partial file.
+ *
+ *	papercraft-inventory 1 <next id>
+ *	sheet <id> <width> <height> <regions>
+ *	region <points>
+ *	<x> <y>		one line per point
+ */
+#ifndef _papercraft_inventory_h_
+#define _papercraft_inventory_h_
+
+// free space narrower than this is not worth keeping, in mm
+#define INVENTORY_MIN_SIDE	20.0
+
+// free space is found on a grid this fine, in mm
+#define INVENTORY_RES		1.0
+
+// the most free regions kept for one sheet
+#define INVENTORY_MAX_REGIONS	8
+
+
+typedef struct
+{
+	int num_points;
+	double * p;		// x,y of each point, in the sheet's frame
+	double min[2];
+	double max[2];
+	double area;
+} inventory_region_t;
+
+
+typedef struct
+{
+	int id;
+	double width;
+	double height;
+	inventory_region_t * region;
+	int num_regions;
+} inventory_sheet_t;
+
+
+typedef struct
+{
+	char * path;
+	int lock_fd;
+	int next_id;
+	inventory_sheet_t * sheet;
+	int num_sheets;
+} inventory_t;
+
+
+/** Lock the inventory at path and read it; a missing file is an
+ * empty inventory.  The lock is held until inventory_close().
+ * \return 0 on success, -1 with errno set on failure.
+ */
+int
+inventory_open(
+	inventory_t * inv,
+	const char * path
+);
+
+
+/** Replace the inventory file with the current sheets.
+ * \return 0 on success, -1 with errno set on failure.
+ */
+int
+inventory_write(
+	const inventory_t * inv
+);
+
+
+/** Release the lock and free the inventory. */
+void
+inventory_close(
+	inventory_t * inv
+);
+
+
+/** Add a new, entirely free sheet.
+ * \return its index in inv->sheet.
+ */
+int
+inventory_add(
+	inventory_t * inv,
+	double width,
+	double height
+);
+
+
+/** Take n pieces out of the free space of a sheet.
+ *
+ * outline[i] holds count[i] points in the sheet's frame.  Everything
+ * within gap of a piece is used, and the free space that is left is
+ * split into the largest rectangles, down to INVENTORY_MIN_SIDE.
+ */
+void
+inventory_cut(
+	inventory_sheet_t * sheet,
+	const double * const * outline,
+	const int * count,
+	int n,
+	double gap
+);
+
+
+/** Remove the sheets that have no free regions left. */
+void
+inventory_prune(
+	inventory_t * inv
+);
+
+#endif
@@ -0,0 +1,1192 @@
+/** \file
+ * Nest the pieces of several jobs onto shared sheets.
+ *
+ * The manifest lists one job per line, as a job id and the piece
+ * file that `unfold -o` or `faces -o` wrote for it.  Every piece of
+ * every job is placed, largest first, at the lowest and then leftmost
+ * spot on the first sheet that it fits on, trying each rotation at
+ * the corners of the pieces already on that sheet.  The candidate
+ * spots are tested in parallel.
+ *
+ * With an inventory, the free regions of the remnants from earlier
+ * jobs are tried first, smallest first, and the free space left on
+ * every sheet that was used is written back for the next job.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <err.h>
+#include "pieces.h"
+#include "inventory.h"
+#include "pool.h"
+#include "progress.h"
+
+#ifndef M_PI
+#define 	M_PI   3.1415926535897932384
+#endif
+
+#define NEST_MAX_ROT	16
+#define NEST_GRID	32	// cells along each side of a sheet
+
+
+typedef struct
+{
+	const char * job;
+	const piece_t * piece;
+	int order;
+	double area;
+
+	// the outline turned by each rotation and moved so that
+	// its bounding box starts at 0,0; min is how far it moved.
+	double * p[NEST_MAX_ROT];
+	double w[NEST_MAX_ROT];
+	double h[NEST_MAX_ROT];
+	double min[NEST_MAX_ROT][2];
+
+	// where it was placed
+	int sheet;
+	int rot;
+	double x;
+	double y;
+} nest_piece_t;
+
+
+typedef struct
+{
+	int * piece;
+	int count;
+	int max;
+} nest_cell_t;
+
+
+/** Where pieces can be placed: all of a new sheet, or one free
+ * region of a remnant.
+ */
+typedef struct
+{
+	nest_piece_t ** placed;
+	int count;
+	int max;
+	int full;		// holds a piece larger than the sheet
+	double area;
+
+	int stock;
+	double lo[2];
+	double hi[2];
+	double size;
+	const inventory_region_t * region;	// if it is not a rectangle
+
+	// the placed pieces whose boxes touch each cell of the sheet
+	nest_cell_t cell[NEST_GRID][NEST_GRID];
+} nest_sheet_t;
+
+
+/** A physical sheet, new or from the inventory. */
+typedef struct
+{
+	int remnant;		// index in the inventory, or -1 if new
+	double width;
+	double height;
+	int count;
+} nest_stock_t;
+
+
+typedef struct
+{
+	double width;
+	double height;
+	double gap;
+	int rotations;
+
+	// the free regions of the remnants come first, in order
+	// of their area, then the new sheets
+	nest_sheet_t * sheet;
+	int num_sheets;
+	int num_remnants;
+
+	nest_stock_t * stock;
+	int num_stock;
+} nest_t;
+
+
+/** The range of grid cells that x0 to x1 covers on a side that
+ * runs from lo to hi.
+ */
+static void
+nest_cells(
+	const double x0,
+	const double x1,
+	const double lo,
+	const double hi,
+	int * const c0,
+	int * const c1
+)
+{
+	*c0 = floor((x0 - lo) * NEST_GRID / (hi - lo));
+	*c1 = floor((x1 - lo) * NEST_GRID / (hi - lo));
+	if (*c0 < 0) *c0 = 0;
+	if (*c1 < 0) *c1 = 0;
+	if (*c0 >= NEST_GRID) *c0 = NEST_GRID - 1;
+	if (*c1 >= NEST_GRID) *c1 = NEST_GRID - 1;
+}
+
+
+/** A rotation of the piece at a spot, scored by how high its
+ * top is and then how far right it is.
+ */
+typedef struct
+{
+	double top;
+	double x;
+	int rot;
+	const double * off;
+} nest_fit_t;
+
+
+static void
+nest_rotate(
+	nest_piece_t * const np,
+	const int rotations
+)
+{
+	const int n = np->piece->num_points;
+	const double * const q = np->piece->p;
+
+	double area = 0;
+	for (int i = 0 ; i < n ; i++)
+	{
+		const int j = (i + 1) % n;
+		area += q[2*i+0] * q[2*j+1] - q[2*j+0] * q[2*i+1];
+	}
+	np->area = fabs(area) / 2;
+
+	for (int r = 0 ; r < rotations ; r++)
+	{
+		const double theta = 2 * M_PI * r / rotations;
+		const double c = cos(theta);
+		const double s = sin(theta);
+		double * const p = np->p[r] = calloc(2 * n, sizeof(*p));
+		double min[2] = { INFINITY, INFINITY };
+		double max[2] = { -INFINITY, -INFINITY };
+
+		for (int i = 0 ; i < n ; i++)
+		{
+			p[2*i+0] = c * q[2*i+0] - s * q[2*i+1];
+			p[2*i+1] = s * q[2*i+0] + c * q[2*i+1];
+			for (int k = 0 ; k < 2 ; k++)
+			{
+				if (p[2*i+k] < min[k]) min[k] = p[2*i+k];
+				if (p[2*i+k] > max[k]) max[k] = p[2*i+k];
+			}
+		}
+
+		for (int i = 0 ; i < n ; i++)
+			for (int k = 0 ; k < 2 ; k++)
+				p[2*i+k] -= min[k];
+
+		np->w[r] = max[0] - min[0];
+		np->h[r] = max[1] - min[1];
+		np->min[r][0] = min[0];
+		np->min[r][1] = min[1];
+	}
+}
+
+
+/** Squared distance from point p to the segment a-b. */
+static double
+point_seg_dist2(
+	const double * const p,
+	const double * const a,
+	const double * const b
+)
+{
+	const double dx = b[0] - a[0];
+	const double dy = b[1] - a[1];
+	const double len2 = dx*dx + dy*dy;
+	double t = len2 > 0
+		? ((p[0] - a[0]) * dx + (p[1] - a[1]) * dy) / len2
+		: 0;
+	if (t < 0) t = 0;
+	if (t > 1) t = 1;
+
+	const double ex = a[0] + t * dx - p[0];
+	const double ey = a[1] + t * dy - p[1];
+	return ex*ex + ey*ey;
+}
+
+
+static double
+cross2(
+	const double * const o,
+	const double * const a,
+	const double * const b
+)
+{
+	return (a[0] - o[0]) * (b[1] - o[1]) - (a[1] - o[1]) * (b[0] - o[0]);
+}
+
+
+/** Squared distance between the segments a0-a1 and b0-b1. */
+static double
+seg_dist2(
+	const double * const a0,
+	const double * const a1,
+	const double * const b0,
+	const double * const b1
+)
+{
+	const double d1 = cross2(a0, a1, b0);
+	const double d2 = cross2(a0, a1, b1);
+	const double d3 = cross2(b0, b1, a0);
+	const double d4 = cross2(b0, b1, a1);
+	if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0))
+	&&  ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0)))
+		return 0;
+
+	double d = point_seg_dist2(a0, b0, b1);
+	double e;
+	if ((e = point_seg_dist2(a1, b0, b1)) < d) d = e;
+	if ((e = point_seg_dist2(b0, a0, a1)) < d) d = e;
+	if ((e = point_seg_dist2(b1, a0, a1)) < d) d = e;
+	return d;
+}
+
+
+/** Even-odd test of point q against the n point polygon p at off. */
+static int
+point_inside(
+	const double * const q,
+	const double * const p,
+	const int n,
+	const double * const off
+)
+{
+	int inside = 0;
+	for (int i = 0, j = n - 1 ; i < n ; j = i++)
+	{
+		const double yi = p[2*i+1] + off[1];
+		const double yj = p[2*j+1] + off[1];
+		if ((yi > q[1]) == (yj > q[1]))
+			continue;
+
+		const double xi = p[2*i+0] + off[0];
+		const double xj = p[2*j+0] + off[0];
+		if (q[0] < xi + (q[1] - yi) * (xj - xi) / (yj - yi))
+			inside = !inside;
+	}
+
+	return inside;
+}
+
+
+/** Does edge i of the n point outline p at off touch the box lo-hi? */
+static int
+edge_near(
+	const double * const p,
+	const int n,
+	const int i,
+	const double * const off,
+	const double * const lo,
+	const double * const hi
+)
+{
+	const int i1 = (i + 1) % n;
+	const double x0 = p[2*i+0] + off[0];
+	const double y0 = p[2*i+1] + off[1];
+	const double x1 = p[2*i1+0] + off[0];
+	const double y1 = p[2*i1+1] + off[1];
+
+	return fmax(x0, x1) >= lo[0] && fmin(x0, x1) <= hi[0]
+	    && fmax(y0, y1) >= lo[1] && fmin(y0, y1) <= hi[1];
+}
+
+
+/** Would piece a, turned by rotation ra and placed at off, come
+ * within gap of the placed piece b?
+ */
+static int
+nest_collides(
+	const nest_piece_t * const a,
+	const int ra,
+	const double * const off,
+	const nest_piece_t * const b,
+	const double gap
+)
+{
+	const double boff[2] = { b->x, b->y };
+	const int rb = b->rot;
+
+	if (off[0] > boff[0] + b->w[rb] + gap
+	||  off[1] > boff[1] + b->h[rb] + gap
+	||  boff[0] > off[0] + a->w[ra] + gap
+	||  boff[1] > off[1] + a->h[ra] + gap)
+		return 0;
+
+	const int na = a->piece->num_points;
+	const int nb = b->piece->num_points;
+	const double * const pa = a->p[ra];
+	const double * const pb = b->p[rb];
+	const double gap2 = gap * gap;
+
+	// only the edges of each that are near the other's box
+	const double lo[2] = {
+		(off[0] > boff[0] ? off[0] : boff[0]) - gap,
+		(off[1] > boff[1] ? off[1] : boff[1]) - gap,
+	};
+	const double hi[2] = {
+		fmin(off[0] + a->w[ra], boff[0] + b->w[rb]) + gap,
+		fmin(off[1] + a->h[ra], boff[1] + b->h[rb]) + gap,
+	};
+
+	int * const near = calloc(na + nb, sizeof(*near));
+	int num_a = 0;
+	int num_b = na;
+	for (int i = 0 ; i < na ; i++)
+		if (edge_near(pa, na, i, off, lo, hi))
+			near[num_a++] = i;
+	for (int j = 0 ; j < nb && num_a ; j++)
+		if (edge_near(pb, nb, j, boff, lo, hi))
+			near[num_b++] = j;
+
+	int collides = 0;
+	for (int ia = 0 ; ia < num_a && !collides ; ia++)
+	{
+		const int i = near[ia];
+		const int i1 = (i + 1) % na;
+		const double a0[2] = { pa[2*i+0] + off[0], pa[2*i+1] + off[1] };
+		const double a1[2] = { pa[2*i1+0] + off[0], pa[2*i1+1] + off[1] };
+
+		for (int jb = na ; jb < num_b && !collides ; jb++)
+		{
+			const int j = near[jb];
+			const int j1 = (j + 1) % nb;
+			const double b0[2] = { pb[2*j+0] + boff[0], pb[2*j+1] + boff[1] };
+			const double b1[2] = { pb[2*j1+0] + boff[0], pb[2*j1+1] + boff[1] };
+			collides = seg_dist2(a0, a1, b0, b1) < gap2;
+		}
+	}
+
+	free(near);
+	if (collides)
+		return 1;
+
+	// no edges are close, so either one is inside the other
+	// or they are apart
+	const double qa[2] = { pa[0] + off[0], pa[1] + off[1] };
+	const double qb[2] = { pb[0] + boff[0], pb[1] + boff[1] };
+	return point_inside(qa, pb, nb, boff)
+	    || point_inside(qb, pa, na, off);
+}
+
+
+/** Is piece a, turned by rotation ra and placed at off, inside
+ * the free region r?
+ */
+static int
+nest_inside(
+	const inventory_region_t * const r,
+	const nest_piece_t * const a,
+	const int ra,
+	const double * const off
+)
+{
+	const int na = a->piece->num_points;
+	const double * const pa = a->p[ra];
+	const double zero[2] = { 0, 0 };
+
+	for (int i = 0 ; i < na ; i++)
+	{
+		const double q[2] = { pa[2*i+0] + off[0], pa[2*i+1] + off[1] };
+		if (!point_inside(q, r->p, r->num_points, zero))
+			return 0;
+	}
+
+	for (int i = 0 ; i < na ; i++)
+	{
+		const int i1 = (i + 1) % na;
+		const double a0[2] = { pa[2*i+0] + off[0], pa[2*i+1] + off[1] };
+		const double a1[2] = { pa[2*i1+0] + off[0], pa[2*i1+1] + off[1] };
+		for (int j = 0 ; j < r->num_points ; j++)
+		{
+			const int j1 = (j + 1) % r->num_points;
+			if (seg_dist2(a0, a1, &r->p[2*j], &r->p[2*j1]) == 0)
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+typedef struct
+{
+	const nest_t * nest;
+	const nest_sheet_t * sheet;
+	const nest_piece_t * np;
+	const nest_fit_t * fit;
+
+	// the other regions of the same remnant that come within
+	// the gap of this one
+	const int * near;
+	int num_near;
+} nest_arg_t;
+
+
+static int
+nest_fit_cmp(
+	const void * const a_ptr,
+	const void * const b_ptr
+)
+{
+	const nest_fit_t * const a = a_ptr;
+	const nest_fit_t * const b = b_ptr;
+	if (a->top != b->top)
+		return a->top < b->top ? -1 : 1;
+	if (a->x != b->x)
+		return a->x < b->x ? -1 : 1;
+	if (a->off != b->off)
+		return a->off < b->off ? -1 : 1;
+	return a->rot - b->rot;
+}
+
+
+/** Find the first candidate in [start,end) that fits; since they
+ * are sorted best first, the rest of the range can be skipped.
+ */
+static void
+nest_fit_range(
+	void * const arg_ptr,
+	const int start,
+	const int end,
+	void * const acc_ptr
+)
+{
+	const nest_arg_t * const arg = arg_ptr;
+	const nest_sheet_t * const sheet = arg->sheet;
+	const nest_piece_t * const np = arg->np;
+	const double gap = arg->nest->gap;
+	int * const best = acc_ptr;
+
+	for (int k = start ; k < end && *best < 0 ; k++)
+	{
+		const nest_fit_t * const fit = &arg->fit[k];
+		const double * const off = fit->off;
+		int cx0, cx1, cy0, cy1;
+		if (sheet->region && !nest_inside(sheet->region, np, fit->rot, off))
+			continue;
+
+		nest_cells(off[0] - gap, off[0] + np->w[fit->rot] + gap,
+			sheet->lo[0], sheet->hi[0], &cx0, &cx1);
+		nest_cells(off[1] - gap, off[1] + np->h[fit->rot] + gap,
+			sheet->lo[1], sheet->hi[1], &cy0, &cy1);
+
+		int collides = 0;
+		for (int cy = cy0 ; cy <= cy1 && !collides ; cy++)
+		for (int cx = cx0 ; cx <= cx1 && !collides ; cx++)
+		{
+			const nest_cell_t * const cell = &sheet->cell[cy][cx];
+			for (int i = 0 ; i < cell->count && !collides ; i++)
+			{
+				const nest_piece_t * const p = sheet->placed[cell->piece[i]];
+
+				// a piece in several cells is only tested in
+				// the first one that both boxes cover
+				int px0, px1, py0, py1;
+				nest_cells(p->x, p->x + p->w[p->rot],
+					sheet->lo[0], sheet->hi[0], &px0, &px1);
+				nest_cells(p->y, p->y + p->h[p->rot],
+					sheet->lo[1], sheet->hi[1], &py0, &py1);
+				if (cx != (px0 > cx0 ? px0 : cx0)
+				||  cy != (py0 > cy0 ? py0 : cy0))
+					continue;
+
+				collides = nest_collides(np, fit->rot, off, p, gap);
+			}
+		}
+
+		// the pieces just over the edge of the region are on
+		// the same physical sheet and need the same gap
+		for (int j = 0 ; j < arg->num_near && !collides ; j++)
+		{
+			const nest_sheet_t * const other = &arg->nest->sheet[arg->near[j]];
+			for (int i = 0 ; i < other->count && !collides ; i++)
+				collides = nest_collides(np, fit->rot, off,
+					other->placed[i], gap);
+		}
+
+		if (!collides)
+			*best = k;
+	}
+}
+
+
+static void
+nest_fit_combine(
+	void * const arg,
+	void * const acc_ptr,
+	const void * const other_ptr
+)
+{
+	(void) arg;
+	int * const acc = acc_ptr;
+	const int * const other = other_ptr;
+	if (*acc < 0)
+		*acc = *other;
+}
+
+
+/** Add a placed piece to the sheet and to the cells it covers. */
+static void
+nest_add(
+	nest_t * const nest,
+	nest_sheet_t * const sheet,
+	nest_piece_t * const np
+)
+{
+	nest->stock[sheet->stock].count++;
+
+	if (sheet->count == sheet->max)
+	{
+		sheet->max = sheet->max ? 2 * sheet->max : 16;
+		sheet->placed = realloc(sheet->placed,
+			sheet->max * sizeof(*sheet->placed));
+	}
+
+	const int index = sheet->count++;
+	sheet->placed[index] = np;
+	sheet->area += np->area;
+
+	int cx0, cx1, cy0, cy1;
+	nest_cells(np->x, np->x + np->w[np->rot],
+		sheet->lo[0], sheet->hi[0], &cx0, &cx1);
+	nest_cells(np->y, np->y + np->h[np->rot],
+		sheet->lo[1], sheet->hi[1], &cy0, &cy1);
+
+	for (int cy = cy0 ; cy <= cy1 ; cy++)
+	for (int cx = cx0 ; cx <= cx1 ; cx++)
+	{
+		nest_cell_t * const cell = &sheet->cell[cy][cx];
+		if (cell->count == cell->max)
+		{
+			cell->max = cell->max ? 2 * cell->max : 8;
+			cell->piece = realloc(cell->piece,
+				cell->max * sizeof(*cell->piece));
+		}
+		cell->piece[cell->count++] = index;
+	}
+}
+
+
+/** Try to place np on sheet s.
+ * \return 1 if it was placed, 0 if it does not fit.
+ */
+static int
+nest_place(
+	nest_t * const nest,
+	const int s,
+	nest_piece_t * const np
+)
+{
+	nest_sheet_t * const sheet = &nest->sheet[s];
+	const double gap = nest->gap;
+	if (sheet->full)
+		return 0;
+
+	// the corner of the sheet, and right of and above each of
+	// the placed pieces, against the edges and against the piece.
+	double * const spot = calloc(2 * (4 * sheet->count + 1), sizeof(*spot));
+	spot[0] = sheet->lo[0];
+	spot[1] = sheet->lo[1];
+	int num_spots = 1;
+	for (int i = 0 ; i < sheet->count ; i++)
+	{
+		const nest_piece_t * const p = sheet->placed[i];
+		const double right = p->x + p->w[p->rot] + gap;
+		const double top = p->y + p->h[p->rot] + gap;
+		const double xy[4][2] = {
+			{ right, p->y },
+			{ p->x, top },
+			{ right, sheet->lo[1] },
+			{ sheet->lo[0], top },
+		};
+		memcpy(&spot[2 * num_spots], xy, sizeof(xy));
+		num_spots += 4;
+	}
+
+	nest_fit_t * const fit = calloc(num_spots * nest->rotations, sizeof(*fit));
+	int num_fits = 0;
+	for (int i = 0 ; i < num_spots ; i++)
+	{
+		const double * const off = &spot[2*i];
+		for (int r = 0 ; r < nest->rotations ; r++)
+		{
+			if (off[0] + np->w[r] > sheet->hi[0]
+			||  off[1] + np->h[r] > sheet->hi[1])
+				continue;
+
+			fit[num_fits++] = (nest_fit_t) {
+				.top	= off[1] + np->h[r],
+				.x	= off[0],
+				.rot	= r,
+				.off	= off,
+			};
+		}
+	}
+	qsort(fit, num_fits, sizeof(*fit), nest_fit_cmp);
+
+	// only remnants are split into several regions; a new
+	// sheet is the one place on its stock
+	int * const near = calloc(nest->num_remnants + 1, sizeof(*near));
+	int num_near = 0;
+	for (int j = 0 ; j < nest->num_remnants ; j++)
+	{
+		const nest_sheet_t * const other = &nest->sheet[j];
+		if (j == s
+		||  other->stock != sheet->stock
+		||  other->count == 0
+		||  other->lo[0] > sheet->hi[0] + gap
+		||  other->lo[1] > sheet->hi[1] + gap
+		||  sheet->lo[0] > other->hi[0] + gap
+		||  sheet->lo[1] > other->hi[1] + gap)
+			continue;
+		near[num_near++] = j;
+	}
+
+	int best = -1;
+	nest_arg_t arg = {
+		.nest		= nest,
+		.sheet		= sheet,
+		.np		= np,
+		.fit		= fit,
+		.near		= near,
+		.num_near	= num_near,
+	};
+	pool_reduce(0, num_fits, 16, &best, sizeof(best),
+		nest_fit_range, nest_fit_combine, &arg);
+
+	if (best >= 0)
+	{
+		np->sheet = s;
+		np->rot = fit[best].rot;
+		np->x = fit[best].off[0];
+		np->y = fit[best].off[1];
+
+		nest_add(nest, sheet, np);
+	}
+
+	free(near);
+	free(fit);
+	free(spot);
+	return best >= 0;
+}
+
+
+static int
+nest_stock(
+	nest_t * const nest,
+	const int remnant,
+	const double width,
+	const double height
+)
+{
+	nest->stock = realloc(nest->stock,
+		(nest->num_stock + 1) * sizeof(*nest->stock));
+	nest->stock[nest->num_stock] = (nest_stock_t) {
+		.remnant	= remnant,
+		.width		= width,
+		.height		= height,
+	};
+	return nest->num_stock++;
+}
+
+
+/** Add a place for pieces from lo to hi on a stock sheet, limited
+ * to the region if there is one.
+ * \return its index.
+ */
+static int
+nest_sheet(
+	nest_t * const nest,
+	const int stock,
+	const double * const lo,
+	const double * const hi,
+	const inventory_region_t * const region
+)
+{
+	const double size = (hi[0] - lo[0]) * (hi[1] - lo[1]);
+
+	nest->sheet = realloc(nest->sheet,
+		(nest->num_sheets + 1) * sizeof(*nest->sheet));
+	nest->sheet[nest->num_sheets] = (nest_sheet_t) {
+		.stock	= stock,
+		.lo	= { lo[0], lo[1] },
+		.hi	= { hi[0], hi[1] },
+		.size	= region ? region->area : size,
+		.region	= region && region->area < size * 0.999 ? region : NULL,
+	};
+	return nest->num_sheets++;
+}
+
+
+static int
+nest_size_cmp(
+	const void * const a_ptr,
+	const void * const b_ptr
+)
+{
+	const nest_sheet_t * const a = a_ptr;
+	const nest_sheet_t * const b = b_ptr;
+	if (a->size != b->size)
+		return a->size < b->size ? -1 : 1;
+	if (a->stock != b->stock)
+		return a->stock - b->stock;
+	return a->lo[1] != b->lo[1]
+		? (a->lo[1] < b->lo[1] ? -1 : 1)
+		: (a->lo[0] < b->lo[0] ? -1 : a->lo[0] > b->lo[0]);
+}
+
+
+/** Make a place for each free region of each remnant, sorted by
+ * size so that the first that can hold a piece is found by a
+ * binary search.
+ */
+static void
+nest_remnants(
+	nest_t * const nest,
+	const inventory_t * const inv
+)
+{
+	for (int k = 0 ; k < inv->num_sheets ; k++)
+	{
+		const inventory_sheet_t * const sheet = &inv->sheet[k];
+		const int stock = nest_stock(nest, k, sheet->width, sheet->height);
+		for (int i = 0 ; i < sheet->num_regions ; i++)
+			nest_sheet(nest, stock,
+				sheet->region[i].min,
+				sheet->region[i].max,
+				&sheet->region[i]);
+	}
+
+	nest->num_remnants = nest->num_sheets;
+	qsort(nest->sheet, nest->num_sheets, sizeof(*nest->sheet), nest_size_cmp);
+}
+
+
+/** The first remnant region that is at least as large as area. */
+static int
+nest_first_remnant(
+	const nest_t * const nest,
+	const double area
+)
+{
+	int lo = 0;
+	int hi = nest->num_remnants;
+	while (lo < hi)
+	{
+		const int mid = (lo + hi) / 2;
+		if (nest->sheet[mid].size < area)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+/** Could any rotation of the piece's box fit in the sheet? */
+static int
+nest_box_fits(
+	const nest_t * const nest,
+	const nest_sheet_t * const sheet,
+	const nest_piece_t * const np
+)
+{
+	for (int r = 0 ; r < nest->rotations ; r++)
+		if (np->w[r] <= sheet->hi[0] - sheet->lo[0]
+		&&  np->h[r] <= sheet->hi[1] - sheet->lo[1])
+			return 1;
+	return 0;
+}
+
+
+/** Write s as the value of an attribute. */
+static void
+nest_attr(
+	FILE * const out,
+	const char * s
+)
+{
+	for ( ; *s ; s++)
+	{
+		switch (*s)
+		{
+		case '&': fputs("&amp;", out); break;
+		case '<': fputs("&lt;", out); break;
+		case '"': fputs("&quot;", out); break;
+		default: fputc(*s, out); break;
+		}
+	}
+}
+
+
+static void
+nest_print(
+	FILE * const out,
+	const nest_t * const nest,
+	const nest_piece_t * const np
+)
+{
+	const int r = np->rot;
+	fprintf(out, "<g transform=\"translate(%f %f) rotate(%f)\" data-job=\"",
+		np->x - np->min[r][0],
+		np->y - np->min[r][1],
+		360.0 * r / nest->rotations
+	);
+	nest_attr(out, np->job);
+
+	// the job is only in the attribute, since it may hold a --
+	// that would end a comment
+	fprintf(out, "\"><!-- piece %d -->\n", np->piece->id);
+	fwrite(np->piece->svg, 1, np->piece->svg_len, out);
+	fprintf(out, "</g>\n");
+}
+
+
+/** Take the placed pieces out of the free space of every sheet that
+ * was used, adding the new sheets to the inventory.
+ */
+static void
+nest_cut(
+	const nest_t * const nest,
+	inventory_t * const inv
+)
+{
+	for (int k = 0 ; k < nest->num_stock ; k++)
+	{
+		const nest_stock_t * const stock = &nest->stock[k];
+		if (stock->count == 0)
+			continue;
+
+		int n = 0;
+		double ** const outline = calloc(stock->count, sizeof(*outline));
+		int * const count = calloc(stock->count, sizeof(*count));
+		for (int s = 0 ; s < nest->num_sheets ; s++)
+		{
+			const nest_sheet_t * const sheet = &nest->sheet[s];
+			if (sheet->stock != k)
+				continue;
+
+			for (int i = 0 ; i < sheet->count ; i++)
+			{
+				const nest_piece_t * const np = sheet->placed[i];
+				const int points = np->piece->num_points;
+				double * const p = calloc(2 * points, sizeof(*p));
+				for (int j = 0 ; j < points ; j++)
+				{
+					p[2*j+0] = np->p[np->rot][2*j+0] + np->x;
+					p[2*j+1] = np->p[np->rot][2*j+1] + np->y;
+				}
+
+				outline[n] = p;
+				count[n] = points;
+				n++;
+			}
+		}
+
+		const int index = stock->remnant >= 0
+			? stock->remnant
+			: inventory_add(inv, stock->width, stock->height);
+		inventory_cut(&inv->sheet[index],
+			(const double * const *) outline, count, n, nest->gap);
+
+		for (int i = 0 ; i < n ; i++)
+			free(outline[i]);
+		free(outline);
+		free(count);
+	}
+
+	inventory_prune(inv);
+}
+
+
+static int
+nest_cmp(
+	const void * const a_ptr,
+	const void * const b_ptr
+)
+{
+	const nest_piece_t * const a = *(nest_piece_t * const *) a_ptr;
+	const nest_piece_t * const b = *(nest_piece_t * const *) b_ptr;
+	if (a->area != b->area)
+		return a->area > b->area ? -1 : 1;
+	return a->order - b->order;
+}
+
+
+/** Add each line of defs that is not already in *all. */
+static void
+nest_defs(
+	char ** const all,
+	size_t * const all_len,
+	const char * defs
+)
+{
+	while (defs && *defs)
+	{
+		const char * const eol = strchr(defs, '\n');
+		const size_t len = eol ? (size_t)(eol - defs) + 1 : strlen(defs);
+
+		int found = 0;
+		for (const char * s = *all ; s && *s && !found ; )
+		{
+			const char * const s_eol = strchr(s, '\n');
+			const size_t s_len = s_eol ? (size_t)(s_eol - s) + 1 : strlen(s);
+			found = s_len == len && memcmp(s, defs, len) == 0;
+			s += s_len;
+		}
+
+		if (!found)
+		{
+			*all = realloc(*all, *all_len + len + 1);
+			memcpy(*all + *all_len, defs, len);
+			*all_len += len;
+			(*all)[*all_len] = '\0';
+		}
+
+		defs += len;
+	}
+}
+
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+"usage: nest [-j threads] [-s WxH] [-g gap] [-r rotations] [-i inventory] manifest > sheets.svg\n"
+"\n"
+"Each line of the manifest is a job id and the piece file that\n"
+"unfold -o or faces -o wrote for it.\n"
+"\n"
+"-j N          Use N threads\n"
+"-s WxH        Sheet size in mm (default 600x400)\n"
+"-g mm         Space to leave between pieces (default 2)\n"
+"-r N          Rotations of each piece to try (default 4)\n"
+"-i file       Fill the remnants in the inventory first, and record\n"
+"              the free space left on every sheet that was used\n"
+	);
+	exit(EXIT_FAILURE);
+}
+
+
+int
+main(
+	int argc,
+	char ** argv
+)
+{
+	nest_t nest = {
+		.width		= 600,
+		.height		= 400,
+		.gap		= 2,
+		.rotations	= 4,
+	};
+	const char * inventory_file = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "j:s:g:r:i:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'j': pool_init(atoi(optarg)); break;
+		case 's':
+			if (sscanf(optarg, "%lfx%lf", &nest.width, &nest.height) != 2)
+				usage();
+			break;
+		case 'g': nest.gap = atof(optarg); break;
+		case 'r': nest.rotations = atoi(optarg); break;
+		case 'i': inventory_file = optarg; break;
+		default: usage();
+		}
+	}
+
+	if (argc - optind != 1
+	||  nest.rotations < 1 || nest.rotations > NEST_MAX_ROT
+	||  nest.width <= 0 || nest.height <= 0)
+		usage();
+
+	FILE * const manifest = fopen(argv[optind], "r");
+	if (!manifest)
+		err(EXIT_FAILURE, "%s", argv[optind]);
+
+	piece_file_t * files = NULL;
+	char ** jobs = NULL;
+	int num_jobs = 0;
+	int num_pieces = 0;
+	char * defs = NULL;
+	size_t defs_len = 0;
+
+	char line[1024];
+	while (fgets(line, sizeof(line), manifest))
+	{
+		char job[256], filename[768];
+		if (line[0] == '#' || sscanf(line, "%255s %767s", job, filename) != 2)
+			continue;
+
+		files = realloc(files, (num_jobs + 1) * sizeof(*files));
+		jobs = realloc(jobs, (num_jobs + 1) * sizeof(*jobs));
+		if (pieces_read(filename, &files[num_jobs]) < 0)
+			err(EXIT_FAILURE, "%s", filename);
+
+		jobs[num_jobs] = strdup(job);
+		num_pieces += files[num_jobs].count;
+		nest_defs(&defs, &defs_len, files[num_jobs].defs);
+		num_jobs++;
+	}
+	fclose(manifest);
+
+	nest_piece_t * const pieces = calloc(num_pieces + 1, sizeof(*pieces));
+	nest_piece_t ** const order = calloc(num_pieces + 1, sizeof(*order));
+	int count = 0;
+	for (int j = 0 ; j < num_jobs ; j++)
+	{
+		for (int i = 0 ; i < files[j].count ; i++)
+		{
+			nest_piece_t * const np = &pieces[count];
+			np->job = jobs[j];
+			np->piece = &files[j].piece[i];
+			np->order = count;
+			nest_rotate(np, nest.rotations);
+			order[count++] = np;
+		}
+	}
+
+	qsort(order, num_pieces, sizeof(*order), nest_cmp);
+
+	inventory_t inv;
+	if (inventory_file)
+	{
+		if (inventory_open(&inv, inventory_file) < 0)
+			err(EXIT_FAILURE, "%s", inventory_file);
+		nest_remnants(&nest, &inv);
+		fprintf(stderr, "%s: %d remnants, %d free regions\n",
+			inventory_file,
+			inv.num_sheets,
+			nest.num_remnants
+		);
+	}
+
+	progress_start("nest", num_pieces);
+	for (int i = 0 ; i < num_pieces ; i++)
+	{
+		nest_piece_t * const np = order[i];
+		progress_add(1);
+
+		// the smallest remnants that could hold it, then the
+		// sheets that have been opened, then a new sheet
+		int placed = 0;
+		for (int s = nest_first_remnant(&nest, np->area)
+		; s < nest.num_remnants && !placed
+		; s++)
+			if (nest_box_fits(&nest, &nest.sheet[s], np))
+				placed = nest_place(&nest, s, np);
+
+		for (int s = nest.num_remnants ; s < nest.num_sheets && !placed ; s++)
+			placed = nest_place(&nest, s, np);
+
+		if (placed)
+			continue;
+
+		const double lo[2] = { 0, 0 };
+		const double hi[2] = { nest.width, nest.height };
+		const int s = nest_sheet(&nest,
+			nest_stock(&nest, -1, nest.width, nest.height),
+			lo, hi, NULL);
+
+		if (nest_place(&nest, s, np))
+			continue;
+
+		// too big for any sheet; it goes on its own
+		progress_clear();
+		warnx("%s piece %d is larger than the sheet", np->job, np->piece->id);
+		np->sheet = s;
+		np->rot = 0;
+		np->x = np->y = 0;
+		nest_add(&nest, &nest.sheet[s], np);
+		nest.sheet[s].full = 1;
+	}
+	progress_end();
+
+	printf("<svg xmlns=\"http://www.w3.org/2000/svg\""
+		" xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n");
+	printf("<g transform=\"scale(3.543307)\"><!-- scale to mm -->\n");
+	if (defs)
+		printf("<defs>\n%s</defs>\n", defs);
+
+	// the sheets that were used are stacked down the page with
+	// a gap between them, remnants first
+	double y = 0;
+	int num_used = 0;
+	for (int k = 0 ; k < nest.num_stock ; k++)
+	{
+		const nest_stock_t * const stock = &nest.stock[k];
+		if (stock->count == 0)
+			continue;
+
+		if (stock->remnant >= 0)
+			printf("<g transform=\"translate(0 %f)\"><!-- remnant %d -->\n",
+				y, inv.sheet[stock->remnant].id);
+		else
+			printf("<g transform=\"translate(0 %f)\"><!-- sheet %d -->\n",
+				y, num_used);
+
+		double area = 0;
+		for (int s = 0 ; s < nest.num_sheets ; s++)
+		{
+			const nest_sheet_t * const sheet = &nest.sheet[s];
+			if (sheet->stock != k)
+				continue;
+
+			area += sheet->area;
+			for (int i = 0 ; i < sheet->count ; i++)
+				nest_print(stdout, &nest, sheet->placed[i]);
+		}
+
+		printf("</g>\n");
+
+		if (stock->remnant >= 0)
+			fprintf(stderr, "remnant %d: %d pieces, %.1f%% of the sheet\n",
+				inv.sheet[stock->remnant].id,
+				stock->count,
+				100 * area / (stock->width * stock->height)
+			);
+		else
+			fprintf(stderr, "sheet %d: %d pieces, %.1f%% used\n",
+				num_used,
+				stock->count,
+				100 * area / (stock->width * stock->height)
+			);
+
+		y += stock->height + 10;
+		num_used++;
+	}
+
+	printf("</g></svg>\n");
+
+	fprintf(stderr, "%d jobs, %d pieces on %d sheets\n",
+		num_jobs,
+		num_pieces,
+		num_used
+	);
+
+	if (inventory_file)
+	{
+		nest_cut(&nest, &inv);
+		if (inventory_write(&inv) < 0)
+			err(EXIT_FAILURE, "%s", inventory_file);
+		inventory_close(&inv);
+	}
+
+	return 0;
+}
@@ -0,0 +1,413 @@
+/** \file
+ * Print orientation search.
+ */
+#include "orient.h"
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#ifndef M_PI
+#define 	M_PI   3.1415926535897932384
+#endif
+
+// facets facing down by more than 45 degrees from the wall need support
+#define ORIENT_OVERHANG		0.7071
+
+// facets closer than this to the lowest point are on the bed
+#define ORIENT_BED		0.1
+
+// print time of one mm of height, as mm^3 of support
+#define ORIENT_HEIGHT_COST	20.0
+
+// points on the sphere to try, and facets to model curves with
+#define ORIENT_SAMPLES		256
+#define ORIENT_SEGMENTS		12
+
+
+void
+orient_part_init(
+	orient_part_t * const part
+)
+{
+	*part = (orient_part_t) { 0 };
+}
+
+
+void
+orient_part_free(
+	orient_part_t * const part
+)
+{
+	free(part->facet);
+	free(part->point);
+	orient_part_init(part);
+}
+
+
+void
+orient_facet(
+	orient_part_t * const part,
+	const v3_t n,
+	const v3_t c,
+	const real_t area
+)
+{
+	if (part->num_facet == part->max_facet)
+	{
+		part->max_facet = part->max_facet ? 2 * part->max_facet : 64;
+		part->facet = realloc(part->facet,
+			part->max_facet * sizeof(*part->facet));
+	}
+
+	part->facet[part->num_facet++] = (orient_facet_t) {
+		.n	= n,
+		.c	= c,
+		.area	= area,
+	};
+}
+
+
+void
+orient_point(
+	orient_part_t * const part,
+	const v3_t p
+)
+{
+	if (part->num_point == part->max_point)
+	{
+		part->max_point = part->max_point ? 2 * part->max_point : 64;
+		part->point = realloc(part->point,
+			part->max_point * sizeof(*part->point));
+	}
+
+	part->point[part->num_point++] = p;
+}
+
+
+/** Two unit vectors perpendicular to the unit vector n and to
+ * each other, with x cross y == n.
+ */
+static void
+orient_perp(
+	const v3_t n,
+	v3_t * const x,
+	v3_t * const y
+)
+{
+	// start from the axis least aligned with n
+	v3_t a = {{ 1, 0, 0 }};
+	if (fabs(n.p[1]) < fabs(n.p[0]) && fabs(n.p[1]) <= fabs(n.p[2]))
+		a = (v3_t) {{ 0, 1, 0 }};
+	else
+	if (fabs(n.p[2]) < fabs(n.p[0]))
+		a = (v3_t) {{ 0, 0, 1 }};
+
+	*y = v3_norm(v3_cross(n, a));
+	*x = v3_cross(*y, n);
+}
+
+
+/** Even points on the unit sphere, on a Fibonacci spiral. */
+static v3_t
+orient_sample(
+	const int k,
+	const int n
+)
+{
+	const real_t z = 1 - 2 * (k + 0.5) / n;
+	const real_t r = sqrt(1 - z*z);
+	const real_t phi = k * M_PI * (3 - sqrt(5));
+	return (v3_t) {{ r * cos(phi), r * sin(phi), z }};
+}
+
+
+void
+orient_cylinder(
+	orient_part_t * const part,
+	const v3_t base,
+	const v3_t axis,
+	const real_t r,
+	const real_t len
+)
+{
+	v3_t e1, e2;
+	orient_perp(axis, &e1, &e2);
+
+	const v3_t top = v3_add(base, v3_scale(axis, len));
+	const v3_t mid = v3_add(base, v3_scale(axis, len/2));
+
+	for (int k = 0 ; k < ORIENT_SEGMENTS ; k++)
+	{
+		const real_t phi = 2 * M_PI * k / ORIENT_SEGMENTS;
+		const v3_t n = v3_add(
+			v3_scale(e1, cos(phi)),
+			v3_scale(e2, sin(phi))
+		);
+		const v3_t rim = v3_scale(n, r);
+
+		orient_facet(part, n, v3_add(mid, rim),
+			2 * M_PI * r * len / ORIENT_SEGMENTS);
+		orient_point(part, v3_add(base, rim));
+		orient_point(part, v3_add(top, rim));
+	}
+
+	orient_facet(part, axis, top, M_PI * r * r);
+	orient_facet(part, v3_scale(axis, -1), base, M_PI * r * r);
+}
+
+
+void
+orient_sphere(
+	orient_part_t * const part,
+	const v3_t center,
+	const real_t r
+)
+{
+	const int n = 4 * ORIENT_SEGMENTS;
+	for (int k = 0 ; k < n ; k++)
+	{
+		const v3_t s = orient_sample(k, n);
+		const v3_t p = v3_add(center, v3_scale(s, r));
+		orient_facet(part, s, p, 4 * M_PI * r * r / n);
+		orient_point(part, p);
+	}
+}
+
+
+void
+orient_plate(
+	orient_part_t * const part,
+	const v3_t a,
+	const v3_t b,
+	const v3_t c,
+	const real_t thick
+)
+{
+	const v3_t cross = v3_cross(v3_sub(b, a), v3_sub(c, a));
+	const real_t mag = v3_mag(cross);
+	if (mag == 0)
+		return;
+
+	const real_t area = mag / 2;
+	const v3_t n = v3_scale(cross, 1 / mag);
+	const v3_t off = v3_scale(n, thick / 2);
+	const v3_t mid = v3_scale(v3_add(a, v3_add(b, c)), 1.0 / 3);
+
+	orient_facet(part, n, v3_add(mid, off), area);
+	orient_facet(part, v3_scale(n, -1), v3_sub(mid, off), area);
+
+	const v3_t p[3] = { a, b, c };
+	for (int k = 0 ; k < 3 ; k++)
+	{
+		orient_point(part, v3_add(p[k], off));
+		orient_point(part, v3_sub(p[k], off));
+	}
+}
+
+
+orient_t
+orient_score(
+	const orient_part_t * const part,
+	const v3_t up
+)
+{
+	orient_t o = { .up = up };
+	orient_perp(up, &o.x, &o.y);
+
+	real_t min = INFINITY;
+	real_t max = -INFINITY;
+	for (int i = 0 ; i < part->num_point ; i++)
+	{
+		const real_t z = v3_dot(part->point[i], up);
+		if (z < min) min = z;
+		if (z > max) max = z;
+	}
+
+	real_t support = 0;
+	for (int i = 0 ; i < part->num_facet ; i++)
+	{
+		const orient_facet_t * const f = &part->facet[i];
+		const real_t down = -v3_dot(f->n, up);
+		if (down < ORIENT_OVERHANG)
+			continue;
+
+		const real_t z = v3_dot(f->c, up) - min;
+		if (z < ORIENT_BED)
+			continue;
+
+		support += f->area * down * z;
+	}
+
+	o.min = min;
+	o.height = max - min;
+	o.support = support;
+	o.score = support + ORIENT_HEIGHT_COST * o.height;
+	return o;
+}
+
+
+/** Principal axes of the hull points, by Jacobi rotations of
+ * their covariance matrix.
+ */
+static void
+orient_axes(
+	const orient_part_t * const part,
+	v3_t axes[3]
+)
+{
+	double mean[3] = { 0, 0, 0 };
+	for (int i = 0 ; i < part->num_point ; i++)
+		for (int j = 0 ; j < 3 ; j++)
+			mean[j] += part->point[i].p[j] / part->num_point;
+
+	double a[3][3] = {{ 0 }};
+	for (int i = 0 ; i < part->num_point ; i++)
+		for (int j = 0 ; j < 3 ; j++)
+			for (int k = 0 ; k < 3 ; k++)
+				a[j][k] += (part->point[i].p[j] - mean[j])
+					 * (part->point[i].p[k] - mean[k]);
+
+	double v[3][3] = {{ 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }};
+
+	for (int sweep = 0 ; sweep < 16 ; sweep++)
+	{
+		for (int p = 0 ; p < 2 ; p++)
+		for (int q = p + 1 ; q < 3 ; q++)
+		{
+			if (fabs(a[p][q]) < 1e-12)
+				continue;
+
+			const double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+			const double t = (theta < 0 ? -1 : 1)
+				/ (fabs(theta) + sqrt(theta*theta + 1));
+			const double c = 1 / sqrt(t*t + 1);
+			const double s = t * c;
+
+			for (int k = 0 ; k < 3 ; k++)
+			{
+				const double akp = a[k][p];
+				const double akq = a[k][q];
+				a[k][p] = c * akp - s * akq;
+				a[k][q] = s * akp + c * akq;
+			}
+			for (int k = 0 ; k < 3 ; k++)
+			{
+				const double apk = a[p][k];
+				const double aqk = a[q][k];
+				a[p][k] = c * apk - s * aqk;
+				a[q][k] = s * apk + c * aqk;
+			}
+			for (int k = 0 ; k < 3 ; k++)
+			{
+				const double vkp = v[k][p];
+				const double vkq = v[k][q];
+				v[k][p] = c * vkp - s * vkq;
+				v[k][q] = s * vkp + c * vkq;
+			}
+		}
+	}
+
+	for (int j = 0 ; j < 3 ; j++)
+		axes[j] = (v3_t) {{ v[0][j], v[1][j], v[2][j] }};
+}
+
+
+typedef struct
+{
+	const orient_part_t * part;
+	const v3_t * up;
+} orient_arg_t;
+
+
+static void
+orient_best_range(
+	void * const arg_ptr,
+	const int start,
+	const int end,
+	void * const acc_ptr
+)
+{
+	const orient_arg_t * const arg = arg_ptr;
+	orient_t * const best = acc_ptr;
+
+	for (int i = start ; i < end ; i++)
+	{
+		const orient_t o = orient_score(arg->part, arg->up[i]);
+		if (o.score < best->score)
+			*best = o;
+	}
+}
+
+
+static void
+orient_best_combine(
+	void * const arg,
+	void * const acc_ptr,
+	const void * const other_ptr
+)
+{
+	(void) arg;
+	orient_t * const acc = acc_ptr;
+	const orient_t * const other = other_ptr;
+	if (other->score < acc->score)
+		*acc = *other;
+}
+
+
+orient_t
+orient_best(
+	const orient_part_t * const part
+)
+{
+	// resting each facet on the bed, both ways along each
+	// principal axis, and the sampled sphere
+	const int n = part->num_facet + 6 + ORIENT_SAMPLES;
+	v3_t * const up = calloc(n, sizeof(*up));
+	int count = 0;
+
+	for (int i = 0 ; i < part->num_facet ; i++)
+		up[count++] = v3_scale(part->facet[i].n, -1);
+
+	v3_t axes[3];
+	orient_axes(part, axes);
+	for (int j = 0 ; j < 3 ; j++)
+	{
+		up[count++] = axes[j];
+		up[count++] = v3_scale(axes[j], -1);
+	}
+
+	for (int k = 0 ; k < ORIENT_SAMPLES ; k++)
+		up[count++] = orient_sample(k, ORIENT_SAMPLES);
+
+	orient_t best = { .score = INFINITY };
+	orient_arg_t arg = {
+		.part	= part,
+		.up	= up,
+	};
+	pool_reduce(0, count, 32, &best, sizeof(best),
+		orient_best_range, orient_best_combine, &arg);
+
+	free(up);
+	return best;
+}
+
+
+void
+orient_multmatrix(
+	FILE * const out,
+	const orient_t * const o,
+	const real_t x,
+	const real_t y
+)
+{
+	fprintf(out, "multmatrix(m=["
+		"[%f,%f,%f,%f],"
+		"[%f,%f,%f,%f],"
+		"[%f,%f,%f,%f],"
+		"[0,0,0,1]])\n",
+		o->x.p[0], o->x.p[1], o->x.p[2], x,
+		o->y.p[0], o->y.p[1], o->y.p[2], y,
+		o->up.p[0], o->up.p[1], o->up.p[2], -o->min
+	);
+}
@@ -0,0 +1,142 @@
+/** \file
+ * Choose the orientation to 3D print a part in.
+ *
+ * The part is described by facets (outward normal, centroid, area)
+ * and by points on its hull.  Each candidate up direction is scored
+ * by the support it needs, which is the area of each facet facing
+ * down more steeply than ORIENT_OVERHANG times its height above the
+ * bed, plus a cost for the height of the print.  The candidates are
+ * the directions that put each facet flat on the bed, the principal
+ * axes of the hull points and an even sampling of the sphere.
+ */
+#ifndef _papercraft_orient_h_
+#define _papercraft_orient_h_
+
+#include <stdio.h>
+#include "v3.h"
+
+typedef struct
+{
+	v3_t n;
+	v3_t c;
+	real_t area;
+} orient_facet_t;
+
+
+typedef struct
+{
+	orient_facet_t * facet;
+	int num_facet;
+	int max_facet;
+
+	v3_t * point;
+	int num_point;
+	int max_point;
+} orient_part_t;
+
+
+typedef struct
+{
+	// the frame to print in: up leaves the bed, and x, y, up
+	// are the rows of the rotation from part to printer.
+	v3_t x;
+	v3_t y;
+	v3_t up;
+
+	real_t min;		// lowest point along up
+	real_t height;		// mm
+	real_t support;		// mm^3
+	real_t score;
+} orient_t;
+
+
+void
+orient_part_init(
+	orient_part_t * part
+);
+
+
+void
+orient_part_free(
+	orient_part_t * part
+);
+
+
+void
+orient_facet(
+	orient_part_t * part,
+	v3_t n,
+	v3_t c,
+	real_t area
+);
+
+
+void
+orient_point(
+	orient_part_t * part,
+	v3_t p
+);
+
+
+/** A closed cylinder from base along the unit vector axis. */
+void
+orient_cylinder(
+	orient_part_t * part,
+	v3_t base,
+	v3_t axis,
+	real_t r,
+	real_t len
+);
+
+
+void
+orient_sphere(
+	orient_part_t * part,
+	v3_t center,
+	real_t r
+);
+
+
+/** A flat plate on the triangle a,b,c, extending thick/2 to
+ * either side of it.
+ */
+void
+orient_plate(
+	orient_part_t * part,
+	v3_t a,
+	v3_t b,
+	v3_t c,
+	real_t thick
+);
+
+
+/** Score the part printed with the unit vector up pointing up. */
+orient_t
+orient_score(
+	const orient_part_t * part,
+	v3_t up
+);
+
+
+/** Score every candidate, in parallel, and return the best one.
+ * Ties go to the first candidate, so the result does not depend on
+ * the number of threads.
+ */
+orient_t
+orient_best(
+	const orient_part_t * part
+);
+
+
+/** Write the OpenSCAD multmatrix() that rotates the part into
+ * the frame of o and puts its lowest point on the bed at (x,y).
+ */
+void
+orient_multmatrix(
+	FILE * out,
+	const orient_t * o,
+	real_t x,
+	real_t y
+);
+
+#endif
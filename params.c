@@ -0,0 +1,164 @@
+/** \file
+ * Tunable parameters of the unfold heuristics.
+ */
+#include "params.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char * const params_start_name[PARAMS_STARTS] = {
+	[PARAMS_START_OFFSET]	= "offset",
+	[PARAMS_START_LARGEST]	= "largest",
+};
+
+
+void
+params_default(
+	params_t * const params
+)
+{
+	*params = (params_t) {
+		.folds_first	= 1,
+		.coplanar_now	= 1,
+		.start		= PARAMS_START_OFFSET,
+		.seeds		= 0,
+		.strips		= 0,
+		.strip_fold	= 45,
+		.strip_flat	= 1e-3,
+	};
+}
+
+
+int
+params_set(
+	params_t * const params,
+	const char * const key,
+	const char * const value
+)
+{
+	if (strcmp(key, "start") == 0)
+	{
+		for (int i = 0 ; i < PARAMS_STARTS ; i++)
+		{
+			if (strcmp(value, params_start_name[i]) != 0)
+				continue;
+			params->start = i;
+			return 0;
+		}
+		return -1;
+	}
+
+	char * end;
+	const double x = strtod(value, &end);
+	if (end == value || *end != '\0')
+		return -1;
+
+	if (strcmp(key, "folds_first") == 0)
+		params->folds_first = x != 0;
+	else
+	if (strcmp(key, "coplanar_now") == 0)
+		params->coplanar_now = x != 0;
+	else
+	if (strcmp(key, "seeds") == 0)
+		params->seeds = x;
+	else
+	if (strcmp(key, "strips") == 0)
+		params->strips = x != 0;
+	else
+	if (strcmp(key, "strip_fold") == 0)
+		params->strip_fold = x;
+	else
+	if (strcmp(key, "strip_flat") == 0)
+		params->strip_flat = x;
+	else
+		return -1;
+
+	return 0;
+}
+
+
+int
+params_load(
+	params_t * const params,
+	const char * const filename,
+	const char * const cls
+)
+{
+	FILE * const f = fopen(filename, "r");
+	if (!f)
+		return -1;
+
+	char line[256];
+	char key[64];
+	char value[64];
+
+	// the common parameters apply until the first class line
+	int active = 1;
+
+	while (fgets(line, sizeof(line), f))
+	{
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		if (sscanf(line, "%63s %63s", key, value) != 2)
+		{
+			fprintf(stderr, "%s: unable to parse '%s'\n", filename, line);
+			continue;
+		}
+
+		if (strcmp(key, "class") == 0)
+		{
+			active = cls && strcmp(value, cls) == 0;
+			continue;
+		}
+
+		if (!active)
+			continue;
+
+		if (params_set(params, key, value) < 0)
+			fprintf(stderr, "%s: bad parameter '%s %s'\n",
+				filename, key, value);
+	}
+
+	fclose(f);
+	return 0;
+}
+
+
+void
+params_write(
+	FILE * const out,
+	const params_t * const params
+)
+{
+	fprintf(out, "folds_first %d\n", params->folds_first);
+	fprintf(out, "coplanar_now %d\n", params->coplanar_now);
+	fprintf(out, "start %s\n", params_start_name[params->start]);
+	fprintf(out, "seeds %d\n", params->seeds);
+	fprintf(out, "strips %d\n", params->strips);
+	fprintf(out, "strip_fold %g\n", params->strip_fold);
+	fprintf(out, "strip_flat %g\n", params->strip_flat);
+}
+
+
+const char *
+params_class(
+	const int num_triangles,
+	const double flat_fraction
+)
+{
+	static const char * const names[3][2] = {
+		{ "small-smooth", "small-faceted" },
+		{ "medium-smooth", "medium-faceted" },
+		{ "large-smooth", "large-faceted" },
+	};
+
+	const int size = num_triangles < 500 ? 0
+		: num_triangles < 5000 ? 1
+		: 2;
+
+	// a flat sided model has at least the diagonals of its faces
+	// flat, a smooth one has few or none.
+	const int faceted = flat_fraction >= 0.2;
+
+	return names[size][faceted];
+}
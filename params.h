@@ -0,0 +1,87 @@
+/** \file
+ * Tunable parameters of the unfold heuristics.
+ *
+ * `tune` searches for the parameters that give the fewest pieces and
+ * the shortest cuts over a corpus of meshes and writes the best set
+ * for each class of mesh; `unfold -p` reads them at startup and uses
+ * the set for the class of the mesh that it is given.  The file is
+ * "key value" lines; those after a "class <name>" line only apply to
+ * meshes of that class, and those before any apply to all of them.
+ *
+ *	class small-faceted
+ *	folds_first 1
+ *	strips 0
+ */
+#ifndef _papercraft_params_h_
+#define _papercraft_params_h_
+
+#include <stdio.h>
+
+typedef enum
+{
+	PARAMS_START_OFFSET,	// every face in turn from the start face
+	PARAMS_START_LARGEST,	// the largest faces first
+	PARAMS_STARTS
+} params_start_t;
+
+
+typedef struct
+{
+	int folds_first;	// try folded neighbors before coplanar ones
+	int coplanar_now;	// grow from coplanar neighbors before the rest
+	params_start_t start;	// the order in which groups are rooted
+	int seeds;		// groups grown at once, or 0
+	int strips;		// lay out developable strips first
+	double strip_fold;	// degrees, sharper folds are creases
+	double strip_flat;	// radians from 2 pi that is still flat
+} params_t;
+
+
+/** Fill in the built-in parameters. */
+void
+params_default(
+	params_t * params
+);
+
+
+/** Set one parameter from its text value.
+ * \return 0 on success, -1 if the key or value is not known.
+ */
+int
+params_set(
+	params_t * params,
+	const char * key,
+	const char * value
+);
+
+
+/** Read the parameters for mesh class cls from a file over the
+ * current ones.  cls may be NULL to read only the common ones.
+ * \return 0 on success, -1 with errno set if the file can not be read.
+ */
+int
+params_load(
+	params_t * params,
+	const char * filename,
+	const char * cls
+);
+
+
+/** Write every parameter as "key value" lines. */
+void
+params_write(
+	FILE * out,
+	const params_t * params
+);
+
+
+/** Name the class of a mesh from its size and the fraction of its
+ * edges that are flat, which is what the best parameters depend on.
+ */
+const char *
+params_class(
+	int num_triangles,
+	double flat_fraction
+);
+
+#endif
@@ -0,0 +1,155 @@
+/** \file
+ * Piece file reader and writer.
+ */
+#include "pieces.h"
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#define PIECES_MAGIC	"papercraft-pieces"
+#define PIECES_VERSION	1
+
+
+void
+pieces_header(
+	FILE * const out
+)
+{
+	fprintf(out, "%s %d\n", PIECES_MAGIC, PIECES_VERSION);
+}
+
+
+void
+pieces_write(
+	FILE * const out,
+	const int id,
+	const double * const p,
+	const int n,
+	const char * const svg,
+	const size_t svg_len
+)
+{
+	fprintf(out, "piece %d %d %zu\n", id, n, svg_len);
+	for (int i = 0 ; i < n ; i++)
+		fprintf(out, "%f %f\n", p[2*i+0], p[2*i+1]);
+	fwrite(svg, 1, svg_len, out);
+	fprintf(out, "\n");
+}
+
+
+void
+pieces_defs(
+	FILE * const out,
+	const char * const defs,
+	const size_t defs_len
+)
+{
+	fprintf(out, "defs %zu\n", defs_len);
+	fwrite(defs, 1, defs_len, out);
+	fprintf(out, "\n");
+}
+
+
+/** Read len bytes of SVG that follow the newline after a header. */
+static char *
+pieces_blob(
+	FILE * const in,
+	const char * const filename,
+	const size_t len
+)
+{
+	if (fgetc(in) != '\n')
+		errx(EXIT_FAILURE, "%s: missing newline before svg", filename);
+
+	char * const buf = calloc(len + 1, 1);
+	if (fread(buf, 1, len, in) != len)
+		errx(EXIT_FAILURE, "%s: short svg", filename);
+
+	return buf;
+}
+
+
+int
+pieces_read(
+	const char * const filename,
+	piece_file_t * const file
+)
+{
+	FILE * const in = fopen(filename, "r");
+	if (!in)
+		return -1;
+
+	*file = (piece_file_t) { 0 };
+
+	char magic[32];
+	int version;
+	if (fscanf(in, "%31s %d", magic, &version) != 2
+	||  strcmp(magic, PIECES_MAGIC) != 0)
+		errx(EXIT_FAILURE, "%s: not a piece file", filename);
+	if (version != PIECES_VERSION)
+		errx(EXIT_FAILURE, "%s: version %d not supported", filename, version);
+
+	int max = 0;
+	char key[16];
+
+	while (fscanf(in, "%15s", key) == 1)
+	{
+		size_t len;
+
+		if (strcmp(key, "defs") == 0)
+		{
+			if (fscanf(in, "%zu", &len) != 1)
+				errx(EXIT_FAILURE, "%s: bad defs", filename);
+
+			char * const defs = pieces_blob(in, filename, len);
+			file->defs = realloc(file->defs, file->defs_len + len + 1);
+			memcpy(file->defs + file->defs_len, defs, len + 1);
+			file->defs_len += len;
+			free(defs);
+			continue;
+		}
+
+		if (strcmp(key, "piece") != 0)
+			errx(EXIT_FAILURE, "%s: unknown record '%s'", filename, key);
+
+		if (file->count == max)
+		{
+			max = max ? 2 * max : 64;
+			file->piece = realloc(file->piece, max * sizeof(*file->piece));
+		}
+
+		piece_t * const piece = &file->piece[file->count++];
+		if (fscanf(in, "%d %d %zu", &piece->id, &piece->num_points, &len) != 3
+		||  piece->num_points < 3)
+			errx(EXIT_FAILURE, "%s: bad piece %d", filename, file->count);
+
+		piece->p = calloc(2 * piece->num_points, sizeof(*piece->p));
+		for (int i = 0 ; i < 2 * piece->num_points ; i++)
+			if (fscanf(in, "%lf", &piece->p[i]) != 1)
+				errx(EXIT_FAILURE, "%s: bad point in piece %d",
+					filename, piece->id);
+
+		piece->svg = pieces_blob(in, filename, len);
+		piece->svg_len = len;
+	}
+
+	fclose(in);
+	return 0;
+}
+
+
+void
+pieces_free(
+	piece_file_t * const file
+)
+{
+	for (int i = 0 ; i < file->count ; i++)
+	{
+		free(file->piece[i].p);
+		free(file->piece[i].svg);
+	}
+
+	free(file->piece);
+	free(file->defs);
+	*file = (piece_file_t) { 0 };
+}
@@ -0,0 +1,83 @@
+/** \file
+ * Piece files, for nesting the output of several jobs together.
+ *
+ * `unfold -o` and `faces -o` write every piece that they lay out as
+ * its outline and the SVG that draws it, both in the frame of the
+ * piece, so that `nest` can place the pieces of many jobs on shared
+ * sheets.  The file is text:
+ *
+ *	papercraft-pieces 1
+ *	piece <id> <points> <svg bytes>
+ *	<x> <y>		one line per point of the outline
+ *	<svg>		exactly <svg bytes> of SVG
+ *	defs <bytes>
+ *	<svg>		elements for the <defs>, one per line
+ */
+#ifndef _papercraft_pieces_h_
+#define _papercraft_pieces_h_
+
+#include <stdio.h>
+#include <stddef.h>
+
+typedef struct
+{
+	int id;
+	int num_points;
+	double * p;		// x,y of each point of the outline
+	char * svg;
+	size_t svg_len;
+} piece_t;
+
+
+typedef struct
+{
+	piece_t * piece;
+	int count;
+	char * defs;
+	size_t defs_len;
+} piece_file_t;
+
+
+void
+pieces_header(
+	FILE * out
+);
+
+
+/** Write one piece with n outline points at p. */
+void
+pieces_write(
+	FILE * out,
+	int id,
+	const double * p,
+	int n,
+	const char * svg,
+	size_t svg_len
+);
+
+
+void
+pieces_defs(
+	FILE * out,
+	const char * defs,
+	size_t defs_len
+);
+
+
+/** Read every piece in a file.
+ * \return 0 on success, or -1 with errno set if the file can not be
+ * read.  A malformed file is a fatal error.
+ */
+int
+pieces_read(
+	const char * filename,
+	piece_file_t * file
+);
+
+
+void
+pieces_free(
+	piece_file_t * file
+);
+
+#endif
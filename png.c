@@ -0,0 +1,314 @@
+/** \file
+ * PNG encoder.
+ */
+#include "png.h"
+#include <stdlib.h>
+#include <string.h>
+
+// LZ77 window, and how many earlier matches are tried at each byte
+#define PNG_WINDOW	32768
+#define PNG_HASH	(1 << 15)
+#define PNG_CHAIN	16
+#define PNG_MAX_MATCH	258
+
+
+typedef struct
+{
+	uint8_t * data;
+	size_t len;
+	size_t max;
+	uint32_t bits;
+	int num_bits;
+} png_bits_t;
+
+
+static void
+png_byte(
+	png_bits_t * const b,
+	const uint8_t x
+)
+{
+	if (b->len == b->max)
+	{
+		b->max = b->max ? 2 * b->max : 65536;
+		b->data = realloc(b->data, b->max);
+	}
+	b->data[b->len++] = x;
+}
+
+
+/** Add n bits of x, least significant first. */
+static void
+png_put(
+	png_bits_t * const b,
+	const uint32_t x,
+	const int n
+)
+{
+	b->bits |= x << b->num_bits;
+	b->num_bits += n;
+	while (b->num_bits >= 8)
+	{
+		png_byte(b, b->bits);
+		b->bits >>= 8;
+		b->num_bits -= 8;
+	}
+}
+
+
+/** Add a Huffman code, which goes most significant bit first. */
+static void
+png_code(
+	png_bits_t * const b,
+	const uint32_t code,
+	const int n
+)
+{
+	uint32_t r = 0;
+	for (int i = 0 ; i < n ; i++)
+		r |= ((code >> i) & 1) << (n - 1 - i);
+	png_put(b, r, n);
+}
+
+
+/** The fixed literal/length code of symbol s. */
+static void
+png_symbol(
+	png_bits_t * const b,
+	const int s
+)
+{
+	if (s < 144)
+		png_code(b, 0x30 + s, 8);
+	else
+	if (s < 256)
+		png_code(b, 0x190 + s - 144, 9);
+	else
+	if (s < 280)
+		png_code(b, s - 256, 7);
+	else
+		png_code(b, 0xC0 + s - 280, 8);
+}
+
+
+static const uint16_t png_len_base[] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const uint8_t png_len_extra[] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const uint16_t png_dist_base[] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+	8193, 12289, 16385, 24577,
+};
+static const uint8_t png_dist_extra[] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+
+static void
+png_match(
+	png_bits_t * const b,
+	const int len,
+	const int dist
+)
+{
+	int l = 28;
+	while (png_len_base[l] > len)
+		l--;
+	png_symbol(b, 257 + l);
+	png_put(b, len - png_len_base[l], png_len_extra[l]);
+
+	int d = 29;
+	while (png_dist_base[d] > dist)
+		d--;
+	png_code(b, d, 5);
+	png_put(b, dist - png_dist_base[d], png_dist_extra[d]);
+}
+
+
+static uint32_t
+png_hash(
+	const uint8_t * const p
+)
+{
+	return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> 17;
+}
+
+
+/** Compress src as a zlib stream of one fixed Huffman block. */
+static void
+png_deflate(
+	png_bits_t * const b,
+	const uint8_t * const src,
+	const size_t len
+)
+{
+	int * const head = malloc(PNG_HASH * sizeof(*head));
+	int * const prev = malloc(PNG_WINDOW * sizeof(*prev));
+	for (int i = 0 ; i < PNG_HASH ; i++)
+		head[i] = -1;
+
+	png_byte(b, 0x78);
+	png_byte(b, 0x01);
+	png_put(b, 1, 1);	// final block
+	png_put(b, 1, 2);	// fixed codes
+
+	size_t i = 0;
+	while (i < len)
+	{
+		int best_len = 0;
+		int best_dist = 0;
+
+		if (i + 3 <= len)
+		{
+			const uint32_t hash = png_hash(&src[i]);
+			int cand = head[hash];
+			const size_t max = len - i < PNG_MAX_MATCH ? len - i : PNG_MAX_MATCH;
+
+			for (int n = 0 ; n < PNG_CHAIN && cand >= 0 ; n++)
+			{
+				if (i - cand > PNG_WINDOW - 1)
+					break;
+
+				size_t k = 0;
+				while (k < max && src[cand + k] == src[i + k])
+					k++;
+				if ((int) k > best_len)
+				{
+					best_len = k;
+					best_dist = i - cand;
+					if (k == max)
+						break;
+				}
+
+				cand = prev[cand % PNG_WINDOW];
+			}
+		}
+
+		const size_t step = best_len >= 3 ? (size_t) best_len : 1;
+		if (best_len >= 3)
+			png_match(b, best_len, best_dist);
+		else
+			png_symbol(b, src[i]);
+
+		// every position that was passed goes into the chains
+		for (size_t k = 0 ; k < step ; k++, i++)
+		{
+			if (i + 3 > len)
+				continue;
+			const uint32_t hash = png_hash(&src[i]);
+			prev[i % PNG_WINDOW] = head[hash];
+			head[hash] = i;
+		}
+	}
+
+	png_symbol(b, 256);
+	if (b->num_bits)
+		png_put(b, 0, 8 - b->num_bits);
+
+	uint32_t s1 = 1;
+	uint32_t s2 = 0;
+	for (size_t k = 0 ; k < len ; k++)
+	{
+		s1 = (s1 + src[k]) % 65521;
+		s2 = (s2 + s1) % 65521;
+	}
+	const uint32_t adler = s2 << 16 | s1;
+	for (int k = 3 ; k >= 0 ; k--)
+		png_byte(b, adler >> (8 * k));
+
+	free(head);
+	free(prev);
+}
+
+
+static void
+png_be32(
+	uint8_t * const p,
+	const uint32_t x
+)
+{
+	p[0] = x >> 24;
+	p[1] = x >> 16;
+	p[2] = x >> 8;
+	p[3] = x >> 0;
+}
+
+
+/** Write a chunk with its length and CRC. */
+static void
+png_chunk(
+	FILE * const out,
+	const char * const type,
+	const uint8_t * const data,
+	const size_t len
+)
+{
+	uint32_t table[256];
+	for (uint32_t n = 0 ; n < 256 ; n++)
+	{
+		uint32_t c = n;
+		for (int k = 0 ; k < 8 ; k++)
+			c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+		table[n] = c;
+	}
+
+	uint8_t hdr[8];
+	png_be32(hdr, len);
+	memcpy(hdr + 4, type, 4);
+
+	uint32_t crc = 0xFFFFFFFF;
+	for (int k = 4 ; k < 8 ; k++)
+		crc = table[(crc ^ hdr[k]) & 0xFF] ^ (crc >> 8);
+	for (size_t k = 0 ; k < len ; k++)
+		crc = table[(crc ^ data[k]) & 0xFF] ^ (crc >> 8);
+
+	uint8_t tail[4];
+	png_be32(tail, crc ^ 0xFFFFFFFF);
+
+	fwrite(hdr, 1, sizeof(hdr), out);
+	if (len)
+		fwrite(data, 1, len, out);
+	fwrite(tail, 1, sizeof(tail), out);
+}
+
+
+int
+png_write(
+	FILE * const out,
+	const int w,
+	const int h,
+	const uint8_t * const rgb
+)
+{
+	static const uint8_t magic[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	fwrite(magic, 1, sizeof(magic), out);
+
+	uint8_t ihdr[13] = {
+		[8]	= 8,	// bits per sample
+		[9]	= 2,	// RGB
+	};
+	png_be32(ihdr + 0, w);
+	png_be32(ihdr + 4, h);
+	png_chunk(out, "IHDR", ihdr, sizeof(ihdr));
+
+	// each row starts with its filter type, which is always none
+	const size_t stride = 3 * (size_t) w + 1;
+	uint8_t * const raw = calloc(stride * h + 1, 1);
+	for (int y = 0 ; y < h ; y++)
+		memcpy(raw + y * stride + 1, rgb + y * (stride - 1), stride - 1);
+
+	png_bits_t b = { 0 };
+	png_deflate(&b, raw, stride * h);
+	png_chunk(out, "IDAT", b.data, b.len);
+	png_chunk(out, "IEND", NULL, 0);
+
+	free(raw);
+	free(b.data);
+	return ferror(out) ? -1 : 0;
+}
@@ -0,0 +1,25 @@
+/** \file
+ * PNG encoder.
+ *
+ * Writes 8 bit RGB images, compressed with the fixed Huffman codes of
+ * deflate and a short LZ77 search, which is quick and does well on the
+ * large flat areas of a thumbnail.
+ */
+#ifndef _papercraft_png_h_
+#define _papercraft_png_h_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/** Write the w by h image of RGB triples, top row first.
+ * \return 0 on success, -1 with errno set if it could not be written.
+ */
+int
+png_write(
+	FILE * out,
+	int w,
+	int h,
+	const uint8_t * rgb
+);
+
+#endif
@@ -0,0 +1,427 @@
+/** \file
+ * Work-stealing thread pool.
+ *
+ * Each worker owns a range of chunk indices and takes chunks from the
+ * front of it.  A worker whose range is empty steals the back half of
+ * another worker's range.  The calling thread takes part as worker 0.
+ */
+#include "pool.h"
+#include "progress.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <err.h>
+
+#define POOL_MAX_THREADS 256
+
+typedef struct pool_job pool_job_t;
+
+struct pool_job
+{
+	int start;
+	int end;
+	int grain;
+	int num_chunks;
+
+	void (*run)(const pool_job_t * job, int chunk, int start, int end);
+
+	pool_for_fn for_fn;
+	pool_reduce_fn reduce_fn;
+	const void * identity;
+	size_t acc_size;
+	char * partial;
+	void * arg;
+};
+
+typedef struct
+{
+	pthread_mutex_t lock;
+	int lo;
+	int hi;
+} pool_range_t;
+
+static int pool_num_threads = 1;
+static pthread_t pool_thread[POOL_MAX_THREADS];
+static pool_range_t pool_range[POOL_MAX_THREADS];
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static unsigned pool_generation;
+static int pool_busy;
+static const pool_job_t * pool_job;
+
+// set in worker threads (and the caller while it runs a job) so
+// that nested loops run serially instead of deadlocking.
+static __thread int pool_in_job;
+
+
+/** Take one chunk from our own range, or steal half of another. */
+static int
+pool_next_chunk(
+	const int id
+)
+{
+	pool_range_t * const own = &pool_range[id];
+	int chunk = -1;
+
+	pthread_mutex_lock(&own->lock);
+	if (own->lo < own->hi)
+		chunk = own->lo++;
+	pthread_mutex_unlock(&own->lock);
+
+	if (chunk >= 0)
+		return chunk;
+
+	for (int i = 1 ; i < pool_num_threads ; i++)
+	{
+		pool_range_t * const victim
+			= &pool_range[(id + i) % pool_num_threads];
+
+		pthread_mutex_lock(&victim->lock);
+		const int left = victim->hi - victim->lo;
+		int lo = 0, hi = 0;
+		if (left > 0)
+		{
+			const int steal = (left + 1) / 2;
+			hi = victim->hi;
+			lo = victim->hi = hi - steal;
+		}
+		pthread_mutex_unlock(&victim->lock);
+
+		if (lo == hi)
+			continue;
+
+		// keep the first stolen chunk, publish the rest
+		// so that other idle workers can steal from us.
+		pthread_mutex_lock(&own->lock);
+		own->lo = lo + 1;
+		own->hi = hi;
+		pthread_mutex_unlock(&own->lock);
+
+		return lo;
+	}
+
+	return -1;
+}
+
+
+static void
+pool_work(
+	const pool_job_t * const job,
+	const int id
+)
+{
+	pool_in_job = 1;
+
+	int chunk;
+	while ((chunk = pool_next_chunk(id)) >= 0)
+	{
+		const int start = job->start + chunk * job->grain;
+		int end = start + job->grain;
+		if (end > job->end)
+			end = job->end;
+
+		job->run(job, chunk, start, end);
+	}
+
+	pool_in_job = 0;
+}
+
+
+static void *
+pool_thread_main(
+	void * const arg
+)
+{
+	const int id = (int)(intptr_t) arg;
+	unsigned generation = 0;
+
+	while (1)
+	{
+		pthread_mutex_lock(&pool_lock);
+		while (pool_generation == generation)
+			pthread_cond_wait(&pool_wake, &pool_lock);
+		generation = pool_generation;
+		const pool_job_t * const job = pool_job;
+		pthread_mutex_unlock(&pool_lock);
+
+		pool_work(job, id);
+
+		pthread_mutex_lock(&pool_lock);
+		if (--pool_busy == 0)
+			pthread_cond_signal(&pool_done);
+		pthread_mutex_unlock(&pool_lock);
+	}
+
+	return NULL;
+}
+
+
+void
+pool_init(
+	int num_threads
+)
+{
+	if (num_threads <= 0)
+		num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_threads <= 0)
+		num_threads = 1;
+	if (num_threads > POOL_MAX_THREADS)
+		num_threads = POOL_MAX_THREADS;
+
+	for (int i = 0 ; i < num_threads ; i++)
+		pthread_mutex_init(&pool_range[i].lock, NULL);
+
+	for (int i = pool_num_threads ; i < num_threads ; i++)
+	{
+		if (pthread_create(&pool_thread[i], NULL,
+			pool_thread_main, (void*)(intptr_t) i) != 0)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	if (num_threads > pool_num_threads)
+		pool_num_threads = num_threads;
+}
+
+
+int
+pool_threads(void)
+{
+	return pool_num_threads;
+}
+
+
+/** Run all of the chunks of a job, in parallel if possible. */
+static void
+pool_run(
+	pool_job_t * const job
+)
+{
+	if (job->grain < 1)
+		job->grain = 1;
+	job->num_chunks = (job->end - job->start + job->grain - 1) / job->grain;
+
+	if (pool_num_threads == 1 || pool_in_job || job->num_chunks == 1)
+	{
+		for (int chunk = 0 ; chunk < job->num_chunks ; chunk++)
+		{
+			const int start = job->start + chunk * job->grain;
+			int end = start + job->grain;
+			if (end > job->end)
+				end = job->end;
+			job->run(job, chunk, start, end);
+		}
+		return;
+	}
+
+	// hand each worker a contiguous share of the chunks
+	const int n = pool_num_threads;
+	for (int i = 0 ; i < n ; i++)
+	{
+		pool_range[i].lo = (long) job->num_chunks * i / n;
+		pool_range[i].hi = (long) job->num_chunks * (i+1) / n;
+	}
+
+	pthread_mutex_lock(&pool_lock);
+	pool_job = job;
+	pool_busy = n - 1;
+	pool_generation++;
+	pthread_cond_broadcast(&pool_wake);
+	pthread_mutex_unlock(&pool_lock);
+
+	pool_work(job, 0);
+
+	pthread_mutex_lock(&pool_lock);
+	while (pool_busy != 0)
+		pthread_cond_wait(&pool_done, &pool_lock);
+	pool_job = NULL;
+	pthread_mutex_unlock(&pool_lock);
+}
+
+
+static void
+pool_run_for(
+	const pool_job_t * const job,
+	const int chunk,
+	const int start,
+	const int end
+)
+{
+	(void) chunk;
+	job->for_fn(job->arg, start, end);
+}
+
+
+void
+pool_for(
+	const int start,
+	const int end,
+	const int grain,
+	const pool_for_fn fn,
+	void * const arg
+)
+{
+	if (end <= start)
+		return;
+
+	pool_job_t job = {
+		.start		= start,
+		.end		= end,
+		.grain		= grain,
+		.run		= pool_run_for,
+		.for_fn		= fn,
+		.arg		= arg,
+	};
+
+	pool_run(&job);
+}
+
+
+static void
+pool_run_reduce(
+	const pool_job_t * const job,
+	const int chunk,
+	const int start,
+	const int end
+)
+{
+	void * const acc = job->partial + chunk * job->acc_size;
+	memcpy(acc, job->identity, job->acc_size);
+	job->reduce_fn(job->arg, start, end, acc);
+}
+
+
+void
+pool_reduce(
+	const int start,
+	const int end,
+	const int grain,
+	void * const acc,
+	const size_t acc_size,
+	const pool_reduce_fn fn,
+	const pool_combine_fn combine,
+	void * const arg
+)
+{
+	if (end <= start)
+		return;
+
+	pool_job_t job = {
+		.start		= start,
+		.end		= end,
+		.grain		= grain,
+		.run		= pool_run_reduce,
+		.reduce_fn	= fn,
+		.acc_size	= acc_size,
+		.arg		= arg,
+	};
+
+	// the identity is copied since acc is overwritten below
+	char * const identity = malloc(acc_size);
+	memcpy(identity, acc, acc_size);
+	job.identity = identity;
+
+	const int g = grain < 1 ? 1 : grain;
+	const int num_chunks = (end - start + g - 1) / g;
+	job.partial = calloc(num_chunks, acc_size);
+	if (!job.partial)
+		err(EXIT_FAILURE, "pool_reduce: %d chunks", num_chunks);
+
+	pool_run(&job);
+
+	for (int i = 0 ; i < num_chunks ; i++)
+		combine(arg, acc, job.partial + i * acc_size);
+
+	free(job.partial);
+	free(identity);
+}
+
+
+typedef struct
+{
+	pool_print_fn fn;
+	void * arg;
+	char ** buf;
+	size_t * len;
+} pool_print_t;
+
+
+static void
+pool_print_chunk(
+	void * const arg,
+	const int start,
+	const int end
+)
+{
+	pool_print_t * const p = arg;
+
+	for (int i = start ; i < end ; i++)
+	{
+		FILE * const out = open_memstream(&p->buf[i], &p->len[i]);
+		if (!out)
+			err(EXIT_FAILURE, "open_memstream");
+		p->fn(p->arg, i, out);
+		fclose(out);
+	}
+}
+
+
+void
+pool_print(
+	const int count,
+	const pool_print_fn fn,
+	void * const arg,
+	FILE * const out
+)
+{
+	// nested inside another loop there is nobody to share the
+	// work with, so it can go straight to the output.
+	if (pool_in_job)
+	{
+		for (int i = 0 ; i < count ; i++)
+			fn(arg, i, out);
+		return;
+	}
+
+	pool_print_t p = {
+		.fn	= fn,
+		.arg	= arg,
+		.buf	= calloc(count, sizeof(*p.buf)),
+		.len	= calloc(count, sizeof(*p.len)),
+	};
+
+	// with a single thread each element is written as soon as
+	// it has been rendered.
+	if (pool_num_threads == 1)
+	{
+		for (int i = 0 ; i < count ; i++)
+		{
+			pool_print_chunk(&p, i, i+1);
+			fwrite(p.buf[i], 1, p.len[i], out);
+			progress_add(1);
+			progress_emit(p.len[i]);
+			free(p.buf[i]);
+		}
+
+		free(p.buf);
+		free(p.len);
+		return;
+	}
+
+	pool_for(0, count, 1, pool_print_chunk, &p);
+
+	for (int i = 0 ; i < count ; i++)
+	{
+		fwrite(p.buf[i], 1, p.len[i], out);
+		progress_add(1);
+		progress_emit(p.len[i]);
+		free(p.buf[i]);
+	}
+
+	free(p.buf);
+	free(p.len);
+}
@@ -0,0 +1,104 @@
+/** \file
+ * Work-stealing thread pool.
+ *
+ * Parallel loops over integer ranges, executed by a fixed set of
+ * worker threads.  The range is cut into chunks of `grain` iterations
+ * and the chunk boundaries never depend on the schedule, so loops that
+ * write per-element results and reductions that combine per-chunk
+ * results in order produce exactly the same output as a serial run.
+ */
+#ifndef _papercraft_pool_h_
+#define _papercraft_pool_h_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/** Loop body: process iterations [start, end). */
+typedef void (*pool_for_fn)(
+	void * arg,
+	int start,
+	int end
+);
+
+/** Reduction body: accumulate iterations [start, end) into acc. */
+typedef void (*pool_reduce_fn)(
+	void * arg,
+	int start,
+	int end,
+	void * acc
+);
+
+/** Combine the partial result `other` into `acc`. */
+typedef void (*pool_combine_fn)(
+	void * arg,
+	void * acc,
+	const void * other
+);
+
+/** Render element i to the output stream. */
+typedef void (*pool_print_fn)(
+	void * arg,
+	int i,
+	FILE * out
+);
+
+
+/** Start the worker threads.
+ *
+ * num_threads <= 0 uses one thread per online CPU.  Without a call
+ * to pool_init() every loop runs serially on the calling thread.
+ * It should be called once, before the first loop.
+ */
+void
+pool_init(
+	int num_threads
+);
+
+
+int
+pool_threads(void);
+
+
+/** Call fn on chunks of [start, end) in parallel. */
+void
+pool_for(
+	int start,
+	int end,
+	int grain,
+	pool_for_fn fn,
+	void * arg
+);
+
+
+/** Fold [start, end) into acc.
+ *
+ * acc must hold the identity value on entry; every chunk starts
+ * from a copy of it and the partial results are combined in
+ * chunk order, independent of the number of threads.
+ */
+void
+pool_reduce(
+	int start,
+	int end,
+	int grain,
+	void * acc,
+	size_t acc_size,
+	pool_reduce_fn fn,
+	pool_combine_fn combine,
+	void * arg
+);
+
+
+/** Render elements [0, count) in parallel and write them to out
+ * in index order.  Each element is reported to the current progress
+ * stage as one unit of work and one piece of output.
+ */
+void
+pool_print(
+	int count,
+	pool_print_fn fn,
+	void * arg,
+	FILE * out
+);
+
+#endif
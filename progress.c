@@ -0,0 +1,207 @@
+/** \file
+ * Rate limited progress reports.
+ */
+#include "progress.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+// how often to report, in seconds
+#define PROGRESS_INTERVAL 0.25
+
+// how many updates a thread makes between looks at the clock
+#define PROGRESS_CALLS 64
+
+static int progress_tty;
+static FILE * progress_json;
+
+static const char * progress_stage;
+static long progress_total;
+static long progress_done;
+static long progress_pieces;
+static long progress_written;
+static double progress_start_time;
+static double progress_next_time;
+static int progress_busy;
+static int progress_drawn;
+static __thread unsigned progress_calls;
+
+
+static double
+progress_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static void
+__attribute__((constructor))
+progress_init(void)
+{
+	progress_tty = isatty(STDERR_FILENO);
+
+	const char * const fd_str = getenv("PAPERCRAFT_PROGRESS_FD");
+	if (!fd_str)
+		return;
+
+	progress_json = fdopen(atoi(fd_str), "w");
+	if (!progress_json)
+		fprintf(stderr, "progress: unable to open fd %s\n", fd_str);
+}
+
+
+static void
+progress_report(
+	const int final
+)
+{
+	const double now = progress_now();
+	const double elapsed = now - progress_start_time;
+	const long done = __atomic_load_n(&progress_done, __ATOMIC_RELAXED);
+	const long pieces = __atomic_load_n(&progress_pieces, __ATOMIC_RELAXED);
+	const long written = __atomic_load_n(&progress_written, __ATOMIC_RELAXED);
+	const double rate = elapsed > 0 ? done / elapsed : 0;
+	const double eta = rate > 0 && done < progress_total
+		? (progress_total - done) / rate : 0;
+
+	if (progress_tty)
+	{
+		fprintf(stderr, "\r%-12s %9ld/%-9ld %3d%% %10.0f/s",
+			progress_stage,
+			done,
+			progress_total,
+			progress_total ? (int) (100 * done / progress_total) : 100,
+			rate
+		);
+		if (pieces)
+			fprintf(stderr, " %6ld out %8ld KiB",
+				pieces,
+				written / 1024
+			);
+		if (final)
+			fprintf(stderr, " %6.1fs\n", elapsed);
+		else
+			fprintf(stderr, " ETA %3d:%02d",
+				(int) eta / 60,
+				(int) eta % 60
+			);
+		__atomic_store_n(&progress_drawn, !final, __ATOMIC_RELAXED);
+	}
+
+	if (progress_json)
+	{
+		fprintf(progress_json,
+			"{\"stage\":\"%s\",\"done\":%ld,\"total\":%ld,"
+			"\"pieces\":%ld,\"bytes\":%ld,\"elapsed\":%.3f,"
+			"\"rate\":%.1f,\"eta\":%.3f,\"final\":%s}\n",
+			progress_stage,
+			done,
+			progress_total,
+			pieces,
+			written,
+			elapsed,
+			rate,
+			eta,
+			final ? "true" : "false"
+		);
+		fflush(progress_json);
+	}
+}
+
+
+/** Report if it has been long enough since the last report.
+ * The clock is only read every PROGRESS_CALLS updates from a thread,
+ * and only one thread does the report; the others carry on.
+ */
+static void
+progress_check(void)
+{
+	if (++progress_calls % PROGRESS_CALLS)
+		return;
+
+	double next;
+	__atomic_load(&progress_next_time, &next, __ATOMIC_RELAXED);
+	if (progress_now() < next)
+		return;
+	if (__atomic_exchange_n(&progress_busy, 1, __ATOMIC_ACQUIRE))
+		return;
+
+	progress_report(0);
+	next = progress_now() + PROGRESS_INTERVAL;
+	__atomic_store(&progress_next_time, &next, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&progress_busy, 0, __ATOMIC_RELEASE);
+}
+
+
+void
+progress_start(
+	const char * const stage,
+	const long total
+)
+{
+	if (progress_stage)
+		progress_end();
+	if (!progress_tty && !progress_json)
+		return;
+
+	progress_stage = stage;
+	progress_total = total;
+	progress_done = 0;
+	progress_pieces = 0;
+	progress_written = 0;
+	progress_start_time = progress_now();
+	progress_next_time = progress_start_time + PROGRESS_INTERVAL;
+}
+
+
+void
+progress_add(
+	const long n
+)
+{
+	if (!progress_stage)
+		return;
+
+	__atomic_add_fetch(&progress_done, n, __ATOMIC_RELAXED);
+	progress_check();
+}
+
+
+void
+progress_emit(
+	const long n
+)
+{
+	if (!progress_stage)
+		return;
+
+	__atomic_add_fetch(&progress_pieces, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&progress_written, n, __ATOMIC_RELAXED);
+	progress_check();
+}
+
+
+void
+progress_clear(void)
+{
+	if (!__atomic_exchange_n(&progress_drawn, 0, __ATOMIC_RELAXED))
+		return;
+
+	fprintf(stderr, "\r\033[K");
+}
+
+
+void
+progress_end(void)
+{
+	if (!progress_stage)
+		return;
+
+	progress_report(1);
+	progress_stage = NULL;
+}
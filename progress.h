@@ -0,0 +1,57 @@
+/** \file
+ * Progress reporting for long runs.
+ *
+ * Each tool goes through a few stages (welding vertices, pairing
+ * edges, placing triangles, writing output) and reports how far it
+ * is through the current one and how many pieces and bytes of output
+ * it has written.  Updates are rate limited, so they can be made from
+ * inner loops and from the pool threads.  Tools that log to stderr
+ * while a stage runs call progress_clear() first.
+ *
+ * If stderr is a terminal a status line with the throughput and ETA
+ * is kept up to date on it.  If PAPERCRAFT_PROGRESS_FD is set, one
+ * JSON object per update is written to that file descriptor for a
+ * job runner to read.  Otherwise nothing is reported.
+ */
+#ifndef _papercraft_progress_h_
+#define _papercraft_progress_h_
+
+/** Start a new stage that will do `total` units of work.
+ * Any stage that is still running is finished first.
+ */
+void
+progress_start(
+	const char * stage,
+	long total
+);
+
+
+/** Record n more units of work done in the current stage. */
+void
+progress_add(
+	long n
+);
+
+
+/** Record one more piece (a group, polygon or connector) written
+ * to the output, taking n bytes.
+ */
+void
+progress_emit(
+	long n
+);
+
+
+/** Erase the status line, if one is showing, so that other output
+ * to stderr starts on a line of its own.  The status line is drawn
+ * again at the next report.
+ */
+void
+progress_clear(void);
+
+
+/** Report the final state of the current stage. */
+void
+progress_end(void);
+
+#endif
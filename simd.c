@@ -0,0 +1,144 @@
+/** \file
+ * Runtime CPU dispatch for the SIMD kernels.
+ */
+#include "simd.h"
+#include "v3.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// The scalar code compares real_t values against the double EPS.
+// These are the real_t thresholds that give the same answers.
+static real_t simd_eq;		// largest real_t < EPS
+static real_t simd_above_eps;	// smallest real_t > EPS
+static real_t simd_below_1eps;	// largest real_t < 1-EPS
+
+// Lane mask type and math functions for the working precision.
+#ifdef PAPERCRAFT_DOUBLE
+typedef int64_t real_int_t;
+#define real_nextafter nextafter
+#define real_sqrt sqrt
+#else
+typedef int32_t real_int_t;
+#define real_nextafter nextafterf
+#define real_sqrt sqrtf
+#endif
+
+
+static real_t
+real_below(
+	const double x
+)
+{
+	real_t f = x;
+	while ((double) f >= x)
+		f = real_nextafter(f, -INFINITY);
+	return f;
+}
+
+
+static real_t
+real_above(
+	const double x
+)
+{
+	real_t f = x;
+	while ((double) f <= x)
+		f = real_nextafter(f, INFINITY);
+	return f;
+}
+
+
+#define SIMD_NAME(x) x##_scalar
+#define SIMD_NAME_STR "scalar"
+#define SIMD_TARGET
+#define SIMD_BYTES sizeof(real_t)
+#include "simd_kernels.h"
+#undef SIMD_NAME
+#undef SIMD_NAME_STR
+#undef SIMD_TARGET
+#undef SIMD_BYTES
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+
+#define SIMD_NAME(x) x##_sse2
+#define SIMD_NAME_STR "sse2"
+#define SIMD_TARGET __attribute__((target("sse2")))
+#define SIMD_BYTES 16
+#include "simd_kernels.h"
+#undef SIMD_NAME
+#undef SIMD_NAME_STR
+#undef SIMD_TARGET
+#undef SIMD_BYTES
+
+#define SIMD_NAME(x) x##_avx2
+#define SIMD_NAME_STR "avx2"
+#define SIMD_TARGET __attribute__((target("avx2")))
+#define SIMD_BYTES 32
+#include "simd_kernels.h"
+#undef SIMD_NAME
+#undef SIMD_NAME_STR
+#undef SIMD_TARGET
+#undef SIMD_BYTES
+
+#define SIMD_NAME(x) x##_avx512
+#define SIMD_NAME_STR "avx512"
+#define SIMD_TARGET __attribute__((target("avx512f")))
+#define SIMD_BYTES 64
+#include "simd_kernels.h"
+#undef SIMD_NAME
+#undef SIMD_NAME_STR
+#undef SIMD_TARGET
+#undef SIMD_BYTES
+#endif
+
+
+const simd_ops_t * simd_ops = &ops_scalar;
+
+
+/** Pick the widest supported kernels, unless overridden by
+ * the PAPERCRAFT_SIMD environment variable.
+ */
+static void
+__attribute__((constructor))
+simd_init(void)
+{
+	simd_eq = real_below(EPS);
+	simd_above_eps = real_above(EPS);
+	simd_below_1eps = real_below(1 - EPS);
+
+	const simd_ops_t * best = &ops_scalar;
+	const simd_ops_t * supported[4] = { &ops_scalar };
+	int num_supported = 1;
+
+#ifdef SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		supported[num_supported++] = best = &ops_sse2;
+	if (__builtin_cpu_supports("avx2"))
+		supported[num_supported++] = best = &ops_avx2;
+	if (__builtin_cpu_supports("avx512f"))
+		supported[num_supported++] = best = &ops_avx512;
+#endif
+
+	simd_ops = best;
+
+	const char * const name = getenv("PAPERCRAFT_SIMD");
+	if (!name)
+		return;
+
+	for (int i = 0 ; i < num_supported ; i++)
+	{
+		if (strcmp(name, supported[i]->name) != 0)
+			continue;
+		simd_ops = supported[i];
+		fprintf(stderr, "simd: using %s\n", simd_ops->name);
+		return;
+	}
+
+	fprintf(stderr, "simd: %s not supported, using %s\n",
+		name, simd_ops->name);
+}
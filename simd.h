@@ -0,0 +1,170 @@
+/** \file
+ * Runtime selected SIMD kernels.
+ *
+ * The hot loops are compiled once per instruction set (scalar, SSE2,
+ * AVX2 and AVX-512 on x86) and the best one that the CPU supports is
+ * chosen at startup.  Setting PAPERCRAFT_SIMD=scalar|sse2|avx2|avx512
+ * forces a particular variant for testing.
+ *
+ * Every variant performs the same real_t operations in the same order
+ * as the scalar code, so the choice never changes the output.
+ */
+#ifndef _papercraft_simd_h_
+#define _papercraft_simd_h_
+
+#include "v3.h"
+
+typedef struct
+{
+	const char * name;
+
+	int (*find_point)(
+		const real_t * x,
+		const real_t * y,
+		const real_t * z,
+		int n,
+		const real_t p[3]
+	);
+
+	int (*match_edge)(
+		const real_t * const p[3][3],
+		int start,
+		int n,
+		const real_t a[3],
+		const real_t b[3],
+		int * edges
+	);
+
+	int (*overlap)(
+		const real_t * const p[3][2],
+		int n,
+		const real_t q[3][2]
+	);
+
+	void (*dihedral)(
+		int n,
+		const real_t * const p[4][3],
+		real_t * dot
+	);
+
+	// batch vector operations, see v3_batch.h
+	void (*v3_add)(
+		int n,
+		const v3_soa_t * a,
+		const v3_soa_t * b,
+		const v3_soa_t * out
+	);
+
+	void (*v3_sub)(
+		int n,
+		const v3_soa_t * a,
+		const v3_soa_t * b,
+		const v3_soa_t * out
+	);
+
+	void (*v3_cross)(
+		int n,
+		const v3_soa_t * a,
+		const v3_soa_t * b,
+		const v3_soa_t * out
+	);
+
+	void (*v3_dot)(
+		int n,
+		const v3_soa_t * a,
+		const v3_soa_t * b,
+		real_t * out
+	);
+
+	void (*v3_mag)(
+		int n,
+		const v3_soa_t * a,
+		real_t * out
+	);
+
+	void (*v3_norm)(
+		int n,
+		const v3_soa_t * a,
+		const v3_soa_t * out
+	);
+
+	void (*v3_project)(
+		int n,
+		const v3_t * origin,
+		const v3_t * x,
+		const v3_t * y,
+		const v3_soa_t * p,
+		real_t * x_out,
+		real_t * y_out
+	);
+} simd_ops_t;
+
+extern const simd_ops_t * simd_ops;
+
+
+/** Find the first point in the SoA arrays that is v3_eq() to p.
+ * \return the index, or -1 if there is none.
+ */
+static inline int
+simd_find_point(
+	const real_t * const x,
+	const real_t * const y,
+	const real_t * const z,
+	const int n,
+	const real_t p[3]
+)
+{
+	return simd_ops->find_point(x, y, z, n, p);
+}
+
+
+/** Find the first triangle at or after start that has an edge
+ * running from b to a (the reverse of the edge a to b).
+ *
+ * p[k][c] is coordinate c of vertex k of each triangle.  The bitmask
+ * of matching edges in the returned triangle is stored in *edges.
+ * \return the triangle index, or -1 if there is none.
+ */
+static inline int
+simd_match_edge(
+	const real_t * const p[3][3],
+	const int start,
+	const int n,
+	const real_t a[3],
+	const real_t b[3],
+	int * const edges
+)
+{
+	return simd_ops->match_edge(p, start, n, a, b, edges);
+}
+
+
+/** Find the first 2D triangle with an edge that crosses an edge of q.
+ * p[k][c] is coordinate c of vertex k of each triangle.
+ * \return the triangle index, or -1 if none overlap.
+ */
+static inline int
+simd_overlap(
+	const real_t * const p[3][2],
+	const int n,
+	const real_t q[3][2]
+)
+{
+	return simd_ops->overlap(p, n, q);
+}
+
+
+/** Compute (x3-x1) . ((x2-x1) X (x4-x3)) for n sets of four points,
+ * which is zero if the points are coplanar.
+ */
+static inline void
+simd_dihedral(
+	const int n,
+	const real_t * const p[4][3],
+	real_t * const dot
+)
+{
+	simd_ops->dihedral(n, p, dot);
+}
+
+#endif
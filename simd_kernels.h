@@ -0,0 +1,490 @@
+/** \file
+ * SIMD kernel bodies.
+ *
+ * This file is included by simd.c once per instruction set with
+ * SIMD_NAME(), SIMD_TARGET and SIMD_BYTES defined.  The vectors use
+ * the GCC vector extensions so that the same source compiles to
+ * native instructions for each target.  Partial blocks at the end
+ * of the arrays are padded and the unused lanes masked off, so there
+ * is no separate scalar tail loop to keep in sync.
+ */
+
+#define LANES ((int) (SIMD_BYTES / sizeof(real_t)))
+#define vf SIMD_NAME(vf)
+#define vi SIMD_NAME(vi)
+
+typedef real_t vf __attribute__((vector_size(SIMD_BYTES)));
+typedef real_int_t vi __attribute__((vector_size(SIMD_BYTES)));
+
+
+/** Load up to LANES reals, padding with zeros. */
+static inline SIMD_TARGET vf
+SIMD_NAME(load)(
+	const real_t * const p,
+	const int count
+)
+{
+	vf v = { 0 };
+	if (count >= LANES)
+		memcpy(&v, p, sizeof(v));
+	else
+		memcpy(&v, p, count * sizeof(*p));
+	return v;
+}
+
+
+/** Mask of the lanes that hold real data. */
+static inline SIMD_TARGET vi
+SIMD_NAME(valid)(
+	const int count
+)
+{
+	vi m;
+	for (int k = 0 ; k < LANES ; k++)
+		m[k] = k < count ? -1 : 0;
+	return m;
+}
+
+
+static inline SIMD_TARGET int
+SIMD_NAME(any)(
+	const vi m
+)
+{
+	real_int_t r = 0;
+	for (int k = 0 ; k < LANES ; k++)
+		r |= m[k];
+	return r != 0;
+}
+
+
+static inline SIMD_TARGET int
+SIMD_NAME(first)(
+	const vi m
+)
+{
+	for (int k = 0 ; k < LANES ; k++)
+		if (m[k])
+			return k;
+	return -1;
+}
+
+
+/** -EPS < d < EPS, as in v3_eq() and v2_eq(). */
+static inline SIMD_TARGET vi
+SIMD_NAME(near)(
+	const vf d
+)
+{
+	return (d >= -simd_eq) & (d <= simd_eq);
+}
+
+
+static SIMD_TARGET int
+SIMD_NAME(find_point)(
+	const real_t * const x,
+	const real_t * const y,
+	const real_t * const z,
+	const int n,
+	const real_t p[3]
+)
+{
+	for (int i = 0 ; i < n ; i += LANES)
+	{
+		const int count = n - i;
+		const vi m = SIMD_NAME(valid)(count)
+			& SIMD_NAME(near)(SIMD_NAME(load)(x + i, count) - p[0])
+			& SIMD_NAME(near)(SIMD_NAME(load)(y + i, count) - p[1])
+			& SIMD_NAME(near)(SIMD_NAME(load)(z + i, count) - p[2]);
+
+		if (SIMD_NAME(any)(m))
+			return i + SIMD_NAME(first)(m);
+	}
+
+	return -1;
+}
+
+
+static SIMD_TARGET int
+SIMD_NAME(match_edge)(
+	const real_t * const p[3][3],
+	const int start,
+	const int n,
+	const real_t a[3],
+	const real_t b[3],
+	int * const edges
+)
+{
+	for (int i = start ; i < n ; i += LANES)
+	{
+		const int count = n - i;
+		vf v[3][3];
+		for (int k = 0 ; k < 3 ; k++)
+			for (int c = 0 ; c < 3 ; c++)
+				v[k][c] = SIMD_NAME(load)(p[k][c] + i, count);
+
+		// edge e runs from v[e] to v[e+1]; it matches if
+		// it runs from b to a.
+		vi m[3];
+		for (int e = 0 ; e < 3 ; e++)
+		{
+			const vf * const v0 = v[e];
+			const vf * const v1 = v[(e+1) % 3];
+			m[e] = SIMD_NAME(valid)(count)
+				& SIMD_NAME(near)(v1[0] - a[0])
+				& SIMD_NAME(near)(v1[1] - a[1])
+				& SIMD_NAME(near)(v1[2] - a[2])
+				& SIMD_NAME(near)(v0[0] - b[0])
+				& SIMD_NAME(near)(v0[1] - b[1])
+				& SIMD_NAME(near)(v0[2] - b[2]);
+		}
+
+		const vi any = m[0] | m[1] | m[2];
+		if (!SIMD_NAME(any)(any))
+			continue;
+
+		const int k = SIMD_NAME(first)(any);
+		*edges = (m[0][k] ? 1 : 0)
+			| (m[1][k] ? 2 : 0)
+			| (m[2][k] ? 4 : 0);
+		return i + k;
+	}
+
+	return -1;
+}
+
+
+/** Test one edge of each of the vector triangles against the
+ * edge c-d, following intersect() and get_line_intersection().
+ */
+static inline SIMD_TARGET vi
+SIMD_NAME(intersect)(
+	const vf p0_x,
+	const vf p0_y,
+	const vf p1_x,
+	const vf p1_y,
+	const real_t * const c,
+	const real_t * const d
+)
+{
+	const real_t p2_x = c[0];
+	const real_t p2_y = c[1];
+	const real_t s2_x = d[0] - p2_x;
+	const real_t s2_y = d[1] - p2_y;
+
+	const vf s1_x = p1_x - p0_x;
+	const vf s1_y = p1_y - p0_y;
+
+	const vf s = (-s1_y * (p0_x - p2_x) + s1_x * (p0_y - p2_y))
+		/ (-s2_x * s1_y + s1_x * s2_y);
+
+	const vf t = ( s2_x * (p0_y - p2_y) - s2_y * (p0_x - p2_x))
+		/ (-s2_x * s1_y + s1_x * s2_y);
+
+	const vi hit
+		= (s >= simd_above_eps) & (s <= simd_below_1eps)
+		& (t >= simd_above_eps) & (t <= simd_below_1eps);
+	if (!SIMD_NAME(any)(hit))
+		return hit;
+
+	// special case; if this is the same line, it does not intersect
+	const vi same =
+		( SIMD_NAME(near)(p0_x - c[0])
+		& SIMD_NAME(near)(p0_y - c[1])
+		& SIMD_NAME(near)(p1_x - d[0])
+		& SIMD_NAME(near)(p1_y - d[1]))
+	|	( SIMD_NAME(near)(p1_x - c[0])
+		& SIMD_NAME(near)(p1_y - c[1])
+		& SIMD_NAME(near)(p0_x - d[0])
+		& SIMD_NAME(near)(p0_y - d[1]));
+
+	return hit & ~same;
+}
+
+
+static SIMD_TARGET int
+SIMD_NAME(overlap)(
+	const real_t * const p[3][2],
+	const int n,
+	const real_t q[3][2]
+)
+{
+	for (int i = 0 ; i < n ; i += LANES)
+	{
+		const int count = n - i;
+		vf x[3], y[3];
+		for (int k = 0 ; k < 3 ; k++)
+		{
+			x[k] = SIMD_NAME(load)(p[k][0] + i, count);
+			y[k] = SIMD_NAME(load)(p[k][1] + i, count);
+		}
+
+		vi hit = { 0 };
+		for (int e1 = 0 ; e1 < 3 ; e1++)
+		{
+			const int e1n = (e1 + 1) % 3;
+			for (int e2 = 0 ; e2 < 3 ; e2++)
+				hit |= SIMD_NAME(intersect)(
+					x[e1], y[e1],
+					x[e1n], y[e1n],
+					q[e2], q[(e2+1) % 3]
+				);
+		}
+
+		hit &= SIMD_NAME(valid)(count);
+		if (SIMD_NAME(any)(hit))
+			return i + SIMD_NAME(first)(hit);
+	}
+
+	return -1;
+}
+
+
+static SIMD_TARGET void
+SIMD_NAME(dihedral)(
+	const int n,
+	const real_t * const p[4][3],
+	real_t * const dot
+)
+{
+	for (int i = 0 ; i < n ; i += LANES)
+	{
+		const int count = n - i;
+		vf x[4][3];
+		for (int k = 0 ; k < 4 ; k++)
+			for (int c = 0 ; c < 3 ; c++)
+				x[k][c] = SIMD_NAME(load)(p[k][c] + i, count);
+
+		// (x3-x1) . ((x2-x1) X (x4-x3)), in the same order as
+		// v3_sub(), v3_cross() and v3_dot().
+		vf dx31[3], u[3], v[3];
+		for (int c = 0 ; c < 3 ; c++)
+		{
+			dx31[c] = x[2][c] - x[0][c];
+			u[c] = x[1][c] - x[0][c];
+			v[c] = x[3][c] - x[2][c];
+		}
+
+		const vf cross[3] = {
+			u[1]*v[2] - u[2]*v[1],
+			u[2]*v[0] - u[0]*v[2],
+			u[0]*v[1] - u[1]*v[0],
+		};
+
+		const vf d = dx31[0]*cross[0] + dx31[1]*cross[1] + dx31[2]*cross[2];
+
+		if (count >= LANES)
+			memcpy(dot + i, &d, sizeof(d));
+		else
+			memcpy(dot + i, &d, count * sizeof(*dot));
+	}
+}
+
+
+/** Store up to LANES reals. */
+static inline SIMD_TARGET void
+SIMD_NAME(store)(
+	real_t * const p,
+	const vf v,
+	const int count
+)
+{
+	if (count >= LANES)
+		memcpy(p, &v, sizeof(v));
+	else
+		memcpy(p, &v, count * sizeof(*p));
+}
+
+
+static SIMD_TARGET void
+SIMD_NAME(v3_add)(
+	const int n,
+	const v3_soa_t * const a,
+	const v3_soa_t * const b,
+	const v3_soa_t * const out
+)
+{
+	for (int i = 0 ; i < n ; i += LANES)
+	{
+		const int count = n - i;
+		SIMD_NAME(store)(out->x + i, SIMD_NAME(load)(a->x + i, count)
+			+ SIMD_NAME(load)(b->x + i, count), count);
+		SIMD_NAME(store)(out->y + i, SIMD_NAME(load)(a->y + i, count)
+			+ SIMD_NAME(load)(b->y + i, count), count);
+		SIMD_NAME(store)(out->z + i, SIMD_NAME(load)(a->z + i, count)
+			+ SIMD_NAME(load)(b->z + i, count), count);
+	}
+}
+
+
+static SIMD_TARGET void
+SIMD_NAME(v3_sub)(
+	const int n,
+	const v3_soa_t * const a,
+	const v3_soa_t * const b,
+	const v3_soa_t * const out
+)
+{
+	for (int i = 0 ; i < n ; i += LANES)
+	{
+		const int count = n - i;
+		SIMD_NAME(store)(out->x + i, SIMD_NAME(load)(a->x + i, count)
+			- SIMD_NAME(load)(b->x + i, count), count);
+		SIMD_NAME(store)(out->y + i, SIMD_NAME(load)(a->y + i, count)
+			- SIMD_NAME(load)(b->y + i, count), count);
+		SIMD_NAME(store)(out->z + i, SIMD_NAME(load)(a->z + i, count)
+			- SIMD_NAME(load)(b->z + i, count), count);
+	}
+}
+
+
+static SIMD_TARGET void
+SIMD_NAME(v3_cross)(
+	const int n,
+	const v3_soa_t * const a,
+	const v3_soa_t * const b,
+	const v3_soa_t * const out
+)
+{
+	for (int i = 0 ; i < n ; i += LANES)
+	{
+		const int count = n - i;
+		const vf u1 = SIMD_NAME(load)(a->x + i, count);
+		const vf u2 = SIMD_NAME(load)(a->y + i, count);
+		const vf u3 = SIMD_NAME(load)(a->z + i, count);
+		const vf v1 = SIMD_NAME(load)(b->x + i, count);
+		const vf v2 = SIMD_NAME(load)(b->y + i, count);
+		const vf v3 = SIMD_NAME(load)(b->z + i, count);
+
+		// out may alias a or b, so compute before storing
+		const vf cx = u2*v3 - u3*v2;
+		const vf cy = u3*v1 - u1*v3;
+		const vf cz = u1*v2 - u2*v1;
+
+		SIMD_NAME(store)(out->x + i, cx, count);
+		SIMD_NAME(store)(out->y + i, cy, count);
+		SIMD_NAME(store)(out->z + i, cz, count);
+	}
+}
+
+
+static SIMD_TARGET void
+SIMD_NAME(v3_dot)(
+	const int n,
+	const v3_soa_t * const a,
+	const v3_soa_t * const b,
+	real_t * const out
+)
+{
+	for (int i = 0 ; i < n ; i += LANES)
+	{
+		const int count = n - i;
+		const vf d
+			= SIMD_NAME(load)(a->x + i, count) * SIMD_NAME(load)(b->x + i, count)
+			+ SIMD_NAME(load)(a->y + i, count) * SIMD_NAME(load)(b->y + i, count)
+			+ SIMD_NAME(load)(a->z + i, count) * SIMD_NAME(load)(b->z + i, count);
+		SIMD_NAME(store)(out + i, d, count);
+	}
+}
+
+
+static SIMD_TARGET void
+SIMD_NAME(v3_mag)(
+	const int n,
+	const v3_soa_t * const a,
+	real_t * const out
+)
+{
+	for (int i = 0 ; i < n ; i += LANES)
+	{
+		const int count = n - i;
+		const vf dx = SIMD_NAME(load)(a->x + i, count);
+		const vf dy = SIMD_NAME(load)(a->y + i, count);
+		const vf dz = SIMD_NAME(load)(a->z + i, count);
+		const vf ss = dx*dx + dy*dy + dz*dz;
+
+		// the float square root of a float is the same as
+		// rounding the double square root used by v3_mag()
+		vf r;
+		for (int k = 0 ; k < LANES ; k++)
+			r[k] = real_sqrt(ss[k]);
+		SIMD_NAME(store)(out + i, r, count);
+	}
+}
+
+
+static SIMD_TARGET void
+SIMD_NAME(v3_norm)(
+	const int n,
+	const v3_soa_t * const a,
+	const v3_soa_t * const out
+)
+{
+	typedef double vd __attribute__((vector_size(LANES * sizeof(double))));
+
+	for (int i = 0 ; i < n ; i += LANES)
+	{
+		const int count = n - i;
+		const vf dx = SIMD_NAME(load)(a->x + i, count);
+		const vf dy = SIMD_NAME(load)(a->y + i, count);
+		const vf dz = SIMD_NAME(load)(a->z + i, count);
+		const vf ss = dx*dx + dy*dy + dz*dz;
+
+		// v3_norm() scales by 1/sqrt() computed in double
+		const vd d = __builtin_convertvector(ss, vd);
+		vd r;
+		for (int k = 0 ; k < LANES ; k++)
+			r[k] = 1 / sqrt(d[k]);
+		const vf s = __builtin_convertvector(r, vf);
+
+		SIMD_NAME(store)(out->x + i, dx*s, count);
+		SIMD_NAME(store)(out->y + i, dy*s, count);
+		SIMD_NAME(store)(out->z + i, dz*s, count);
+	}
+}
+
+
+static SIMD_TARGET void
+SIMD_NAME(v3_project)(
+	const int n,
+	const v3_t * const origin,
+	const v3_t * const x,
+	const v3_t * const y,
+	const v3_soa_t * const p,
+	real_t * const x_out,
+	real_t * const y_out
+)
+{
+	for (int i = 0 ; i < n ; i += LANES)
+	{
+		const int count = n - i;
+		const vf px = SIMD_NAME(load)(p->x + i, count) - origin->p[0];
+		const vf py = SIMD_NAME(load)(p->y + i, count) - origin->p[1];
+		const vf pz = SIMD_NAME(load)(p->z + i, count) - origin->p[2];
+
+		SIMD_NAME(store)(x_out + i,
+			x->p[0]*px + x->p[1]*py + x->p[2]*pz, count);
+		SIMD_NAME(store)(y_out + i,
+			y->p[0]*px + y->p[1]*py + y->p[2]*pz, count);
+	}
+}
+
+
+static const simd_ops_t SIMD_NAME(ops) = {
+	.name		= SIMD_NAME_STR,
+	.find_point	= SIMD_NAME(find_point),
+	.match_edge	= SIMD_NAME(match_edge),
+	.overlap	= SIMD_NAME(overlap),
+	.dihedral	= SIMD_NAME(dihedral),
+	.v3_add		= SIMD_NAME(v3_add),
+	.v3_sub		= SIMD_NAME(v3_sub),
+	.v3_cross	= SIMD_NAME(v3_cross),
+	.v3_dot		= SIMD_NAME(v3_dot),
+	.v3_mag		= SIMD_NAME(v3_mag),
+	.v3_norm	= SIMD_NAME(v3_norm),
+	.v3_project	= SIMD_NAME(v3_project),
+};
+
+#undef vf
+#undef vi
+#undef LANES
@@ -1,8 +1,14 @@
 #include "stl_3d.h"
+#include "pool.h"
+#include "simd.h"
+#include "v3_batch.h"
+#include "bvh.h"
+#include "progress.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <err.h>
 
 
 static const int debug = 0;
@@ -17,30 +23,61 @@ stl_3d_file_header_t;
 
 typedef struct
 {
-	v3_t normal;
-	v3_t p[3];
+	v3f_t normal;
+	v3f_t p[3];
 	uint16_t attr;
 } __attribute__((__packed__))
 stl_3d_file_triangle_t;
 
 
-/** Find or create a vertex */
-static stl_vertex_t *
+// triangles read from the file at a time
+#define STL_READ_CHUNK		4096
+
+// edges whose angles are computed by each call to the SIMD kernel
+#define STL_ANGLE_BATCH		4096
+
+
+/** Read all of len bytes, which a pipe may deliver in pieces. */
+static int
+stl_read_all(
+	const int fd,
+	void * const buf,
+	const size_t len
+)
+{
+	size_t off = 0;
+
+	while (off < len)
+	{
+		const ssize_t rc = read(fd, (char *) buf + off, len - off);
+		if (rc <= 0)
+			return 0;
+		off += rc;
+	}
+
+	return 1;
+}
+
+
+/** Find or create a vertex and return its index.
+ *
+ * The positions are mirrored in the SoA arrays xyz[] so that the
+ * search can use the SIMD kernels instead of walking the much larger
+ * vertex structures.
+ */
+static int
 stl_vertex_find(
 	stl_vertex_t * const vertices,
+	real_t * const xyz[3],
 	int * num_vertex_ptr,
 	const v3_t * const p
 )
 {
 	const int num_vertex = *num_vertex_ptr;
 
-	for (int x = 0 ; x < num_vertex ; x++)
-	{
-		stl_vertex_t * const v = &vertices[x];
-
-		if (v3_eq(&v->p, p))
-			return v;
-	}
+	const int x = simd_find_point(xyz[0], xyz[1], xyz[2], num_vertex, p->p);
+	if (x >= 0)
+		return x;
 
 	if (debug)
 	fprintf(stderr, "%d: %f,%f,%f\n",
@@ -50,188 +87,735 @@ stl_vertex_find(
 		p->p[2]
 	);
 
-	stl_vertex_t * const v = &vertices[(*num_vertex_ptr)++];
-	v->p = *p;
+	vertices[num_vertex].p = *p;
+	xyz[0][num_vertex] = p->p[0];
+	xyz[1][num_vertex] = p->p[1];
+	xyz[2][num_vertex] = p->p[2];
 
-	return v;
+	return (*num_vertex_ptr)++;
 }
 
 
-/** Check to see if the two faces share an edge.
- * \return 0 if no common edge, 1 if there is a shared link
- */
-static int
-stl_has_edge(
-	const stl_face_t * const f,
-	const stl_vertex_t * const v1,
-	const stl_vertex_t * const v2
-)
-{
-	if (f->vertex[0] != v1 && f->vertex[1] != v1 && f->vertex[2] != v1)
-		return 0;
-	if (f->vertex[0] != v2 && f->vertex[1] != v2 && f->vertex[2] != v2)
-		return 0;
-
-	return 1;
-}
-
-
-/** Compute the angle between the two planes.
- * This is an approximation:
- * \return 0 == coplanar, negative == valley, positive == mountain.
- */
-static double
-stl_angle(
-	const stl_face_t * const f1,
-	const stl_face_t * const f2
+/** Find the point of face f2 that is not shared with face f1. */
+static v3_t
+stl_angle_point(
+	const stl_3d_t * const stl,
+	const int f1,
+	const int f2
 )
 {
 	// find the four distinct points
-	v3_t x1 = f1->vertex[0]->p;
-	v3_t x2 = f1->vertex[1]->p;
-	v3_t x3 = f1->vertex[2]->p;
+	const v3_t * const x1 = &stl_face_vertex(stl, f1, 0)->p;
+	const v3_t * const x2 = &stl_face_vertex(stl, f1, 1)->p;
+	const v3_t * const x3 = &stl_face_vertex(stl, f1, 2)->p;
 	v3_t x4;
 
 	for (int i = 0 ; i < 3 ; i++)
 	{
-		x4 = f2->vertex[i]->p;
-		if (v3_eq(&x1, &x4))
+		x4 = stl_face_vertex(stl, f2, i)->p;
+		if (v3_eq(x1, &x4))
 			continue;
-		if (v3_eq(&x2, &x4))
+		if (v3_eq(x2, &x4))
 			continue;
-		if (v3_eq(&x3, &x4))
+		if (v3_eq(x3, &x4))
 			continue;
 		break;
 	}
 
-	// (x3-x1) . ((x2-x1) X (x4-x3)) == 0
-	v3_t dx31 = v3_sub(x3, x1);
-	v3_t dx21 = v3_sub(x2, x1);
-	v3_t dx43 = v3_sub(x4, x3);
-	v3_t cross = v3_cross(dx21, dx43);
-	float dot = v3_dot(dx31, cross);
+	return x4;
+}
 
-	if (debug)
-	fprintf(stderr, "dot %f:\n %f,%f,%f\n %f,%f,%f\n %f,%f,%f\n %f,%f,%f\n",
-		dot,
-		x1.p[0], x1.p[1], x1.p[2],
-		x2.p[0], x2.p[1], x2.p[2],
-		x3.p[0], x3.p[1], x3.p[2],
-		x4.p[0], x4.p[1], x4.p[2]
-	);
-	
-	//int check = -EPS < dot && dot < +EPS;
-	int check = -10 < dot && dot < +10;
 
-	// if the dot product is not close enough to zero, they
-	// are not coplanar.
-	if (check)
-		return 0;
+/** The half-edges waiting for the angle to their neighbor.
+ *
+ * The points are gathered into SoA arrays so that the triple
+ * products can be computed by the SIMD kernel a batch at a time,
+ * rather than holding the points of every edge in the mesh at once.
+ */
+typedef struct
+{
+	int count;
+	int h[STL_ANGLE_BATCH];
+	real_t p[4][3][STL_ANGLE_BATCH];
+	real_t dot[STL_ANGLE_BATCH];
+} stl_angles_t;
 
-	if (dot < 0)
-		return -1;
-	else
-		return +1;
+
+/** Compute the angle between each queued face and its neighbor.
+ * This is an approximation:
+ * 0 == coplanar, negative == valley, positive == mountain.
+ */
+static void
+stl_angles_flush(
+	stl_3d_t * const stl,
+	stl_angles_t * const a
+)
+{
+	const real_t * p[4][3];
+	for (int k = 0 ; k < 4 ; k++)
+		for (int c = 0 ; c < 3 ; c++)
+			p[k][c] = a->p[k][c];
+
+	simd_dihedral(a->count, (const real_t * const (*)[3]) p, a->dot);
+
+	for (int i = 0 ; i < a->count ; i++)
+	{
+		const int h = a->h[i];
+		const real_t d = a->dot[i];
+		if (debug)
+		fprintf(stderr, "%d.%d: dot %f\n", stl_he_face(h), h % 3, d);
+
+		//int check = -EPS < d && d < +EPS;
+		int check = -10 < d && d < +10;
+
+		// if the dot product is not close enough to zero, they
+		// are not coplanar.
+		stl->face[stl_he_face(h)].angle[h % 3] = check ? 0 : d < 0 ? -1 : +1;
+	}
+
+	a->count = 0;
 }
 
 
+/** Queue the angle between the face of h and the face of h2. */
 static void
-stl_find_neighbors(
+stl_angles_add(
 	stl_3d_t * const stl,
-	stl_face_t * const f1
+	stl_angles_t * const a,
+	const int h,
+	const int h2
 )
 {
-	for(int i = 0 ; i < 3 ; i++)
+	const int f1 = stl_he_face(h);
+	const v3_t x4 = stl_angle_point(stl, f1, stl_he_face(h2));
+
+	for (int c = 0 ; c < 3 ; c++)
 	{
-		const stl_vertex_t * const v1 = f1->vertex[(i+0) % 3];
-		const stl_vertex_t * const v2 = f1->vertex[(i+1) % 3];
+		for (int k = 0 ; k < 3 ; k++)
+			a->p[k][c][a->count] = stl_face_vertex(stl, f1, k)->p.p[c];
+		a->p[3][c][a->count] = x4.p[c];
+	}
 
-		for(int j = 0 ; j < stl->num_face ; j++)
+	a->h[a->count++] = h;
+	if (a->count == STL_ANGLE_BATCH)
+		stl_angles_flush(stl, a);
+}
+
+
+static int
+stl_edge_low(
+	const int * const he_vertex,
+	const int h
+)
+{
+	const int v1 = he_vertex[h];
+	const int v2 = he_vertex[stl_he_next(h)];
+	return v1 < v2 ? v1 : v2;
+}
+
+
+static int
+stl_edge_high(
+	const int * const he_vertex,
+	const int h
+)
+{
+	const int v1 = he_vertex[h];
+	const int v2 = he_vertex[stl_he_next(h)];
+	return v1 < v2 ? v2 : v1;
+}
+
+
+/** Pair up the half-edges by grouping them on their two vertices.
+ *
+ * Every face that shares an edge is a neighbor; if more than one
+ * does, the one with the highest index is used, as the old linear
+ * search did.  Only edges with exactly two faces running in opposite
+ * directions get twins, so the rings and loops are always consistent.
+ * The angle to each neighbor is found along the way.
+ */
+static void
+stl_pair_edges(
+	stl_3d_t * const stl
+)
+{
+	const int n = 3 * stl->num_face;
+	const int num_vertex = stl->num_vertex;
+	const int * const he_vertex = stl->he_vertex;
+	int * const vertex_he = stl->vertex_he;
+
+	// the half-edges by their lower vertex v, in order, are
+	// bucket[first[v]] up to bucket[first[v+1]].  vertex_he is
+	// not set yet, so it is the cursor while they are filled in.
+	int * const first = calloc(num_vertex + 2, sizeof(*first));
+	int * const bucket = calloc(n + 1, sizeof(*bucket));
+	int max_count = 0;
+
+	for (int h = 0 ; h < n ; h++)
+		first[stl_edge_low(he_vertex, h) + 1]++;
+	for (int v = 0 ; v < num_vertex ; v++)
+	{
+		if (first[v + 1] > max_count)
+			max_count = first[v + 1];
+		first[v + 1] += first[v];
+		vertex_he[v] = first[v];
+	}
+	for (int h = 0 ; h < n ; h++)
+		bucket[vertex_he[stl_edge_low(he_vertex, h)]++] = h;
+
+	// within a bucket, the half-edges with the same higher vertex
+	// are chained from the last one through link[]; vertex_he is
+	// reused again for the head of each chain.
+	int * const link = calloc(max_count + 1, sizeof(*link));
+	for (int v = 0 ; v < num_vertex ; v++)
+		vertex_he[v] = -1;
+
+	stl_angles_t * const angles = calloc(1, sizeof(*angles));
+
+	for (int v = 0 ; v < num_vertex ; v++)
+	{
+		const int start = first[v];
+		const int end = first[v + 1];
+
+		for (int i = start ; i < end ; i++)
 		{
-			stl_face_t * const f2 = &stl->face[j];
+			int * const head = &vertex_he[stl_edge_high(he_vertex, bucket[i])];
+			link[i - start] = *head;
+			*head = i;
+		}
 
-			// skip this triangle against itself
-			if (f1 == f2)
-				continue;
+		for (int i = start ; i < end ; i++)
+		{
+			const int h = bucket[i];
+			int count = 0;
+			int mate = -1;
+			int neighbor = -1;
+
+			// walk from the highest half-edge down
+			for (int j = vertex_he[stl_edge_high(he_vertex, h)] ; j >= 0 ; j = link[j - start])
+			{
+				const int h2 = bucket[j];
+				count++;
+				if (h2 != h)
+					mate = h2;
+				if (neighbor < 0 && stl_he_face(h2) != stl_he_face(h))
+					neighbor = h2;
+			}
+
+			if (neighbor >= 0)
+				stl_angles_add(stl, angles, h, neighbor);
+
+			stl->he_twin[h] = count == 2
+				&& stl_he_face(mate) != stl_he_face(h)
+				&& he_vertex[h] == he_vertex[stl_he_next(mate)]
+				? mate : -1;
+		}
+
+		for (int i = start ; i < end ; i++)
+			vertex_he[stl_edge_high(he_vertex, bucket[i])] = -1;
+
+		progress_add(end - start);
+	}
+
+	stl_angles_flush(stl, angles);
 
-			// find if these two triangles share an edge
-			if (!stl_has_edge(f2, v1, v2))
-				continue;
+	free(angles);
+	free(link);
+	free(bucket);
+	free(first);
+
+	// start each vertex on an open edge if it has one, so that
+	// walking the ring does not miss the faces before it.
+	for (int h = 0 ; h < n ; h++)
+	{
+		int * const vh = &vertex_he[he_vertex[h]];
+		if (*vh < 0 || (stl->he_twin[h] < 0 && stl->he_twin[*vh] >= 0))
+			*vh = h;
+	}
+}
+
+
+typedef struct
+{
+	uint64_t key;
+	int face;
+} stl_morton_key_t;
+
+
+static int
+stl_morton_key_cmp(
+	const void * const a_ptr,
+	const void * const b_ptr
+)
+{
+	const stl_morton_key_t * const a = a_ptr;
+	const stl_morton_key_t * const b = b_ptr;
+	if (a->key != b->key)
+		return a->key < b->key ? -1 : 1;
+	return a->face - b->face;
+}
+
+
+/** Renumber the faces along a Morton curve through their centers and
+ * the vertices in the order that those faces first use them, so that
+ * neighbors are numbered close together.  Only the vertices and the
+ * half-edge vertices exist yet; both are moved in place.
+ */
+static void
+stl_3d_order(
+	stl_3d_t * const stl
+)
+{
+	const int num_face = stl->num_face;
+	const int num_vertex = stl->num_vertex;
+	stl_vertex_t * const vertex = stl->vertex;
+	int * const he_vertex = stl->he_vertex;
+
+	if (num_vertex == 0)
+		return;
 
-			f1->face[i] = f2;
-			f1->angle[i] = stl_angle(f1, f2);
+	v3_t lo = vertex[0].p;
+	v3_t hi = vertex[0].p;
+	for (int v = 0 ; v < num_vertex ; v++)
+		for (int c = 0 ; c < 3 ; c++)
+		{
+			if (vertex[v].p.p[c] < lo.p[c]) lo.p[c] = vertex[v].p.p[c];
+			if (vertex[v].p.p[c] > hi.p[c]) hi.p[c] = vertex[v].p.p[c];
+		}
+
+	stl_morton_key_t * const keys = calloc(num_face + 1, sizeof(*keys));
+	for (int j = 0 ; j < num_face ; j++)
+	{
+		uint64_t key = 0;
+		for (int c = 0 ; c < 3 ; c++)
+		{
+			const double center = (vertex[he_vertex[3*j+0]].p.p[c]
+				+ vertex[he_vertex[3*j+1]].p.p[c]
+				+ vertex[he_vertex[3*j+2]].p.p[c]) / 3;
+			const double size = hi.p[c] - lo.p[c];
+			const uint64_t q = size > 0
+				? (center - lo.p[c]) / size * 1023
+				: 0;
+			for (int bit = 0 ; bit < 10 ; bit++)
+				key |= ((q >> bit) & 1) << (3 * bit + c);
 		}
+		keys[j] = (stl_morton_key_t) { .key = key, .face = j };
+	}
+
+	qsort(keys, num_face, sizeof(*keys), stl_morton_key_cmp);
+
+	int * const rank = calloc(num_face + 1, sizeof(*rank));
+	int * const vrank = calloc(num_vertex + 1, sizeof(*vrank));
+	for (int v = 0 ; v < num_vertex ; v++)
+		vrank[v] = -1;
+
+	int count = 0;
+	for (int j = 0 ; j < num_face ; j++)
+	{
+		const int f = keys[j].face;
+		rank[f] = j;
+		for (int i = 0 ; i < 3 ; i++)
+			if (vrank[he_vertex[3*f + i]] < 0)
+				vrank[he_vertex[3*f + i]] = count++;
 	}
+	free(keys);
+
+	for (int h = 0 ; h < 3 * num_face ; h++)
+		he_vertex[h] = vrank[he_vertex[h]];
+
+	// swap each face and vertex into its new place, following the
+	// cycles of the permutation, instead of copying them.
+	for (int j = 0 ; j < num_face ; j++)
+		while (rank[j] != j)
+		{
+			const int k = rank[j];
+			for (int i = 0 ; i < 3 ; i++)
+			{
+				const int t = he_vertex[3*j + i];
+				he_vertex[3*j + i] = he_vertex[3*k + i];
+				he_vertex[3*k + i] = t;
+			}
+			rank[j] = rank[k];
+			rank[k] = k;
+		}
+
+	for (int v = 0 ; v < num_vertex ; v++)
+		while (vrank[v] != v)
+		{
+			const int k = vrank[v];
+			const stl_vertex_t t = vertex[v];
+			vertex[v] = vertex[k];
+			vertex[k] = t;
+			vrank[v] = vrank[k];
+			vrank[k] = k;
+		}
+
+	free(rank);
+	free(vrank);
 }
 
 
 stl_3d_t *
 stl_3d_parse(
-	int fd
+	const int fd,
+	const int compact
 )
 {
-	ssize_t rc;
 	stl_3d_file_header_t hdr;
 
-	rc = read(fd, &hdr, sizeof(hdr));
-	if (rc != sizeof(hdr))
+	if (!stl_read_all(fd, &hdr, sizeof(hdr)))
 		return NULL;
 
 	const int num_triangles = hdr.num_triangles;
 	fprintf(stderr, "%d triangles\n", num_triangles);
 
-	stl_3d_file_triangle_t * fts;
-	const size_t file_len = num_triangles * sizeof(*fts);
- 	fts = calloc(1, file_len);
-
-	rc = read(fd, fts, file_len);
-	if (rc < 0 || (size_t) rc != file_len)
-		return NULL;
-
 	stl_3d_t * const stl = calloc(1, sizeof(*stl));
+	stl->num_face = num_triangles;
+	stl->he_vertex = calloc(3 * num_triangles + 1, sizeof(*stl->he_vertex));
 
-	*stl = (stl_3d_t) {
-		.num_vertex = 0,
-		.num_face = num_triangles,
-		.vertex = calloc(num_triangles, sizeof(*stl->vertex)),
-		.face = calloc(num_triangles, sizeof(*stl->face)),
-	};
+	// the vertices and their SoA mirror grow as they are found
+	int max_vertex = 0;
+	real_t * xyz[3] = { NULL, NULL, NULL };
+
+	stl_3d_file_triangle_t * const fts = calloc(STL_READ_CHUNK, sizeof(*fts));
+	int ok = 1;
 
 	// build the unique set of vertices and their connection
-	// to each face.
-	for(int i = 0 ; i < num_triangles ; i++)
+	// to each face, a chunk of the file at a time.
+	progress_start("weld", num_triangles);
+	for (int start = 0 ; start < num_triangles ; start += STL_READ_CHUNK)
 	{
-		const stl_3d_file_triangle_t * const ft = &fts[i];
-		stl_face_t * const f = &stl->face[i];
+		const int count = num_triangles - start < STL_READ_CHUNK
+			? num_triangles - start
+			: STL_READ_CHUNK;
+
+		if (!stl_read_all(fd, fts, count * sizeof(*fts)))
+		{
+			ok = 0;
+			break;
+		}
 
-		for (int j = 0 ; j < 3 ; j++)
+		for (int i = 0 ; i < count ; i++)
 		{
-			const v3_t * const p = &ft->p[j];
+			if (stl->num_vertex + 3 > max_vertex)
+			{
+				max_vertex = max_vertex ? 2 * max_vertex : 4096;
+				stl->vertex = realloc(stl->vertex,
+					max_vertex * sizeof(*stl->vertex));
+				for (int c = 0 ; c < 3 ; c++)
+					xyz[c] = realloc(xyz[c],
+						max_vertex * sizeof(*xyz[c]));
+			}
+
+			for (int j = 0 ; j < 3 ; j++)
+			{
+				const v3_t p = v3f_load(fts[i].p[j]);
+
+				// add this vertex to this face
+				stl->he_vertex[3*(start + i) + j] = stl_vertex_find(
+					stl->vertex,
+					xyz,
+					&stl->num_vertex,
+					&p
+				);
+			}
+		}
 
-			stl_vertex_t * const v = stl_vertex_find(
-				stl->vertex,
-				&stl->num_vertex,
-				p
-			);
+		progress_add(count);
+	}
 
-			// add this vertex to this face
-			f->vertex[j] = v;
+	free(fts);
+	for (int c = 0 ; c < 3 ; c++)
+		free(xyz[c]);
 
-			// and add this face to the vertex
-			v->face[v->num_face] = f;
-			v->face_num[v->num_face] = j;
-			v->num_face++;
-		}
+	if (!ok)
+	{
+		progress_end();
+		free(stl->vertex);
+		free(stl->he_vertex);
+		free(stl);
+		return NULL;
 	}
 
+	stl->vertex = realloc(stl->vertex,
+		(stl->num_vertex + 1) * sizeof(*stl->vertex));
+
+	if (compact)
+		stl_3d_order(stl);
+
 	// build the connections between each face
-	for(int i = 0 ; i < num_triangles ; i++)
+	progress_start("pair edges", 3 * num_triangles);
+	stl->face = calloc(num_triangles + 1, sizeof(*stl->face));
+	stl->he_twin = calloc(3 * num_triangles + 1, sizeof(*stl->he_twin));
+	stl->vertex_he = calloc(stl->num_vertex + 1, sizeof(*stl->vertex_he));
+	stl_pair_edges(stl);
+	progress_end();
+
+	if (!compact)
+		return stl;
+
+	const size_t plain = (6 * num_triangles + stl->num_vertex) * sizeof(int);
+	stl->topo = topo_build(
+		num_triangles,
+		stl->num_vertex,
+		stl->he_twin,
+		stl->he_vertex,
+		stl->vertex_he
+	);
+
+	free(stl->he_twin);
+	free(stl->he_vertex);
+	free(stl->vertex_he);
+	stl->he_twin = stl->he_vertex = stl->vertex_he = NULL;
+
+	fprintf(stderr, "topology: %zu bytes, was %zu\n",
+		topo_size(stl->topo), plain);
+
+	return stl;
+}
+
+
+/** Does the segment p-q pass through the triangle?
+ * This is the Moller-Trumbore ray test, limited to the segment.
+ */
+static int
+stl_segment_crosses(
+	const v3_t * const p,
+	const v3_t * const q,
+	const stl_3d_t * const stl,
+	const int f
+)
+{
+	double a[3], e1[3], e2[3], dir[3], s[3];
+	for (int c = 0 ; c < 3 ; c++)
 	{
-		stl_face_t * const f = &stl->face[i];
-		stl_find_neighbors(stl, f);
+		a[c] = stl_face_vertex(stl, f, 0)->p.p[c];
+		e1[c] = stl_face_vertex(stl, f, 1)->p.p[c] - a[c];
+		e2[c] = stl_face_vertex(stl, f, 2)->p.p[c] - a[c];
+		dir[c] = q->p[c] - p->p[c];
+		s[c] = p->p[c] - a[c];
 	}
 
-	return stl;
+	const double h[3] = {
+		dir[1]*e2[2] - dir[2]*e2[1],
+		dir[2]*e2[0] - dir[0]*e2[2],
+		dir[0]*e2[1] - dir[1]*e2[0],
+	};
+	const double det = e1[0]*h[0] + e1[1]*h[1] + e1[2]*h[2];
+
+	// parallel to the plane of the triangle
+	if (-1e-12 < det && det < 1e-12)
+		return 0;
+
+	const double u = (s[0]*h[0] + s[1]*h[1] + s[2]*h[2]) / det;
+	if (u < 0 || u > 1)
+		return 0;
+
+	const double k[3] = {
+		s[1]*e1[2] - s[2]*e1[1],
+		s[2]*e1[0] - s[0]*e1[2],
+		s[0]*e1[1] - s[1]*e1[0],
+	};
+	const double v = (dir[0]*k[0] + dir[1]*k[1] + dir[2]*k[2]) / det;
+	if (v < 0 || u + v > 1)
+		return 0;
+
+	const double t = (e2[0]*k[0] + e2[1]*k[1] + e2[2]*k[2]) / det;
+	return 0 < t && t < 1;
+}
+
+
+/** Two triangles intersect if an edge of one passes through the other. */
+static int
+stl_faces_intersect(
+	const stl_3d_t * const stl,
+	const int f1,
+	const int f2
+)
+{
+	for (int i = 0 ; i < 3 ; i++)
+	{
+		if (stl_segment_crosses(
+			&stl_face_vertex(stl, f1, i)->p,
+			&stl_face_vertex(stl, f1, (i+1) % 3)->p,
+			stl,
+			f2
+		))
+			return 1;
+
+		if (stl_segment_crosses(
+			&stl_face_vertex(stl, f2, i)->p,
+			&stl_face_vertex(stl, f2, (i+1) % 3)->p,
+			stl,
+			f1
+		))
+			return 1;
+	}
+
+	return 0;
+}
+
+
+typedef struct
+{
+	const stl_3d_t * stl;
+	const bvh_t * bvh;
+	const bvh_box_t * boxes;
+
+	// the faces that each face intersects, with higher indices
+	int ** hits;
+	int * num_hits;
+} stl_intersect_t;
+
+
+typedef struct
+{
+	const stl_intersect_t * arg;
+	int i;
+	int max_hits;
+} stl_intersect_query_t;
+
+
+static int
+stl_intersect_test(
+	void * const query_ptr,
+	const int j
+)
+{
+	stl_intersect_query_t * const query = query_ptr;
+	const stl_intersect_t * const arg = query->arg;
+	const int i = query->i;
+
+	// each pair is only tested once
+	if (j <= i)
+		return 0;
+
+	const stl_3d_t * const stl = arg->stl;
+
+	for (int a = 0 ; a < 3 ; a++)
+		for (int b = 0 ; b < 3 ; b++)
+			if (stl_he_vertex(stl, 3*i + a) == stl_he_vertex(stl, 3*j + b))
+				return 0;
+
+	if (!stl_faces_intersect(stl, i, j))
+		return 0;
+
+	if (arg->num_hits[i] == query->max_hits)
+	{
+		query->max_hits = query->max_hits ? 2 * query->max_hits : 4;
+		arg->hits[i] = realloc(arg->hits[i],
+			query->max_hits * sizeof(*arg->hits[i]));
+	}
+
+	arg->hits[i][arg->num_hits[i]++] = j;
+	return 0;
+}
+
+
+static void
+stl_intersect_range(
+	void * const arg_ptr,
+	const int start,
+	const int end
+)
+{
+	const stl_intersect_t * const arg = arg_ptr;
+
+	for (int i = start ; i < end ; i++)
+	{
+		stl_intersect_query_t query = {
+			.arg		= arg,
+			.i		= i,
+		};
+
+		bvh_query(arg->bvh, &arg->boxes[i], stl_intersect_test, &query);
+		progress_add(1);
+	}
+}
+
+
+static int
+int_cmp(
+	const void * a,
+	const void * b
+)
+{
+	return *(const int *) a - *(const int *) b;
+}
+
+
+int
+stl_3d_self_intersections(
+	const stl_3d_t * const stl,
+	int ** const pairs_out
+)
+{
+	const int n = stl->num_face;
+	bvh_box_t * const boxes = calloc(n + 1, sizeof(*boxes));
+
+	for (int i = 0 ; i < n ; i++)
+	{
+		boxes[i] = bvh_box_empty();
+		for (int k = 0 ; k < 3 ; k++)
+			bvh_box_add(&boxes[i], stl_face_vertex(stl, i, k)->p.p);
+	}
+
+	bvh_t * const bvh = bvh_build(boxes, n);
+
+	stl_intersect_t arg = {
+		.stl		= stl,
+		.bvh		= bvh,
+		.boxes		= boxes,
+		.hits		= calloc(n + 1, sizeof(*arg.hits)),
+		.num_hits	= calloc(n + 1, sizeof(*arg.num_hits)),
+	};
+
+	progress_start("intersect", n);
+	pool_for(0, n, 64, stl_intersect_range, &arg);
+	progress_end();
+
+	// the tree order is not the face order, so sort each face's
+	// list to make the report the same every time.
+	int num_pairs = 0;
+	for (int i = 0 ; i < n ; i++)
+		num_pairs += arg.num_hits[i];
+
+	int * const pairs = calloc(2 * num_pairs + 1, sizeof(*pairs));
+	int count = 0;
+	for (int i = 0 ; i < n ; i++)
+	{
+		qsort(arg.hits[i], arg.num_hits[i], sizeof(int), int_cmp);
+		for (int k = 0 ; k < arg.num_hits[i] ; k++)
+		{
+			pairs[count++] = i;
+			pairs[count++] = arg.hits[i][k];
+		}
+		free(arg.hits[i]);
+	}
+
+	free(arg.hits);
+	free(arg.num_hits);
+	free(boxes);
+	bvh_free(bvh);
+
+	*pairs_out = pairs;
+	return num_pairs;
+}
+
+
+void
+stl_3d_check(
+	const stl_3d_t * const stl
+)
+{
+	int * pairs;
+	const int num_pairs = stl_3d_self_intersections(stl, &pairs);
+	for (int i = 0 ; i < num_pairs ; i++)
+		fprintf(stderr, "face %d intersects face %d\n",
+			pairs[2*i+0], pairs[2*i+1]);
+	if (num_pairs)
+		errx(EXIT_FAILURE, "%d intersecting faces", num_pairs);
+	free(pairs);
 }
 
 
@@ -247,49 +831,34 @@ stl_trace_face(
 	const int start_vertex
 )
 {
-	const stl_face_t * f = f_start;
-	int i = start_vertex;
+	const int h_start = 3 * (f_start - stl->face) + start_vertex;
+	int h = h_start;
 	int vertex_count = 0;
 
 	do {
-		const stl_vertex_t * const v1 = f->vertex[(i+0) % 3];
-		const stl_vertex_t * const v2 = f->vertex[(i+1) % 3];
-		const stl_face_t * const f_next = f->face[i];
+		const stl_vertex_t * const v1 = &stl->vertex[stl_he_vertex(stl, h)];
+		fprintf(stderr, "%p %d: %f,%f,%f\n",
+			&stl->face[stl_he_face(h)], h % 3,
+			v1->p.p[0], v1->p.p[1], v1->p.p[2]);
 
-		fprintf(stderr, "%p %d: %f,%f,%f\n", f, i, v1->p.p[0], v1->p.p[1], v1->p.p[2]);
 		if (face_used)
-			face_used[f - stl->face] = 1;
+			face_used[stl_he_face(h)] = 1;
 
-		if (!f_next || f->angle[i] != 0)
+		if (stl_he_boundary(stl, h))
 		{
 			// not coplanar or no connection.
 			// add the NEXT vertex on this face and continue
-			vertex_list[vertex_count++] = v2;
-			i = (i+1) % 3;
+			h = stl_he_next(h);
+			vertex_list[vertex_count++] = &stl->vertex[stl_he_vertex(stl, h)];
 			continue;
 		}
 
-		// coplanar; figure out which vertex on the next
-		// face we start at
-		int i_next = -1;
-		for (int j = 0 ; j < 3 ; j++)
-		{
-			if (f_next->vertex[j] != v1)
-				continue;
-			i_next = j;
-			break;
-		}
-
-		if (i_next == -1)
-			abort();
-		
-		// move to the new face
-		f = f_next;
-		i = i_next;
+		// coplanar; continue on the next face from the same vertex
+		h = stl_he_next(stl_he_twin(stl, h));
 
 		// keep going until we reach our starting face
-		// at vertex 0.
-	} while (f != f_start || i != start_vertex);
+		// at the starting vertex.
+	} while (h != h_start);
 
 	return vertex_count;
 }
@@ -314,6 +883,43 @@ refframe_init(
 }
 
 
+void
+refframe_init_batch(
+	refframe_t * const ref,
+	const int n,
+	const v3_soa_t p[3]
+)
+{
+	v3_soa_t dx = v3_soa_alloc(n);
+	v3_soa_t dy = v3_soa_alloc(n);
+	v3_soa_t z = v3_soa_alloc(n);
+
+	v3_batch_sub(n, &p[1], &p[0], &dx);
+	v3_batch_norm(n, &dx, &dx);
+	v3_batch_sub(n, &p[2], &p[0], &dy);
+	v3_batch_norm(n, &dy, &dy);
+
+	v3_batch_cross(n, &dx, &dy, &z);
+	v3_batch_norm(n, &z, &z);
+
+	// dy is no longer needed; reuse it for the y axis
+	v3_batch_cross(n, &dx, &z, &dy);
+	v3_batch_norm(n, &dy, &dy);
+
+	for (int i = 0 ; i < n ; i++)
+	{
+		ref[i].origin = v3_soa_get(&p[0], i);
+		ref[i].x = v3_soa_get(&dx, i);
+		ref[i].y = v3_soa_get(&dy, i);
+		ref[i].z = v3_soa_get(&z, i);
+	}
+
+	v3_soa_free(&dx);
+	v3_soa_free(&dy);
+	v3_soa_free(&z);
+}
+
+
 void
 v3_project(
 	const refframe_t * const ref,
@@ -398,21 +1004,18 @@ line_intersect(
 
  */
 void
-refframe_inset(
-	const refframe_t * const ref,
+v2_inset(
 	const double inset_dist,
 	double * const x_out,
 	double * const y_out,
-	const v3_t p0, // previous point
-	const v3_t p1, // current point to inset
-	const v3_t p2  // next point
+	double a,
+	double b,
+	double c,
+	double d,
+	double e,
+	double f
 )
 {
-	double a, b, c, d, e, f;
-	v3_project(ref, p0, &a, &b);
-	v3_project(ref, p1, &c, &d);
-	v3_project(ref, p2, &e, &f);
-
 	double c1 = c;
 	double d1 = d;
 	double c2 = c;
@@ -468,3 +1071,23 @@ refframe_inset(
 	*x_out = *y_out = 0;
 	fprintf(stderr, "inset failed 2\n");
 }
+
+
+void
+refframe_inset(
+	const refframe_t * const ref,
+	const double inset_dist,
+	double * const x_out,
+	double * const y_out,
+	const v3_t p0, // previous point
+	const v3_t p1, // current point to inset
+	const v3_t p2  // next point
+)
+{
+	double a, b, c, d, e, f;
+	v3_project(ref, p0, &a, &b);
+	v3_project(ref, p1, &c, &d);
+	v3_project(ref, p2, &e, &f);
+
+	v2_inset(inset_dist, x_out, y_out, a, b, c, d, e, f);
+}
@@ -7,24 +7,21 @@
 #define _stl3d_h_
 
 #include "v3.h"
+#include "topo.h"
+#include <stdint.h>
 
 typedef struct stl_vertex stl_vertex_t;
 typedef struct stl_face stl_face_t;
 
-#define STL_MAX_FACES 64
-
 struct stl_vertex {
 	v3_t p;
-	int num_face;
-	stl_face_t *face[STL_MAX_FACES];
-	int face_num[STL_MAX_FACES]; // which vertex on the face
 };
 
+// the vertices of a face are those of its half-edges, which are
+// read with stl_face_vertex(); only the fold to each neighbor is kept.
 struct stl_face
 {
-	stl_vertex_t * vertex[3];
-	stl_face_t * face[3];
-	double angle[3];
+	int8_t angle[3];	// 0 coplanar, -1 valley, +1 mountain
 };
 
 
@@ -35,12 +32,193 @@ typedef struct
 
 	int num_face;
 	stl_face_t * face;
+
+	// half-edge 3*f+i runs from vertex i of face f to vertex i+1,
+	// so the next half-edge and the face of each are implicit.
+	int * he_twin;		// the opposite half-edge, or -1
+	int * he_vertex;	// index of the vertex it starts at
+	int * vertex_he;	// an outgoing half-edge of each vertex
+
+	// when parsed compact the three arrays above are NULL and
+	// the same values are read from here instead.
+	topo_t * topo;
 } stl_3d_t;
 
 
+static inline int
+stl_he_twin(
+	const stl_3d_t * const stl,
+	const int h
+)
+{
+	return stl->topo ? topo_twin(stl->topo, h) : stl->he_twin[h];
+}
+
+
+static inline int
+stl_he_vertex(
+	const stl_3d_t * const stl,
+	const int h
+)
+{
+	return stl->topo ? topo_he_vertex(stl->topo, h) : stl->he_vertex[h];
+}
+
+
+static inline int
+stl_vertex_he(
+	const stl_3d_t * const stl,
+	const int v
+)
+{
+	return stl->topo ? topo_vertex_he(stl->topo, v) : stl->vertex_he[v];
+}
+
+
+static inline int
+stl_he_next(
+	const int h
+)
+{
+	return h % 3 == 2 ? h - 2 : h + 1;
+}
+
+
+static inline int
+stl_he_prev(
+	const int h
+)
+{
+	return h % 3 == 0 ? h + 2 : h - 1;
+}
+
+
+static inline int
+stl_he_face(
+	const int h
+)
+{
+	return h / 3;
+}
+
+
+/** Vertex k of face f. */
+static inline const stl_vertex_t *
+stl_face_vertex(
+	const stl_3d_t * const stl,
+	const int f,
+	const int k
+)
+{
+	return &stl->vertex[stl_he_vertex(stl, 3 * f + k)];
+}
+
+
+/** Is the half-edge on the boundary of its coplanar polygon:
+ * an open edge or a fold to a face in a different plane?
+ */
+static inline int
+stl_he_boundary(
+	const stl_3d_t * const stl,
+	const int h
+)
+{
+	return stl_he_twin(stl, h) < 0 || stl->face[h / 3].angle[h % 3] != 0;
+}
+
+
+/** The next half-edge around the coplanar polygon that h is on the
+ * boundary of, crossing any coplanar faces in the way.
+ */
+static inline int
+stl_loop_next(
+	const stl_3d_t * const stl,
+	int h
+)
+{
+	h = stl_he_next(h);
+	while (!stl_he_boundary(stl, h))
+		h = stl_he_next(stl_he_twin(stl, h));
+	return h;
+}
+
+
+/** Iterator over the outgoing half-edges around a vertex:
+ *
+ *	stl_ring_t r;
+ *	for (int h = stl_ring_start(&r, stl, v) ; h >= 0 ; h = stl_ring_next(&r))
+ *
+ * On an open fan it starts at the boundary so every face is visited.
+ * Only edges shared by exactly two faces are paired, so at a vertex
+ * where separate fans meet only one fan is walked.
+ */
+typedef struct
+{
+	const stl_3d_t * stl;
+	int first;
+	int h;
+} stl_ring_t;
+
+
+static inline int
+stl_ring_start(
+	stl_ring_t * const r,
+	const stl_3d_t * const stl,
+	const int v
+)
+{
+	r->stl = stl;
+	r->first = r->h = stl_vertex_he(stl, v);
+	return r->h;
+}
+
+
+static inline int
+stl_ring_next(
+	stl_ring_t * const r
+)
+{
+	const int h = stl_he_twin(r->stl, stl_he_prev(r->h));
+	r->h = h == r->first ? -1 : h;
+	return r->h;
+}
+
+
+/** Read a binary STL file a chunk at a time.
+ *
+ * If compact is set the faces and vertices are renumbered so that
+ * neighbors are close together and the half-edges are stored as a
+ * compact topology, for meshes too large to hold the plain arrays.
+ * The faces and vertices keep their shape but not their order.
+ */
 stl_3d_t *
 stl_3d_parse(
-	int fd
+	int fd,
+	int compact
+);
+
+
+/** Find the pairs of faces that pass through each other.
+ *
+ * Faces that share a vertex or an edge are not tested, and faces
+ * that lie in the same plane are not reported.  *pairs_out is set
+ * to a malloc'ed array of the face indices of each pair, two per
+ * pair, with the lower index first and the pairs in order.
+ * \return the number of pairs.
+ */
+int
+stl_3d_self_intersections(
+	const stl_3d_t * stl,
+	int ** pairs_out
+);
+
+
+/** Report every pair of faces that intersect and exit if there are any.
+ * This is the -c check of the tools that read an stl_3d_t.
+ */
+void
+stl_3d_check(
+	const stl_3d_t * stl
 );
 
 
@@ -82,6 +260,35 @@ refframe_init(
 );
 
 
+/** Compute the reference frames for n triangles at once.
+ * p[k] holds vertex k of each triangle; the result is the same
+ * as calling refframe_init() on each of them.
+ */
+void
+refframe_init_batch(
+	refframe_t * ref,
+	int n,
+	const v3_soa_t p[3]
+);
+
+
+/** Inset the 2D point (c,d) by inset_dist, given the previous
+ * point (a,b) and the next point (e,f) on the polygon.
+ */
+void
+v2_inset(
+	const double inset_dist,
+	double * const x_out,
+	double * const y_out,
+	double a,
+	double b,
+	double c,
+	double d,
+	double e,
+	double f
+);
+
+
 void
 refframe_inset(
 	const refframe_t * const ref,
@@ -0,0 +1,230 @@
+/** \file
+ * Sweep-line overlap check for a finished layout.
+ *
+ * The triangles are sorted by their low edge along the longer axis of
+ * the layout and swept along it.  unfold stacks its pieces in columns,
+ * so a sweep across a tall sheet would keep every piece of a column
+ * active at once.  The active set holds the triangles whose range
+ * still reaches the sweep line, and each new triangle is only tested
+ * against the active ones whose range on the other axis it also
+ * overlaps.
+ */
+#include "sweep.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+typedef struct
+{
+	real_t min;
+	int index;
+} sweep_event_t;
+
+
+static int
+sweep_event_cmp(
+	const void * a_ptr,
+	const void * b_ptr
+)
+{
+	const sweep_event_t * const a = a_ptr;
+	const sweep_event_t * const b = b_ptr;
+
+	if (a->min < b->min)
+		return -1;
+	if (a->min > b->min)
+		return +1;
+	return a->index - b->index;
+}
+
+
+static void
+sweep_bbox(
+	const sweep_tri_t * const t,
+	real_t min[2],
+	real_t max[2]
+)
+{
+	for (int c = 0 ; c < 2 ; c++)
+	{
+		min[c] = max[c] = t->p[0][c];
+		for (int k = 1 ; k < 3 ; k++)
+		{
+			if (t->p[k][c] < min[c]) min[c] = t->p[k][c];
+			if (t->p[k][c] > max[c]) max[c] = t->p[k][c];
+		}
+		min[c] += t->off[c];
+		max[c] += t->off[c];
+	}
+}
+
+
+/** How far do the triangles overlap?
+ *
+ * By the separating axis theorem two triangles are disjoint if their
+ * projections onto the normal of one of the six edges are disjoint.
+ * The smallest overlap of the projections is how far one would have
+ * to move to clear the other; it is zero or negative if they only
+ * touch or are apart.  This covers one triangle inside the other
+ * as well as crossing edges.
+ */
+static real_t
+sweep_depth(
+	const real_t p1[3][2],
+	const real_t p2[3][2]
+)
+{
+	const real_t (* const tri[2])[2] = { p1, p2 };
+	real_t depth = INFINITY;
+
+	for (int t = 0 ; t < 2 ; t++)
+	{
+		for (int k = 0 ; k < 3 ; k++)
+		{
+			const real_t * const a = tri[t][k];
+			const real_t * const b = tri[t][(k+1) % 3];
+			const real_t dx = b[0] - a[0];
+			const real_t dy = b[1] - a[1];
+			const real_t len = sqrt(dx*dx + dy*dy);
+			if (len == 0)
+				continue;
+			const real_t nx = -dy / len;
+			const real_t ny = dx / len;
+
+			real_t min[2] = { INFINITY, INFINITY };
+			real_t max[2] = { -INFINITY, -INFINITY };
+			for (int j = 0 ; j < 2 ; j++)
+			{
+				for (int v = 0 ; v < 3 ; v++)
+				{
+					const real_t d = nx * tri[j][v][0] + ny * tri[j][v][1];
+					if (d < min[j]) min[j] = d;
+					if (d > max[j]) max[j] = d;
+				}
+			}
+
+			const real_t lo = min[0] > min[1] ? min[0] : min[1];
+			const real_t hi = max[0] < max[1] ? max[0] : max[1];
+			if (hi - lo < depth)
+				depth = hi - lo;
+		}
+	}
+
+	return depth;
+}
+
+
+static void
+sweep_report(
+	int ** const pairs,
+	int * const num_pairs,
+	int * const max_pairs,
+	const int id1,
+	const int id2
+)
+{
+	if (*num_pairs == *max_pairs)
+	{
+		*max_pairs = *max_pairs ? 2 * *max_pairs : 64;
+		*pairs = realloc(*pairs, 2 * *max_pairs * sizeof(**pairs));
+	}
+
+	int * const pair = &(*pairs)[2 * (*num_pairs)++];
+	pair[0] = id1 < id2 ? id1 : id2;
+	pair[1] = id1 < id2 ? id2 : id1;
+}
+
+
+int
+sweep_overlaps(
+	const sweep_tri_t * const tris,
+	const int n,
+	const real_t tolerance,
+	int ** const pairs_out
+)
+{
+	sweep_event_t * const events = calloc(n + 1, sizeof(*events));
+	real_t * const max_s = calloc(n + 1, sizeof(*max_s));
+
+	// sweep along whichever axis the layout is longer in
+	real_t lo[2] = { INFINITY, INFINITY };
+	real_t hi[2] = { -INFINITY, -INFINITY };
+	for (int i = 0 ; i < n ; i++)
+	{
+		real_t min[2], max[2];
+		sweep_bbox(&tris[i], min, max);
+		for (int c = 0 ; c < 2 ; c++)
+		{
+			if (min[c] < lo[c]) lo[c] = min[c];
+			if (max[c] > hi[c]) hi[c] = max[c];
+		}
+	}
+
+	const int axis = hi[1] - lo[1] > hi[0] - lo[0] ? 1 : 0;
+	const int other = 1 - axis;
+
+	for (int i = 0 ; i < n ; i++)
+	{
+		real_t min[2], max[2];
+		sweep_bbox(&tris[i], min, max);
+		events[i].min = min[axis];
+		events[i].index = i;
+		max_s[i] = max[axis];
+	}
+
+	qsort(events, n, sizeof(*events), sweep_event_cmp);
+
+	int * const active = calloc(n + 1, sizeof(*active));
+	int num_active = 0;
+
+	int * pairs = NULL;
+	int num_pairs = 0;
+	int max_pairs = 0;
+
+	for (int e = 0 ; e < n ; e++)
+	{
+		const int i = events[e].index;
+		const sweep_tri_t * const t = &tris[i];
+
+		real_t min[2], max[2];
+		sweep_bbox(t, min, max);
+
+		// retire the triangles that end before this one starts
+		// and test this one against the rest
+		int kept = 0;
+		for (int j = 0 ; j < num_active ; j++)
+		{
+			const int a = active[j];
+			if (max_s[a] < events[e].min)
+				continue;
+			active[kept++] = a;
+
+			const sweep_tri_t * const t2 = &tris[a];
+			real_t min2[2], max2[2];
+			sweep_bbox(t2, min2, max2);
+			if (max2[other] < min[other] || max[other] < min2[other])
+				continue;
+
+			// move t2 into the frame of t
+			real_t p2[3][2];
+			for (int k = 0 ; k < 3 ; k++)
+				for (int c = 0 ; c < 2 ; c++)
+					p2[k][c] = t2->p[k][c]
+						+ (t2->off[c] - t->off[c]);
+
+			if (sweep_depth(t->p, (const real_t (*)[2]) p2) > tolerance)
+				sweep_report(&pairs, &num_pairs, &max_pairs,
+					t->id, t2->id);
+		}
+
+		num_active = kept;
+		active[num_active++] = i;
+	}
+
+	free(active);
+	free(max_s);
+	free(events);
+
+	*pairs_out = pairs;
+	return num_pairs;
+}
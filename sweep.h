@@ -0,0 +1,46 @@
+/** \file
+ * Whole layout overlap check.
+ *
+ * overlap_check() in unfold only tests each new triangle against its
+ * own group as it is placed.  This checks a finished sheet: every
+ * pair of triangles is tested for crossing edges and for one being
+ * inside the other, using a sweep along the longer axis of the sheet
+ * so that only triangles whose ranges on that axis overlap are ever
+ * compared.
+ */
+#ifndef _papercraft_sweep_h_
+#define _papercraft_sweep_h_
+
+#include "v3.h"
+
+/** A triangle at p + off on the sheet.
+ *
+ * p is in the frame of the piece that holds the triangle and off is
+ * where that piece is placed.  Triangles are compared in the frame of
+ * one of them, so two triangles of the same piece are tested exactly
+ * as they were placed and the placement adds no rounding error.
+ */
+typedef struct
+{
+	real_t p[3][2];
+	real_t off[2];
+	int id;
+} sweep_tri_t;
+
+
+/** Find every pair of triangles that overlap by more than tolerance.
+ *
+ * Triangles that only share an edge or a vertex do not overlap.
+ * *pairs_out is set to a malloc'ed array of the ids of each pair,
+ * two per pair, with the lower id first.
+ * \return the number of pairs.
+ */
+int
+sweep_overlaps(
+	const sweep_tri_t * tris,
+	int n,
+	real_t tolerance,
+	int ** pairs_out
+);
+
+#endif
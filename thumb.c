@@ -0,0 +1,448 @@
+/** \file
+ * Thumbnail rasterizer.
+ */
+#include "thumb.h"
+#include "png.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+#define 	M_PI   3.1415926535897932384
+#endif
+
+// sub-scanlines in each row of pixels for the anti-aliasing
+#define THUMB_SUBSAMPLE	4
+
+// blank space around the drawing in each panel
+#define THUMB_MARGIN	8
+
+// the 3D view, turned about the vertical and then tipped forward
+#define THUMB_AZIMUTH	(M_PI / 6)
+#define THUMB_ELEVATION	(M_PI / 6)
+
+// how far behind the surface, in pixels, an edge can be and still show
+#define THUMB_EDGE_BIAS	1.5
+
+
+thumb_t *
+thumb_alloc(
+	const int panels
+)
+{
+	thumb_t * const thumb = calloc(1, sizeof(*thumb));
+	thumb->w = THUMB_SIZE * panels;
+	thumb->h = THUMB_SIZE;
+	thumb->rgb = malloc(3 * thumb->w * thumb->h);
+	thumb->z = malloc(thumb->w * thumb->h * sizeof(*thumb->z));
+
+	memset(thumb->rgb, 0xFF, 3 * thumb->w * thumb->h);
+	for (int i = 0 ; i < thumb->w * thumb->h ; i++)
+		thumb->z[i] = INFINITY;
+
+	return thumb;
+}
+
+
+void
+thumb_free(
+	thumb_t * const thumb
+)
+{
+	free(thumb->rgb);
+	free(thumb->z);
+	free(thumb);
+}
+
+
+/** Turn a model point into the 3D view: x to the right, y down the
+ * screen and z away from the viewer.
+ */
+static void
+thumb_turn(
+	const double p[3],
+	double out[3]
+)
+{
+	const double ca = cos(THUMB_AZIMUTH);
+	const double sa = sin(THUMB_AZIMUTH);
+	const double ce = cos(THUMB_ELEVATION);
+	const double se = sin(THUMB_ELEVATION);
+
+	const double x = ca * p[0] - sa * p[1];
+	const double y = sa * p[0] + ca * p[1];
+
+	out[0] = x;
+	out[1] = -(ce * p[2] + se * y);
+	out[2] = ce * y - se * p[2];
+}
+
+
+void
+thumb_view(
+	thumb_view_t * const view,
+	const int panel,
+	const int three_d,
+	const double min[3],
+	const double max[3]
+)
+{
+	view->three_d = three_d;
+	for (int c = 0 ; c < 3 ; c++)
+		view->center[c] = (min[c] + max[c]) / 2;
+
+	// the extent on the screen, from the corners of the box
+	double lo[2] = { INFINITY, INFINITY };
+	double hi[2] = { -INFINITY, -INFINITY };
+	for (int k = 0 ; k < 8 ; k++)
+	{
+		double p[3] = {
+			(k & 1 ? max[0] : min[0]) - view->center[0],
+			(k & 2 ? max[1] : min[1]) - view->center[1],
+			(k & 4 ? max[2] : min[2]) - view->center[2],
+		};
+		if (three_d)
+			thumb_turn(p, p);
+
+		for (int c = 0 ; c < 2 ; c++)
+		{
+			if (p[c] < lo[c]) lo[c] = p[c];
+			if (p[c] > hi[c]) hi[c] = p[c];
+		}
+	}
+
+	const double size = fmax(hi[0] - lo[0], hi[1] - lo[1]);
+	view->scale = size > 0 ? (THUMB_SIZE - 2 * THUMB_MARGIN) / size : 1;
+	view->off[0] = panel * THUMB_SIZE + THUMB_SIZE / 2.0
+		- (lo[0] + hi[0]) / 2 * view->scale;
+	view->off[1] = THUMB_SIZE / 2.0
+		- (lo[1] + hi[1]) / 2 * view->scale;
+}
+
+
+void
+thumb_project(
+	const thumb_view_t * const view,
+	const double p[3],
+	double out[3]
+)
+{
+	double q[3] = {
+		p[0] - view->center[0],
+		p[1] - view->center[1],
+		view->three_d ? p[2] - view->center[2] : 0,
+	};
+	if (view->three_d)
+		thumb_turn(q, q);
+
+	out[0] = q[0] * view->scale + view->off[0];
+	out[1] = q[1] * view->scale + view->off[1];
+	out[2] = q[2] * view->scale;
+}
+
+
+/** Mix color into pixel (x,y) by coverage a from 0 to 1. */
+static void
+thumb_blend(
+	thumb_t * const thumb,
+	const int x,
+	const int y,
+	const uint32_t color,
+	const double a
+)
+{
+	uint8_t * const p = &thumb->rgb[3 * (y * thumb->w + x)];
+	for (int c = 0 ; c < 3 ; c++)
+	{
+		const double v = (color >> (16 - 8 * c)) & 0xFF;
+		p[c] = p[c] + (v - p[c]) * a + 0.5;
+	}
+}
+
+
+void
+thumb_polygon(
+	thumb_t * const thumb,
+	const double * const xy,
+	const int n,
+	const uint32_t color
+)
+{
+	// nothing to fill, and the bounds below would stay infinite
+	if (n < 3)
+		return;
+
+	double ymin = INFINITY;
+	double ymax = -INFINITY;
+	for (int i = 0 ; i < n ; i++)
+	{
+		ymin = fmin(ymin, xy[2*i+1]);
+		ymax = fmax(ymax, xy[2*i+1]);
+	}
+
+	const int y0 = fmax(0, floor(ymin));
+	const int y1 = fmin(thumb->h - 1, ceil(ymax));
+	float * const cover = calloc(thumb->w + 1, sizeof(*cover));
+	double * const cross = calloc(n + 1, sizeof(*cross));
+
+	for (int y = y0 ; y <= y1 ; y++)
+	{
+		int xlo = thumb->w;
+		int xhi = -1;
+
+		for (int s = 0 ; s < THUMB_SUBSAMPLE ; s++)
+		{
+			const double sy = y + (s + 0.5) / THUMB_SUBSAMPLE;
+
+			// where this sub-scanline crosses the edges
+			int count = 0;
+			for (int i = 0 ; i < n ; i++)
+			{
+				const double * const a = &xy[2*i];
+				const double * const b = &xy[2*((i+1) % n)];
+				if ((a[1] <= sy) == (b[1] <= sy))
+					continue;
+				const double t = (sy - a[1]) / (b[1] - a[1]);
+				double x = a[0] + t * (b[0] - a[0]);
+
+				int k = count++;
+				for ( ; k > 0 && cross[k-1] > x ; k--)
+					cross[k] = cross[k-1];
+				cross[k] = x;
+			}
+
+			// even-odd spans, with the fraction of the pixels
+			// at each end that is covered
+			for (int i = 0 ; i + 1 < count ; i += 2)
+			{
+				const double xa = fmax(0, cross[i]);
+				const double xb = fmin(thumb->w, cross[i+1]);
+				if (xa >= xb)
+					continue;
+
+				const int ia = xa;
+				const int ib = xb;
+				const float w = 1.0 / THUMB_SUBSAMPLE;
+				if (ia == ib)
+				{
+					cover[ia] += (xb - xa) * w;
+				} else {
+					cover[ia] += (ia + 1 - xa) * w;
+					for (int x = ia + 1 ; x < ib ; x++)
+						cover[x] += w;
+					if (ib < thumb->w)
+						cover[ib] += (xb - ib) * w;
+				}
+
+				if (ia < xlo) xlo = ia;
+				if (ib > xhi) xhi = ib;
+			}
+		}
+
+		if (xhi >= thumb->w)
+			xhi = thumb->w - 1;
+
+		for (int x = xlo ; x <= xhi ; x++)
+		{
+			if (cover[x] > 0)
+				thumb_blend(thumb, x, y, color, fmin(1, cover[x]));
+			cover[x] = 0;
+		}
+	}
+
+	free(cover);
+	free(cross);
+}
+
+
+void
+thumb_line(
+	thumb_t * const thumb,
+	const double a[2],
+	const double b[2],
+	const double width,
+	const uint32_t color
+)
+{
+	const double dx = b[0] - a[0];
+	const double dy = b[1] - a[1];
+	const double len = sqrt(dx*dx + dy*dy);
+	if (len == 0)
+		return;
+
+	// a thin rectangle along the line
+	const double nx = -dy / len * width / 2;
+	const double ny = dx / len * width / 2;
+	const double quad[] = {
+		a[0] + nx, a[1] + ny,
+		b[0] + nx, b[1] + ny,
+		b[0] - nx, b[1] - ny,
+		a[0] - nx, a[1] - ny,
+	};
+
+	thumb_polygon(thumb, quad, 4, color);
+}
+
+
+void
+thumb_edge(
+	thumb_t * const thumb,
+	const double a[3],
+	const double b[3],
+	const double width,
+	const uint32_t color
+)
+{
+	const double dx = b[0] - a[0];
+	const double dy = b[1] - a[1];
+	const double len2 = dx*dx + dy*dy;
+	if (len2 == 0)
+		return;
+
+	const double r = width / 2 + 0.5;
+	const int x0 = fmax(0, floor(fmin(a[0], b[0]) - r));
+	const int x1 = fmin(thumb->w - 1, ceil(fmax(a[0], b[0]) + r));
+	const int y0 = fmax(0, floor(fmin(a[1], b[1]) - r));
+	const int y1 = fmin(thumb->h - 1, ceil(fmax(a[1], b[1]) + r));
+
+	for (int y = y0 ; y <= y1 ; y++)
+	{
+		for (int x = x0 ; x <= x1 ; x++)
+		{
+			// nearest point on the line to the pixel center
+			const double px = x + 0.5 - a[0];
+			const double py = y + 0.5 - a[1];
+			double t = (px * dx + py * dy) / len2;
+			if (t < 0) t = 0;
+			if (t > 1) t = 1;
+
+			const double ex = px - t * dx;
+			const double ey = py - t * dy;
+			const double cover = r - sqrt(ex*ex + ey*ey);
+			if (cover <= 0)
+				continue;
+
+			// the line is on the edge of the triangles that
+			// drew the depth, so it only has to be about as
+			// close as they are.
+			const double z = a[2] + t * (b[2] - a[2]);
+			if (z > thumb->z[y * thumb->w + x] + THUMB_EDGE_BIAS)
+				continue;
+
+			thumb_blend(thumb, x, y, color, fmin(cover, 1));
+		}
+	}
+}
+
+
+void
+thumb_triangle(
+	thumb_t * const thumb,
+	const double p[3][3],
+	const uint32_t color
+)
+{
+	// light from over the viewer's shoulder; the view space
+	// normal is the same for either winding.
+	double e1[3], e2[3];
+	for (int c = 0 ; c < 3 ; c++)
+	{
+		e1[c] = p[1][c] - p[0][c];
+		e2[c] = p[2][c] - p[0][c];
+	}
+	const double n[3] = {
+		e1[1]*e2[2] - e1[2]*e2[1],
+		e1[2]*e2[0] - e1[0]*e2[2],
+		e1[0]*e2[1] - e1[1]*e2[0],
+	};
+	const double len = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+	if (len == 0)
+		return;
+
+	const double light[3] = { -0.3, -0.5, -0.81 };
+	const double shade = 0.35 + 0.65
+		* fabs(n[0]*light[0] + n[1]*light[1] + n[2]*light[2]) / len;
+
+	uint32_t lit = 0;
+	for (int c = 0 ; c < 3 ; c++)
+	{
+		const int v = ((color >> (16 - 8 * c)) & 0xFF) * shade;
+		lit |= (uint32_t) v << (16 - 8 * c);
+	}
+
+	const double det = e1[0]*e2[1] - e1[1]*e2[0];
+	if (det == 0)
+		return;
+
+	const int x0 = fmax(0, floor(fmin(p[0][0], fmin(p[1][0], p[2][0]))));
+	const int x1 = fmin(thumb->w - 1, ceil(fmax(p[0][0], fmax(p[1][0], p[2][0]))));
+	const int y0 = fmax(0, floor(fmin(p[0][1], fmin(p[1][1], p[2][1]))));
+	const int y1 = fmin(thumb->h - 1, ceil(fmax(p[0][1], fmax(p[1][1], p[2][1]))));
+
+	for (int y = y0 ; y <= y1 ; y++)
+	{
+		for (int x = x0 ; x <= x1 ; x++)
+		{
+			// barycentric coordinates of the pixel center
+			const double px = x + 0.5 - p[0][0];
+			const double py = y + 0.5 - p[0][1];
+			const double u = (px * e2[1] - py * e2[0]) / det;
+			const double v = (py * e1[0] - px * e1[1]) / det;
+			if (u < 0 || v < 0 || u + v > 1)
+				continue;
+
+			const float z = p[0][2] + u * e1[2] + v * e2[2];
+			float * const zp = &thumb->z[y * thumb->w + x];
+			if (z >= *zp)
+				continue;
+
+			*zp = z;
+			thumb_blend(thumb, x, y, lit, 1);
+		}
+	}
+}
+
+
+uint32_t
+thumb_color(
+	const int id
+)
+{
+	// hues spaced by the golden angle, at a pastel saturation
+	const double h = fmod(id * 0.618033988749895, 1) * 6;
+	const double s = 0.55;
+	const double v = 0.95;
+	const int i = h;
+	const double f = h - i;
+	const double rgb[6][3] = {
+		{ v, v * (1 - s * (1 - f)), v * (1 - s) },
+		{ v * (1 - s * f), v, v * (1 - s) },
+		{ v * (1 - s), v, v * (1 - s * (1 - f)) },
+		{ v * (1 - s), v * (1 - s * f), v },
+		{ v * (1 - s * (1 - f)), v * (1 - s), v },
+		{ v, v * (1 - s), v * (1 - s * f) },
+	};
+
+	uint32_t color = 0;
+	for (int c = 0 ; c < 3 ; c++)
+		color |= (uint32_t) (rgb[i % 6][c] * 255) << (16 - 8 * c);
+	return color;
+}
+
+
+int
+thumb_write(
+	const thumb_t * const thumb,
+	const char * const filename
+)
+{
+	FILE * const out = fopen(filename, "wb");
+	if (!out)
+		return -1;
+
+	const int rc = png_write(out, thumb->w, thumb->h, thumb->rgb);
+	if (fclose(out) != 0)
+		return -1;
+	return rc;
+}
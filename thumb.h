@@ -0,0 +1,133 @@
+/** \file
+ * Thumbnail rasterizer.
+ *
+ * Draws a small preview of a tool's result straight to a PNG, so a
+ * job runner does not need to render the SVG or SCAD itself.  Flat
+ * 2D layouts are filled with an anti-aliased scanline rasterizer and
+ * 3D meshes are drawn flat shaded with a z-buffer, seen from above
+ * and to one side.  A thumbnail can have several panels side by side,
+ * each with its own view.
+ */
+#ifndef _papercraft_thumb_h_
+#define _papercraft_thumb_h_
+
+#include <stdint.h>
+
+// pixels on each side of a panel
+#define THUMB_SIZE	256
+
+typedef struct
+{
+	int w;
+	int h;
+	uint8_t * rgb;
+	float * z;
+} thumb_t;
+
+
+/** Where a panel is and how points are mapped into it. */
+typedef struct
+{
+	int three_d;
+	double scale;
+	double off[2];
+	double center[3];
+} thumb_view_t;
+
+
+/** A white thumbnail with room for the given number of panels. */
+thumb_t *
+thumb_alloc(
+	int panels
+);
+
+
+void
+thumb_free(
+	thumb_t * thumb
+);
+
+
+/** Fit the box from min to max into panel i, keeping its shape.
+ * 2D views use x and y as they are in the SVG; 3D views turn the
+ * box to show the top and two sides.
+ */
+void
+thumb_view(
+	thumb_view_t * view,
+	int panel,
+	int three_d,
+	const double min[3],
+	const double max[3]
+);
+
+
+/** Map a point into pixels, with its depth in out[2]. */
+void
+thumb_project(
+	const thumb_view_t * view,
+	const double p[3],
+	double out[3]
+);
+
+
+/** Fill a polygon of n pixel points, anti-aliased. */
+void
+thumb_polygon(
+	thumb_t * thumb,
+	const double * xy,
+	int n,
+	uint32_t color
+);
+
+
+/** Draw an anti-aliased line of the given width in pixels. */
+void
+thumb_line(
+	thumb_t * thumb,
+	const double a[2],
+	const double b[2],
+	double width,
+	uint32_t color
+);
+
+
+/** Draw a projected line of the given width in pixels, hidden where
+ * a triangle is closer.  Draw the triangles first.
+ */
+void
+thumb_edge(
+	thumb_t * thumb,
+	const double a[3],
+	const double b[3],
+	double width,
+	uint32_t color
+);
+
+
+/** Draw a projected triangle flat shaded, hidden by anything closer. */
+void
+thumb_triangle(
+	thumb_t * thumb,
+	const double p[3][3],
+	uint32_t color
+);
+
+
+/** A color for group id, with neighboring ids far apart. */
+uint32_t
+thumb_color(
+	int id
+);
+
+
+/** Write the thumbnail as a PNG.
+ * \return 0 on success, -1 with errno set on failure.
+ */
+int
+thumb_write(
+	const thumb_t * thumb,
+	const char * filename
+);
+
+#endif
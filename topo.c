@@ -0,0 +1,269 @@
+/** \file
+ * Compact half-edge topology.
+ *
+ * Each half-edge block is a run of pairs of varints: the vertex as a
+ * zigzag delta from the previous one in the block (the first from 0),
+ * then 0 for no twin or the zigzag delta from h to its twin.
+ * Vertex blocks are zigzag deltas of the outgoing half-edges.
+ */
+#include "topo.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct
+{
+	uint8_t * data;
+	size_t len;
+	size_t max;
+	uint32_t * offset;	// start of each block, and the end
+	int count;		// entries over all the blocks
+} topo_stream_t;
+
+
+struct topo
+{
+	unsigned id;
+	topo_stream_t he;
+	topo_stream_t vertex;
+};
+
+
+/** A decoded block: vertex and twin of each half-edge, or the
+ * outgoing half-edge of each vertex.
+ */
+typedef struct
+{
+	unsigned id;		// of the topology, 0 if the entry is empty
+	int block;
+	int value[2 * TOPO_BLOCK];
+} topo_cache_t;
+
+static __thread topo_cache_t topo_cache[2][TOPO_CACHE];
+
+// every topology gets its own id, so a new one at the address of
+// one that was freed never finds its blocks in the cache.
+static unsigned topo_next_id;
+
+
+static void
+topo_put(
+	topo_stream_t * const s,
+	const int64_t x
+)
+{
+	// zigzag, so that small negative deltas are small too
+	uint64_t z = ((uint64_t) x << 1) ^ (uint64_t) (x >> 63);
+
+	if (s->len + 10 > s->max)
+	{
+		s->max = s->max ? 2 * s->max : 4096;
+		s->data = realloc(s->data, s->max);
+	}
+
+	while (z >= 0x80)
+	{
+		s->data[s->len++] = (z & 0x7F) | 0x80;
+		z >>= 7;
+	}
+	s->data[s->len++] = z;
+}
+
+
+static int64_t
+topo_get(
+	const uint8_t ** const p_ptr
+)
+{
+	const uint8_t * p = *p_ptr;
+	uint64_t z = 0;
+	int shift = 0;
+
+	while (*p & 0x80)
+	{
+		z |= (uint64_t) (*p++ & 0x7F) << shift;
+		shift += 7;
+	}
+	z |= (uint64_t) *p++ << shift;
+
+	*p_ptr = p;
+	return (int64_t) (z >> 1) ^ -(int64_t) (z & 1);
+}
+
+
+static void
+topo_stream_init(
+	topo_stream_t * const s,
+	const int count
+)
+{
+	s->count = count;
+	s->offset = calloc(count / TOPO_BLOCK + 2, sizeof(*s->offset));
+}
+
+
+/** Trim the stream to what was written. */
+static void
+topo_stream_end(
+	topo_stream_t * const s
+)
+{
+	s->offset[(s->count + TOPO_BLOCK - 1) / TOPO_BLOCK] = s->len;
+	s->data = realloc(s->data, s->len + 1);
+	s->max = s->len;
+}
+
+
+topo_t *
+topo_build(
+	const int num_face,
+	const int num_vertex,
+	const int * const he_twin,
+	const int * const he_vertex,
+	const int * const vertex_he
+)
+{
+	topo_t * const topo = calloc(1, sizeof(*topo));
+	topo->id = __atomic_add_fetch(&topo_next_id, 1, __ATOMIC_RELAXED);
+
+	topo_stream_t * const he = &topo->he;
+	topo_stream_init(he, 3 * num_face);
+
+	int prev = 0;
+	for (int h = 0 ; h < 3 * num_face ; h++)
+	{
+		if (h % TOPO_BLOCK == 0)
+		{
+			he->offset[h / TOPO_BLOCK] = he->len;
+			prev = 0;
+		}
+
+		topo_put(he, he_vertex[h] - prev);
+		prev = he_vertex[h];
+
+		// a half-edge is never its own twin, so 0 is free
+		const int twin = he_twin[h];
+		topo_put(he, twin < 0 ? 0 : twin - h);
+	}
+	topo_stream_end(he);
+
+	topo_stream_t * const vs = &topo->vertex;
+	topo_stream_init(vs, num_vertex);
+
+	for (int v = 0 ; v < num_vertex ; v++)
+	{
+		if (v % TOPO_BLOCK == 0)
+		{
+			vs->offset[v / TOPO_BLOCK] = vs->len;
+			prev = 0;
+		}
+
+		topo_put(vs, vertex_he[v] - prev);
+		prev = vertex_he[v];
+	}
+	topo_stream_end(vs);
+
+	return topo;
+}
+
+
+void
+topo_free(
+	topo_t * const topo
+)
+{
+	free(topo->he.data);
+	free(topo->he.offset);
+	free(topo->vertex.data);
+	free(topo->vertex.offset);
+	free(topo);
+}
+
+
+size_t
+topo_size(
+	const topo_t * const topo
+)
+{
+	const topo_stream_t * const s[] = { &topo->he, &topo->vertex };
+	size_t size = sizeof(*topo);
+
+	for (int i = 0 ; i < 2 ; i++)
+		size += s[i]->len
+			+ (s[i]->count / TOPO_BLOCK + 2) * sizeof(*s[i]->offset);
+
+	return size;
+}
+
+
+/** Find the decoded block that holds entry i of a stream, decoding
+ * it into this thread's cache if it is not there.
+ */
+static const int *
+topo_block(
+	const topo_t * const topo,
+	const int which,
+	const int i
+)
+{
+	const int block = i / TOPO_BLOCK;
+	topo_cache_t * const c = &topo_cache[which][block & (TOPO_CACHE - 1)];
+
+	if (c->id == topo->id && c->block == block)
+		return c->value;
+
+	const topo_stream_t * const s = which == 0 ? &topo->he : &topo->vertex;
+	const uint8_t * p = s->data + s->offset[block];
+	const int start = block * TOPO_BLOCK;
+	const int n = s->count - start < TOPO_BLOCK ? s->count - start : TOPO_BLOCK;
+
+	int prev = 0;
+	for (int j = 0 ; j < n ; j++)
+	{
+		prev += topo_get(&p);
+
+		if (which == 0)
+		{
+			// half-edges are stored as vertex, twin pairs
+			const int64_t t = topo_get(&p);
+			c->value[2*j+0] = prev;
+			c->value[2*j+1] = t == 0 ? -1 : start + j + t;
+		} else {
+			c->value[j] = prev;
+		}
+	}
+
+	c->id = topo->id;
+	c->block = block;
+	return c->value;
+}
+
+
+int
+topo_twin(
+	const topo_t * const topo,
+	const int h
+)
+{
+	return topo_block(topo, 0, h)[2 * (h % TOPO_BLOCK) + 1];
+}
+
+
+int
+topo_he_vertex(
+	const topo_t * const topo,
+	const int h
+)
+{
+	return topo_block(topo, 0, h)[2 * (h % TOPO_BLOCK) + 0];
+}
+
+
+int
+topo_vertex_he(
+	const topo_t * const topo,
+	const int v
+)
+{
+	return topo_block(topo, 1, v)[v % TOPO_BLOCK];
+}
@@ -0,0 +1,75 @@
+/** \file
+ * Compact half-edge topology.
+ *
+ * The twin and vertex of every half-edge, and an outgoing half-edge
+ * of every vertex, stored as variable length deltas in blocks of
+ * TOPO_BLOCK entries.  Once the faces are ordered so that neighbors
+ * are close together most deltas fit in a byte, a fraction of the
+ * plain int arrays.  Any entry can be read at random: its block is
+ * decoded whole into a small per-thread cache, so walks that stay in
+ * one part of the mesh decode each block once.
+ */
+#ifndef _papercraft_topo_h_
+#define _papercraft_topo_h_
+
+#include <stddef.h>
+
+// half-edges or vertices in each block
+#define TOPO_BLOCK	192
+
+// decoded blocks kept by each thread, a power of two
+#define TOPO_CACHE	16
+
+typedef struct topo topo_t;
+
+
+/** Encode the half-edge arrays of num_face faces and num_vertex
+ * vertices; they are not kept.
+ */
+topo_t *
+topo_build(
+	int num_face,
+	int num_vertex,
+	const int * he_twin,
+	const int * he_vertex,
+	const int * vertex_he
+);
+
+
+void
+topo_free(
+	topo_t * topo
+);
+
+
+/** Bytes used by the encoded topology. */
+size_t
+topo_size(
+	const topo_t * topo
+);
+
+
+/** The opposite half-edge of h, or -1. */
+int
+topo_twin(
+	const topo_t * topo,
+	int h
+);
+
+
+/** The vertex that half-edge h starts at. */
+int
+topo_he_vertex(
+	const topo_t * topo,
+	int h
+);
+
+
+/** An outgoing half-edge of vertex v. */
+int
+topo_vertex_he(
+	const topo_t * topo,
+	int v
+);
+
+#endif
@@ -0,0 +1,229 @@
+/** \file
+ * Summarize a group building trace written by `unfold` with
+ * PAPERCRAFT_TRACE set.
+ *
+ * Lists the faces that most often blocked another face from being
+ * attached, the parent edges that were most often rejected, and the
+ * groups that had the most rejections while they grew.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include "trace.h"
+
+typedef struct
+{
+	int key;
+	long count;
+} tally_t;
+
+
+/** Counts indexed by a face or edge number, grown as needed. */
+typedef struct
+{
+	long * count;
+	int size;
+} counter_t;
+
+
+static void
+counter_add(
+	counter_t * const c,
+	const int key
+)
+{
+	if (key < 0)
+		return;
+
+	if (key >= c->size)
+	{
+		int size = c->size ? c->size : 1024;
+		while (size <= key)
+			size *= 2;
+		c->count = realloc(c->count, size * sizeof(*c->count));
+		if (!c->count)
+			err(EXIT_FAILURE, "realloc");
+		memset(c->count + c->size, 0, (size - c->size) * sizeof(*c->count));
+		c->size = size;
+	}
+
+	c->count[key]++;
+}
+
+
+static int
+tally_cmp(
+	const void * const a_ptr,
+	const void * const b_ptr
+)
+{
+	const tally_t * const a = a_ptr;
+	const tally_t * const b = b_ptr;
+	if (a->count != b->count)
+		return a->count < b->count ? 1 : -1;
+	return a->key - b->key;
+}
+
+
+/** Print the top n entries of a counter.  Edges are stored as
+ * face * 3 + edge and are printed that way.
+ */
+static void
+counter_print(
+	const char * const title,
+	const counter_t * const c,
+	const int n,
+	const int is_edge
+)
+{
+	tally_t * const t = calloc(c->size + 1, sizeof(*t));
+	if (!t)
+		err(EXIT_FAILURE, "calloc");
+	int num = 0;
+	for (int i = 0 ; i < c->size ; i++)
+		if (c->count[i])
+			t[num++] = (tally_t) { i, c->count[i] };
+
+	qsort(t, num, sizeof(*t), tally_cmp);
+
+	printf("\n%s:\n", title);
+	for (int i = 0 ; i < num && i < n ; i++)
+	{
+		if (is_edge)
+			printf("%8d/%d %8ld\n", t[i].key / 3, t[i].key % 3, t[i].count);
+		else
+			printf("%10d %8ld\n", t[i].key, t[i].count);
+	}
+
+	free(t);
+}
+
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+"usage: trace-summary [-n count] trace.bin...\n"
+"\n"
+"-n N    List the top N faces, edges and groups (default 10)\n"
+	);
+	exit(EXIT_FAILURE);
+}
+
+
+int
+main(
+	int argc,
+	char ** argv
+)
+{
+	int top = 10;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': top = atoi(optarg); break;
+		default: usage();
+		}
+	}
+
+	if (optind == argc)
+		usage();
+
+	long kinds[TRACE_KINDS] = { 0 };
+	long coplanar_rejects = 0;
+	long dropped = 0;
+	long threads = 0;
+	double elapsed = 0;
+
+	counter_t conflict = { 0 };	// face that blocked the attach
+	counter_t rejected = { 0 };	// face that could not be attached
+	counter_t edges = { 0 };	// parent edge that was crossed
+	counter_t groups = { 0 };	// rejections while each root grew
+
+	for (int a = optind ; a < argc ; a++)
+	{
+		const char * const filename = argv[a];
+		FILE * const f = fopen(filename, "r");
+		if (!f)
+			err(EXIT_FAILURE, "%s", filename);
+
+		trace_file_t hdr;
+		if (fread(&hdr, sizeof(hdr), 1, f) != 1
+		||  memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) != 0)
+			errx(EXIT_FAILURE, "%s: not a trace file", filename);
+		if (hdr.event_size != sizeof(trace_event_t))
+			errx(EXIT_FAILURE, "%s: event size %u != %zu",
+				filename, hdr.event_size, sizeof(trace_event_t));
+
+		for (uint32_t i = 0 ; i < hdr.num_threads ; i++)
+		{
+			trace_thread_t th;
+			if (fread(&th, sizeof(th), 1, f) != 1)
+				errx(EXIT_FAILURE, "%s: truncated", filename);
+
+			threads++;
+			dropped += th.dropped;
+
+			// events before the first group in the ring have
+			// lost their root to the wrap around
+			int root = -1;
+
+			for (uint32_t j = 0 ; j < th.count ; j++)
+			{
+				trace_event_t ev;
+				if (fread(&ev, sizeof(ev), 1, f) != 1)
+					errx(EXIT_FAILURE, "%s: truncated", filename);
+				if (ev.kind >= TRACE_KINDS)
+					continue;
+
+				kinds[ev.kind]++;
+				if (ev.time * 1e-9 > elapsed)
+					elapsed = ev.time * 1e-9;
+
+				if (ev.kind == TRACE_GROUP)
+				{
+					root = ev.face;
+					continue;
+				}
+
+				if (ev.kind != TRACE_OVERLAP)
+					continue;
+
+				coplanar_rejects += ev.coplanar;
+				counter_add(&conflict, ev.conflict);
+				counter_add(&rejected, ev.face);
+				counter_add(&edges, ev.parent * 3 + ev.edge);
+				counter_add(&groups, root);
+			}
+		}
+
+		fclose(f);
+	}
+
+	const long attempts = kinds[TRACE_ACCEPT] + kinds[TRACE_OVERLAP];
+
+	printf("threads: %ld, events: %ld, dropped: %ld, elapsed: %.3fs\n",
+		threads,
+		kinds[TRACE_GROUP] + attempts,
+		dropped,
+		elapsed
+	);
+	printf("groups: %ld, accepted: %ld, rejected: %ld (%.1f%%, %ld coplanar)\n",
+		kinds[TRACE_GROUP],
+		kinds[TRACE_ACCEPT],
+		kinds[TRACE_OVERLAP],
+		attempts ? 100.0 * kinds[TRACE_OVERLAP] / attempts : 0,
+		coplanar_rejects
+	);
+
+	counter_print("faces that blocked the most attaches", &conflict, top, 0);
+	counter_print("faces rejected most often", &rejected, top, 0);
+	counter_print("edges (face/edge) rejected most often", &edges, top, 1);
+	counter_print("groups (root face) with the most rejections", &groups, top, 0);
+
+	return 0;
+}
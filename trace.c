@@ -0,0 +1,232 @@
+/** \file
+ * Per-thread ring buffers of group building decisions.
+ */
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#define TRACE_DEFAULT_EVENTS (1 << 16)
+
+// how many events share one reading of the clock
+#define TRACE_CLOCK_EVENTS 64
+
+typedef struct trace_ring trace_ring_t;
+
+struct trace_ring
+{
+	trace_ring_t * next;
+	uint32_t thread;
+	uint64_t head;		// total events ever written
+	uint64_t time;		// when the clock was last read
+	trace_event_t ev[];
+};
+
+int trace_enabled;
+
+static const char * trace_file;
+static uint64_t trace_size;
+static double trace_start_time;
+
+// every thread's ring, pushed on the front as threads start tracing
+static trace_ring_t * trace_rings;
+static uint32_t trace_threads;
+static __thread trace_ring_t * trace_ring;
+
+// SIGUSR1 wakes the watcher thread, which does the dump
+static sem_t trace_dump_sem;
+static pthread_t trace_watcher;
+static int trace_busy;
+
+
+static double
+trace_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static void
+trace_signal(
+	int sig
+)
+{
+	(void) sig;
+	sem_post(&trace_dump_sem);
+}
+
+
+/** Dump whenever the signal arrives, even if the threads that
+ * record events are stuck.
+ */
+static void *
+trace_watch(
+	void * arg
+)
+{
+	(void) arg;
+	while (1)
+	{
+		if (sem_wait(&trace_dump_sem) == 0)
+			trace_dump();
+	}
+
+	return NULL;
+}
+
+
+static void
+trace_exit(void)
+{
+	trace_dump();
+}
+
+
+static void
+__attribute__((constructor))
+trace_init(void)
+{
+	trace_file = getenv("PAPERCRAFT_TRACE");
+	if (!trace_file)
+		return;
+
+	const char * const size_str = getenv("PAPERCRAFT_TRACE_EVENTS");
+	trace_size = size_str ? strtoull(size_str, NULL, 0) : 0;
+	if (trace_size == 0)
+		trace_size = TRACE_DEFAULT_EVENTS;
+
+	trace_start_time = trace_now();
+	atexit(trace_exit);
+
+	if (sem_init(&trace_dump_sem, 0, 0) == 0
+	&& pthread_create(&trace_watcher, NULL, trace_watch, NULL) == 0)
+	{
+		pthread_detach(trace_watcher);
+		signal(SIGUSR1, trace_signal);
+	} else
+		fprintf(stderr, "trace: no SIGUSR1 dumps\n");
+
+	trace_enabled = 1;
+}
+
+
+/** Allocate this thread's ring and add it to the list. */
+static trace_ring_t *
+trace_ring_alloc(void)
+{
+	trace_ring_t * const ring = calloc(1,
+		sizeof(*ring) + trace_size * sizeof(ring->ev[0]));
+	if (!ring)
+	{
+		perror("trace");
+		return NULL;
+	}
+
+	ring->thread = __atomic_fetch_add(&trace_threads, 1, __ATOMIC_RELAXED);
+
+	ring->next = __atomic_load_n(&trace_rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&trace_rings, &ring->next, ring,
+		0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+
+	return ring;
+}
+
+
+void
+trace_record(
+	const trace_kind_t kind,
+	const int face,
+	const int parent,
+	const int edge,
+	const int coplanar,
+	const int conflict
+)
+{
+	trace_ring_t * ring = trace_ring;
+	if (!ring)
+		ring = trace_ring = trace_ring_alloc();
+	if (!ring)
+		return;
+
+	const uint64_t head = ring->head;
+	if (head % TRACE_CLOCK_EVENTS == 0)
+		ring->time = (trace_now() - trace_start_time) * 1e9;
+
+	ring->ev[head % trace_size] = (trace_event_t) {
+		.time		= ring->time,
+		.face		= face,
+		.parent		= parent,
+		.conflict	= conflict,
+		.kind		= kind,
+		.edge		= edge,
+		.coplanar	= coplanar,
+	};
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+
+/** Write the rings.  Other threads keep writing to their own rings
+ * while this runs, so the newest few events of a busy thread may be
+ * torn; the rest of the trace is still usable.
+ */
+static void
+trace_write(
+	FILE * const f
+)
+{
+	trace_ring_t * const rings = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE);
+	trace_file_t hdr = {
+		.magic		= TRACE_MAGIC,
+		.event_size	= sizeof(trace_event_t),
+	};
+	for (const trace_ring_t * ring = rings ; ring ; ring = ring->next)
+		hdr.num_threads++;
+	fwrite(&hdr, sizeof(hdr), 1, f);
+
+	for (const trace_ring_t * ring = rings ; ring ; ring = ring->next)
+	{
+		const uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		const uint64_t count = head < trace_size ? head : trace_size;
+		const trace_thread_t th = {
+			.thread		= ring->thread,
+			.count		= count,
+			.dropped	= head - count,
+		};
+		fwrite(&th, sizeof(th), 1, f);
+
+		// oldest first, which may wrap around the end of the ring
+		const uint64_t first = (head - count) % trace_size;
+		const uint64_t n1 = count < trace_size - first ? count : trace_size - first;
+		fwrite(&ring->ev[first], sizeof(ring->ev[0]), n1, f);
+		fwrite(&ring->ev[0], sizeof(ring->ev[0]), count - n1, f);
+	}
+}
+
+
+void
+trace_dump(void)
+{
+	if (!trace_enabled)
+		return;
+	if (__atomic_exchange_n(&trace_busy, 1, __ATOMIC_ACQUIRE))
+		return;
+
+	FILE * const f = fopen(trace_file, "w");
+	if (!f)
+		perror(trace_file);
+	else
+	{
+		trace_write(f);
+		if (fclose(f) != 0)
+			perror(trace_file);
+	}
+
+	__atomic_store_n(&trace_busy, 0, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,99 @@
+/** \file
+ * Binary trace of the decisions made while growing groups.
+ *
+ * If PAPERCRAFT_TRACE is set to a file name, every face that starts
+ * a group, is attached to one, or is rejected because it would
+ * overlap is recorded with the time, its parent and edge, and the
+ * face it collided with.  Events go into a fixed size ring buffer
+ * per thread without any locking; when a ring is full the oldest
+ * events are dropped.  The rings are written to the file when the
+ * program exits and whenever it receives SIGUSR1; a thread of its own
+ * waits for the signal, so a stalled run can still be dumped.
+ *
+ * PAPERCRAFT_TRACE_EVENTS sets the size of each ring (default 65536).
+ * When tracing is off each event costs a single branch.
+ *
+ * The file is a trace_file_t, then for each thread a trace_thread_t
+ * followed by its events from oldest to newest.  `trace-summary`
+ * reads it and lists the faces and edges with the most conflicts.
+ */
+#ifndef _papercraft_trace_h_
+#define _papercraft_trace_h_
+
+#include <stdint.h>
+
+#define TRACE_MAGIC "PCTRACE1"
+
+typedef enum
+{
+	TRACE_GROUP,		// face is the root of a new group
+	TRACE_ACCEPT,		// face attached to parent across edge
+	TRACE_OVERLAP,		// face rejected, it overlapped conflict
+	TRACE_KINDS
+} trace_kind_t;
+
+
+typedef struct
+{
+	uint64_t time;		// nanoseconds since the trace started,
+				// read every 64 events of a thread
+	int32_t face;
+	int32_t parent;		// -1 for the root of a group
+	int32_t conflict;	// -1 unless the face was rejected
+	uint8_t kind;
+	uint8_t edge;		// edge of the parent that was crossed
+	uint8_t coplanar;	// the faces are coplanar
+	uint8_t pad;
+} trace_event_t;
+
+
+typedef struct
+{
+	char magic[8];
+	uint32_t event_size;
+	uint32_t num_threads;
+} trace_file_t;
+
+
+typedef struct
+{
+	uint32_t thread;
+	uint32_t count;
+	uint64_t dropped;
+} trace_thread_t;
+
+
+extern int trace_enabled;
+
+void
+trace_record(
+	trace_kind_t kind,
+	int face,
+	int parent,
+	int edge,
+	int coplanar,
+	int conflict
+);
+
+
+/** Record an event if tracing is enabled. */
+static inline void
+trace_event(
+	const trace_kind_t kind,
+	const int face,
+	const int parent,
+	const int edge,
+	const int coplanar,
+	const int conflict
+)
+{
+	if (__builtin_expect(trace_enabled, 0))
+		trace_record(kind, face, parent, edge, coplanar, conflict);
+}
+
+
+/** Write every thread's ring to the trace file now. */
+void
+trace_dump(void);
+
+#endif
@@ -0,0 +1,517 @@
+/** \file
+ * Tune the unfold heuristics over a corpus of meshes.
+ *
+ * Every mesh is unfolded once with the built-in parameters, which
+ * gives its class and the baseline that the other runs are scored
+ * against.  Then for each class a set of random parameter vectors,
+ * plus the built-in one, is narrowed down by successive halving:
+ * every vector still in the running is unfolded on each mesh of the
+ * class from a few start faces, the best third go on to be run from
+ * three times as many, until one is left.  A run scores the number
+ * of pieces, the cut length and the CPU time, each relative to the
+ * baseline of its mesh and weighted, so lower is better.
+ *
+ * The runs are separate unfold processes, as many at once as there
+ * are threads, and the best vector of each class is written as a
+ * parameter file for `unfold -p`.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <err.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "params.h"
+#include "cost.h"
+
+// each rung keeps the best 1/TUNE_ETA and runs them TUNE_ETA times as often
+#define TUNE_ETA	3
+
+// the start face of each trial, so they are spread around the mesh
+#define TUNE_STRIDE	7919
+
+
+typedef struct
+{
+	const char * path;
+	char cls[64];
+
+	// the baseline, from the built-in parameters
+	double pieces;
+	double cut;
+	double time;
+} tune_mesh_t;
+
+
+typedef struct
+{
+	params_t params;
+	char file[256];
+	double sum;
+	int runs;
+	double score;
+} tune_cand_t;
+
+
+typedef struct
+{
+	int cand;
+	int mesh;
+	int trial;
+	pid_t pid;
+	char err_file[256];
+	char json_file[256];
+
+	int failed;
+	double pieces;
+	double cut;
+	double time;
+} tune_run_t;
+
+
+typedef struct
+{
+	const char * unfold;
+	const char * dir;
+	int jobs;
+	double weight[3];	// pieces, cut, time
+
+	tune_mesh_t * mesh;
+	int num_meshes;
+} tune_t;
+
+
+/** Start unfold on the run's mesh with a parameter file. */
+static void
+tune_start(
+	const tune_t * const tune,
+	tune_run_t * const run,
+	const char * const params_file
+)
+{
+	const pid_t pid = fork();
+	if (pid < 0)
+		err(EXIT_FAILURE, "fork");
+	if (pid > 0)
+	{
+		run->pid = pid;
+		return;
+	}
+
+	const char * const mesh = tune->mesh[run->mesh].path;
+	const int in = open(mesh, O_RDONLY);
+	const int out = open("/dev/null", O_WRONLY);
+	const int log = open(run->err_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (in < 0 || out < 0 || log < 0)
+	{
+		perror(mesh);
+		_exit(127);
+	}
+
+	dup2(in, 0);
+	dup2(out, 1);
+	dup2(log, 2);
+
+	char poly[32];
+	snprintf(poly, sizeof(poly), "%d", run->trial * TUNE_STRIDE);
+	setenv("POLY", poly, 1);
+
+	execl(tune->unfold, tune->unfold,
+		"-p", params_file,
+		"-e", run->json_file,
+		NULL);
+	perror(tune->unfold);
+	_exit(127);
+}
+
+
+/** Read the pieces and the class from the run's stderr and the
+ * cut length from its estimate.
+ */
+static void
+tune_finish(
+	tune_run_t * const run,
+	char * const cls
+)
+{
+	FILE * const log = fopen(run->err_file, "r");
+	if (!log)
+		err(EXIT_FAILURE, "%s", run->err_file);
+
+	char line[256];
+	while (fgets(line, sizeof(line), log))
+	{
+		if (strncmp(line, "group ", 6) == 0)
+			run->pieces++;
+		else
+		if (cls)
+			sscanf(line, "class: %63s", cls);
+	}
+	fclose(log);
+
+	FILE * const json = fopen(run->json_file, "r");
+	if (!json)
+	{
+		run->failed = 1;
+		return;
+	}
+
+	if (cost_json_length(json, COST_CUT, &run->cut) < 0)
+		run->failed = 1;
+	fclose(json);
+}
+
+
+/** Run every unfold, tune->jobs at a time. */
+static void
+tune_execute(
+	tune_t * const tune,
+	tune_run_t * const runs,
+	const int num_runs,
+	const tune_cand_t * const cands,
+	const char * const default_file
+)
+{
+	int next = 0;
+	int active = 0;
+
+	while (next < num_runs || active)
+	{
+		if (next < num_runs && active < tune->jobs)
+		{
+			tune_run_t * const run = &runs[next];
+			snprintf(run->err_file, sizeof(run->err_file),
+				"%s/run%d.err", tune->dir, next);
+			snprintf(run->json_file, sizeof(run->json_file),
+				"%s/run%d.json", tune->dir, next);
+
+			// a failed run must not find the estimate of an older one
+			unlink(run->json_file);
+			tune_start(tune, run,
+				run->cand < 0 ? default_file : cands[run->cand].file);
+			next++;
+			active++;
+			continue;
+		}
+
+		int status;
+		struct rusage ru;
+		const pid_t pid = wait4(-1, &status, 0, &ru);
+		if (pid < 0)
+			err(EXIT_FAILURE, "wait");
+		active--;
+
+		for (int i = 0 ; i < next ; i++)
+		{
+			tune_run_t * const run = &runs[i];
+			if (run->pid != pid)
+				continue;
+
+			run->pid = 0;
+			run->time = ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+				+ (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+
+			// runs with the built-in parameters also find the class
+			tune_finish(run, run->cand < 0 ? tune->mesh[run->mesh].cls : NULL);
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				run->failed = 1;
+
+			unlink(run->err_file);
+			unlink(run->json_file);
+			break;
+		}
+	}
+}
+
+
+/** Score a run relative to the baseline of its mesh. */
+static double
+tune_score(
+	const tune_t * const tune,
+	const tune_run_t * const run
+)
+{
+	if (run->failed)
+		return INFINITY;
+
+	const tune_mesh_t * const mesh = &tune->mesh[run->mesh];
+	const double * const w = tune->weight;
+
+	// very short runs are below the resolution of the clock
+	const double time = fmax(mesh->time, 1e-3);
+
+	return (w[0] * run->pieces / fmax(mesh->pieces, 1)
+		+ w[1] * run->cut / fmax(mesh->cut, 1e-9)
+		+ w[2] * fmax(run->time, 1e-3) / time)
+		/ (w[0] + w[1] + w[2]);
+}
+
+
+/** A random parameter vector; strips and seeds are never combined. */
+static void
+tune_random(
+	params_t * const params
+)
+{
+	static const int seeds[] = { 0, 0, 2, 4, 8 };
+
+	params_default(params);
+	params->folds_first = drand48() < 0.5;
+	params->coplanar_now = drand48() < 0.5;
+	params->start = lrand48() % PARAMS_STARTS;
+	params->strips = drand48() < 0.3;
+	params->seeds = params->strips ? 0 : seeds[lrand48() % 5];
+	params->strip_fold = 20 + 50 * drand48();
+	params->strip_flat = pow(10, -4 + 2 * drand48());
+}
+
+
+static int
+tune_cand_cmp(
+	const void * const a_ptr,
+	const void * const b_ptr
+)
+{
+	const tune_cand_t * const a = *(const tune_cand_t * const *) a_ptr;
+	const tune_cand_t * const b = *(const tune_cand_t * const *) b_ptr;
+
+	if (a->score != b->score)
+		return a->score < b->score ? -1 : 1;
+	return a < b ? -1 : a > b;
+}
+
+
+/** Successive halving over the meshes of one class.
+ * \return the best candidate.
+ */
+static const tune_cand_t *
+tune_class(
+	tune_t * const tune,
+	const char * const cls,
+	tune_cand_t * const cands,
+	const int num_cands,
+	const int max_trials
+)
+{
+	int * const mesh = calloc(tune->num_meshes, sizeof(*mesh));
+	int num_meshes = 0;
+	for (int m = 0 ; m < tune->num_meshes ; m++)
+		if (strcmp(tune->mesh[m].cls, cls) == 0)
+			mesh[num_meshes++] = m;
+
+	tune_cand_t ** const alive = calloc(num_cands, sizeof(*alive));
+	int num_alive = num_cands;
+	for (int c = 0 ; c < num_cands ; c++)
+	{
+		alive[c] = &cands[c];
+		cands[c].sum = 0;
+		cands[c].runs = 0;
+	}
+
+	tune_run_t * const runs = calloc(num_cands * num_meshes * max_trials,
+		sizeof(*runs));
+	int done = 0;
+
+	for (int trials = 1 ; ; trials *= TUNE_ETA)
+	{
+		if (trials > max_trials)
+			trials = max_trials;
+
+		// only the trials that the survivors have not run yet
+		int num_runs = 0;
+		for (int c = 0 ; c < num_alive ; c++)
+			for (int m = 0 ; m < num_meshes ; m++)
+				for (int t = done ; t < trials ; t++)
+					runs[num_runs++] = (tune_run_t) {
+						.cand	= alive[c] - cands,
+						.mesh	= mesh[m],
+						.trial	= t,
+					};
+
+		tune_execute(tune, runs, num_runs, cands, NULL);
+
+		for (int i = 0 ; i < num_runs ; i++)
+		{
+			tune_cand_t * const cand = &cands[runs[i].cand];
+			cand->sum += tune_score(tune, &runs[i]);
+			cand->runs++;
+		}
+
+		for (int c = 0 ; c < num_alive ; c++)
+			alive[c]->score = alive[c]->sum / alive[c]->runs;
+		qsort(alive, num_alive, sizeof(*alive), tune_cand_cmp);
+
+		fprintf(stderr, "%s: %d candidates, %d trials, best %.4f\n",
+			cls, num_alive, trials, alive[0]->score);
+
+		done = trials;
+		num_alive = (num_alive + TUNE_ETA - 1) / TUNE_ETA;
+		if (num_alive == 1)
+			break;
+	}
+
+	const tune_cand_t * const best = alive[0];
+	free(runs);
+	free(alive);
+	free(mesh);
+	return best;
+}
+
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+"usage: tune [-j jobs] [-n candidates] [-t trials] [-r seed] [-w pieces,cut,time] [-u unfold] [-o params] mesh.stl...\n"
+"\n"
+"-j N          Run N unfolds at once\n"
+"-n N          Start each class with N parameter vectors (27)\n"
+"-t N          Run the finalists from up to N start faces (9)\n"
+"-r N          Seed for the random parameter vectors (1)\n"
+"-w a,b,c      Weights of the pieces, cut length and CPU time (1,1,0.1)\n"
+"-u path       The unfold to run (./unfold)\n"
+"-o file       Write the best parameters of each class here (stdout)\n"
+	);
+	exit(EXIT_FAILURE);
+}
+
+
+int
+main(
+	int argc,
+	char ** argv
+)
+{
+	tune_t tune = {
+		.unfold	= "./unfold",
+		.jobs	= sysconf(_SC_NPROCESSORS_ONLN),
+		.weight	= { 1, 1, 0.1 },
+	};
+	int num_cands = 27;
+	int max_trials = 9;
+	long seed = 1;
+	const char * out_file = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "j:n:t:r:w:u:o:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'j': tune.jobs = atoi(optarg); break;
+		case 'n': num_cands = atoi(optarg); break;
+		case 't': max_trials = atoi(optarg); break;
+		case 'r': seed = atol(optarg); break;
+		case 'w':
+			if (sscanf(optarg, "%lf,%lf,%lf",
+				&tune.weight[0],
+				&tune.weight[1],
+				&tune.weight[2]) != 3)
+				usage();
+			break;
+		case 'u': tune.unfold = optarg; break;
+		case 'o': out_file = optarg; break;
+		default: usage();
+		}
+	}
+
+	if (optind == argc || tune.jobs < 1 || num_cands < 1 || max_trials < 1)
+		usage();
+
+	tune.num_meshes = argc - optind;
+	tune.mesh = calloc(tune.num_meshes, sizeof(*tune.mesh));
+	for (int m = 0 ; m < tune.num_meshes ; m++)
+		tune.mesh[m].path = argv[optind + m];
+
+	char dir[] = "/tmp/tune.XXXXXX";
+	if (!mkdtemp(dir))
+		err(EXIT_FAILURE, "mkdtemp");
+	tune.dir = dir;
+
+	// the baseline of every mesh, which also gives its class
+	params_t defaults;
+	params_default(&defaults);
+	char default_file[256];
+	snprintf(default_file, sizeof(default_file), "%s/default.params", dir);
+	FILE * const f = fopen(default_file, "w");
+	if (!f)
+		err(EXIT_FAILURE, "%s", default_file);
+	params_write(f, &defaults);
+	fclose(f);
+
+	tune_run_t * const base = calloc(tune.num_meshes, sizeof(*base));
+	for (int m = 0 ; m < tune.num_meshes ; m++)
+		base[m] = (tune_run_t) { .cand = -1, .mesh = m };
+	tune_execute(&tune, base, tune.num_meshes, NULL, default_file);
+
+	for (int m = 0 ; m < tune.num_meshes ; m++)
+	{
+		tune_mesh_t * const mesh = &tune.mesh[m];
+		if (base[m].failed)
+			errx(EXIT_FAILURE, "%s: unfold failed", mesh->path);
+		mesh->pieces = base[m].pieces;
+		mesh->cut = base[m].cut;
+		mesh->time = base[m].time;
+		fprintf(stderr, "%s: %s, %.0f pieces, cut %.1f mm, %.3f s\n",
+			mesh->path, mesh->cls, mesh->pieces, mesh->cut, mesh->time);
+	}
+
+	// the candidates are shared by every class, the first is
+	// the built-in parameters so tuning never does worse.
+	srand48(seed);
+	tune_cand_t * const cands = calloc(num_cands, sizeof(*cands));
+	for (int c = 0 ; c < num_cands ; c++)
+	{
+		tune_cand_t * const cand = &cands[c];
+		if (c == 0)
+			cand->params = defaults;
+		else
+			tune_random(&cand->params);
+
+		snprintf(cand->file, sizeof(cand->file), "%s/cand%d.params", dir, c);
+		FILE * const cf = fopen(cand->file, "w");
+		if (!cf)
+			err(EXIT_FAILURE, "%s", cand->file);
+		params_write(cf, &cand->params);
+		fclose(cf);
+	}
+
+	FILE * const out = out_file ? fopen(out_file, "w") : stdout;
+	if (!out)
+		err(EXIT_FAILURE, "%s", out_file);
+	fprintf(out, "# tune over %d meshes, %d candidates, seed %ld\n",
+		tune.num_meshes, num_cands, seed);
+
+	for (int m = 0 ; m < tune.num_meshes ; m++)
+	{
+		const char * const cls = tune.mesh[m].cls;
+
+		// each class once, at its first mesh
+		int seen = 0;
+		for (int m2 = 0 ; m2 < m ; m2++)
+			seen |= strcmp(tune.mesh[m2].cls, cls) == 0;
+		if (seen)
+			continue;
+
+		const tune_cand_t * const best = tune_class(&tune, cls,
+			cands, num_cands, max_trials);
+
+		fprintf(out, "\nclass %s\n# score %.4f\n", cls, best->score);
+		params_write(out, &best->params);
+	}
+
+	if (out != stdout)
+		fclose(out);
+
+	for (int c = 0 ; c < num_cands ; c++)
+		unlink(cands[c].file);
+	unlink(default_file);
+	if (rmdir(dir) < 0)
+		warn("%s", dir);
+
+	return 0;
+}
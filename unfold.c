@@ -5,12 +5,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <stdarg.h>
 #include <unistd.h>
 #include <math.h>
 #include <err.h>
 #include <assert.h>
 #include "v3.h"
+#include "pool.h"
+#include "simd.h"
+#include "v3_batch.h"
+#include "sweep.h"
+#include "progress.h"
+#include "cost.h"
+#include "trace.h"
+#include "font.h"
+#include "pieces.h"
+#include "params.h"
+#include "thumb.h"
 
 #ifndef M_PI
 #define 	M_PI   3.1415926535897932384
@@ -19,6 +31,9 @@
 static int debug = 0;
 static int draw_labels = 0;
 
+// the heuristics, from the built-in defaults or unfold -p
+static params_t params;
+
 typedef struct
 {
 	char header[80];
@@ -29,11 +44,36 @@ stl_header_t;
 
 typedef struct
 {
-	v3_t normal;
-	v3_t p[3];
+	v3f_t normal;
+	v3f_t p[3];
 	uint16_t attr;
 } __attribute__((__packed__))
-stl_face_t;
+stl_file_face_t;
+
+
+/** In-memory triangle, in the working precision. */
+typedef struct
+{
+	v3_t normal;
+	v3_t p[3];
+} stl_face_t;
+
+
+static stl_face_t *
+stl_faces_load(
+	const stl_file_face_t * const ft,
+	const int num_triangles
+)
+{
+	stl_face_t * const f = calloc(num_triangles, sizeof(*f));
+	for (int i = 0 ; i < num_triangles ; i++)
+	{
+		f[i].normal = v3f_load(ft[i].normal);
+		for (int j = 0 ; j < 3 ; j++)
+			f[i].p[j] = v3f_load(ft[i].p[j]);
+	}
+	return f;
+}
 
 
 typedef struct face face_t;
@@ -41,7 +81,8 @@ typedef struct poly poly_t;
 
 struct face
 {
-	float sides[3];
+	int id;
+	real_t sides[3];
 	face_t * next[3];
 	int next_edge[3];
 	int coplanar[3];
@@ -56,95 +97,96 @@ struct poly
 	int printed;
 
 	// local coordinates of the triangle vertices
-	float a;
-	float x2;
-	float y2;
-	float rot;
+	real_t a;
+	real_t x2;
+	real_t y2;
+	real_t rot;
 
 	// absolute coordintes of the triangle vertices
-	float p[3][2];
+	real_t p[3][2];
 
 	// todo: make this const and add backtracking
 	face_t * face;
 	poly_t * next[3];
 
+	// index of the group outline edge along each edge, or -1
+	int outline[3];
+
 	poly_t * work_next;
 };
 
 
-/* Compare two edges in two triangles.
- *
- * note that if the windings are all the same, the edges will
- * compare in the opposite order (for example, the edge from 0 to 1
- * compares to the edge from 2 to 1 in the other triangle).
- */
-static int
-edge_eq2(
-	const stl_face_t * const t0,
-	const stl_face_t * const t1,
-	int e0,
-	int e1
-)
-{
-	const v3_t * const v00 = &t0->p[e0];
-	const v3_t * const v01 = &t0->p[(e0+1) % 3];
+// the cost estimate for the sheet being drawn, if one was requested
+static cost_sheet_t * cost_sheet;
 
-	const v3_t * const v10 = &t1->p[e1];
-	const v3_t * const v11 = &t1->p[(e1+1) % 3];
 
-	if (v3_eq(v00, v11) && v3_eq(v01, v10))
-		return 1;
+static void
+svg_segment(
+	FILE * const out,
+	const cost_class_t cls,
+	const char * color,
+	const real_t * p1,
+	const real_t * p2
+)
+{
+	fprintf(out, "<line x1=\"%f\" y1=\"%f\" x2=\"%f\" y2=\"%f\" stroke=\"%s\" stroke-width=\"0.1px\"/>\n",
+		p1[0],
+		p1[1],
+		p2[0],
+		p2[1],
+		color
+	);
 
-	return 0;
+	if (cost_sheet)
+		cost_line(cost_sheet, cls, p1[0], p1[1], p2[0], p2[1]);
 }
 
 
+/** Cuts are drawn in red, valley folds in solid green and
+ * mountain folds in dashed green.
+ */
 void
 svg_line(
-	const char * color,
-	const float * p1,
-	const float * p2,
-	int dash
+	FILE * const out,
+	const cost_class_t cls,
+	const real_t * p1,
+	const real_t * p2
 )
 {
-	if (!dash)
+	const char * const color = cls == COST_CUT ? "#FF0000" : "#00FF00";
+
+	if (cls != COST_MOUNTAIN)
 	{
-		printf("<line x1=\"%f\" y1=\"%f\" x2=\"%f\" y2=\"%f\" stroke=\"%s\" stroke-width=\"0.1px\"/>\n",
-			p1[0],
-			p1[1],
-			p2[0],
-			p2[1],
-			color
-		);
+		svg_segment(out, cls, color, p1, p2);
 		return;
 	}
 
 	// dashed line, split in the middle
-	const float dx = p2[0] - p1[0];
-	const float dy = p2[1] - p1[1];
+	const real_t dx = p2[0] - p1[0];
+	const real_t dy = p2[1] - p1[1];
 
-	const float h1[] = {
+	const real_t h1[] = {
 		p1[0] + dx*0.45,
 		p1[1] + dy*0.45,
 	};
-	const float h2[] = {
+	const real_t h2[] = {
 		p1[0] + dx*0.55,
 		p1[1] + dy*0.55,
 	};
 
 
-	svg_line(color, p1, h1, 0);
-	svg_line(color, h2, p2, 0);
+	svg_segment(out, cls, color, p1, h1);
+	svg_segment(out, cls, color, h2, p2);
 }
 
 
 void
 rotate(
-	float * p,
-	const float * origin,
-	float a,
-	float x,
-	float y
+	real_t * p,
+	const real_t * origin,
+	real_t a,
+	real_t x,
+	real_t y
 )
 {
 	p[0] = cos(a) * x - sin(a) * y + origin[0];
@@ -157,23 +199,23 @@ void
 poly_position(
 	poly_t * const g,
 	const poly_t * const g_src,
-	float rot,
-	float trans_x,
-	float trans_y
+	real_t rot,
+	real_t trans_x,
+	real_t trans_y
 )
 {
 	const face_t * const f = g->face;
 	const int start_edge = g->start_edge;
 
-	float a = f->sides[(start_edge + 0) % 3];
-	float c = f->sides[(start_edge + 1) % 3];
-	float b = f->sides[(start_edge + 2) % 3];
-	float x2 = (a*a + b*b - c*c) / (2*a);
-	float y2 = sqrt(b*b - x2*x2);
+	real_t a = f->sides[(start_edge + 0) % 3];
+	real_t c = f->sides[(start_edge + 1) % 3];
+	real_t b = f->sides[(start_edge + 2) % 3];
+	real_t x2 = (a*a + b*b - c*c) / (2*a);
+	real_t y2 = sqrt(b*b - x2*x2);
 
 	// translate by trans_x/trans_y in the original ref frame
 	// to get the origin point
-	float origin[2];
+	real_t origin[2];
 	rotate(origin, g_src->p[0], g_src->rot, trans_x, trans_y);
 
 	g->rot = g_src->rot + rot;
@@ -209,17 +251,241 @@ enqueue(
 }
 
 
-static poly_t * poly_root;
-static float poly_min[2], poly_max[2];
+/** One edge of a group's outline, which is a closed loop of the
+ * edges that have no neighbor in the group.  The edge runs from
+ * g->p[i] to g->p[(i+1) % 3] and the loop is counter-clockwise.
+ */
+typedef struct
+{
+	poly_t * g;
+	int i;
+	int next;
+	int prev;
+} outline_edge_t;
+
+
+/** The state of the group that is being built. */
+typedef struct
+{
+	poly_t * root;
+	int count;
+	real_t min[2];
+	real_t max[2];
+
+	// SoA copy of the triangles placed in the group,
+	// for the SIMD overlap kernel.
+	real_t * placed[3][2];
+	int * placed_face;
+
+	// the outline is updated as each triangle is attached,
+	// so it and the area and perimeter are always current.
+	outline_edge_t * outline;
+	int outline_head;
+	int outline_len;
+	int outline_used;
+	real_t area;
+	real_t perimeter;
+} group_t;
+
+
+static group_t *
+group_alloc(
+	const int num_triangles
+)
+{
+	group_t * const group = calloc(1, sizeof(*group));
+	for (int k = 0 ; k < 3 ; k++)
+		for (int c = 0 ; c < 2 ; c++)
+			group->placed[k][c] = calloc(num_triangles, sizeof(real_t));
+	group->placed_face = calloc(num_triangles, sizeof(*group->placed_face));
+
+	// the root has three edges and every triangle that is
+	// attached replaces one edge with two.
+	group->outline = calloc(2 * num_triangles + 1, sizeof(*group->outline));
+
+	return group;
+}
+
+
+/** Length of edge i of a positioned triangle. */
+static real_t
+poly_side(
+	const poly_t * const g,
+	const int i
+)
+{
+	return g->face->sides[(g->start_edge + i) % 3];
+}
+
+
+static int
+outline_add(
+	group_t * const group,
+	poly_t * const g,
+	const int i
+)
+{
+	const int e = group->outline_used++;
+	group->outline[e] = (outline_edge_t) {
+		.g	= g,
+		.i	= i,
+		.next	= -1,
+		.prev	= -1,
+	};
+	group->perimeter += poly_side(g, i);
+	group->outline_len++;
+	return e;
+}
+
+
+static void
+placed_add(
+	group_t * const group,
+	const poly_t * const g
+)
+{
+	const int n = group->count++;
+	for (int k = 0 ; k < 3 ; k++)
+		for (int c = 0 ; c < 2 ; c++)
+			group->placed[k][c][n] = g->p[k][c];
+	group->placed_face[n] = g->face->id;
+
+	// local coordinates are p0=(0,0) p1=(a,0) p2=(x2,y2)
+	group->area += g->a * g->y2 / 2;
+}
+
+
+/** Start a new group with g as its root. */
+static void
+group_start(
+	group_t * const group,
+	poly_t * const g
+)
+{
+	group->root = g;
+	group->count = 0;
+	group->min[0] = group->min[1] = 0;
+	group->max[0] = group->max[1] = 0;
+	group->outline_used = 0;
+	group->outline_len = 0;
+	group->area = 0;
+	group->perimeter = 0;
+
+	placed_add(group, g);
+
+	for (int i = 0 ; i < 3 ; i++)
+	{
+		const int e = outline_add(group, g, i);
+		g->outline[i] = e;
+		group->outline[e].next = (e + 1) % 3;
+		group->outline[e].prev = (e + 2) % 3;
+	}
+
+	group->outline_head = g->outline[0];
+}
+
+
+/** Attach g2 across edge i of g.
+ *
+ * g2's edge 0 is the shared one, so the outline edge along g's
+ * edge i is replaced by g2's edges 1 and 2, which run in the
+ * same direction around the loop.
+ */
+static void
+group_attach(
+	group_t * const group,
+	poly_t * const g,
+	const int i,
+	poly_t * const g2
+)
+{
+	placed_add(group, g2);
+
+	const int old = g->outline[i];
+	outline_edge_t * const o = &group->outline[old];
+	const int e1 = outline_add(group, g2, 1);
+	const int e2 = outline_add(group, g2, 2);
+
+	group->outline[e1].prev = o->prev;
+	group->outline[e1].next = e2;
+	group->outline[e2].prev = e1;
+	group->outline[e2].next = o->next;
+	group->outline[o->prev].next = e1;
+	group->outline[o->next].prev = e2;
+
+	if (group->outline_head == old)
+		group->outline_head = e1;
+
+	group->perimeter -= poly_side(g, i);
+	group->outline_len--;
+
+	g->outline[i] = -1;
+	g2->outline[0] = -1;
+	g2->outline[1] = e1;
+	g2->outline[2] = e2;
+}
+
+
+/** Write the group's outline and drawing to the piece file. */
+static void
+group_piece(
+	FILE * const out,
+	const group_t * const group,
+	const int id,
+	const char * const svg,
+	const size_t svg_len
+)
+{
+	double * const p = calloc(2 * group->outline_len, sizeof(*p));
+	int e = group->outline_head;
+	for (int n = 0 ; n < group->outline_len ; n++)
+	{
+		const outline_edge_t * const o = &group->outline[e];
+		p[2*n+0] = o->g->p[o->i][0];
+		p[2*n+1] = o->g->p[o->i][1];
+		e = o->next;
+	}
+
+	pieces_write(out, id, p, group->outline_len, svg, svg_len);
+	free(p);
+}
+
+
+/** Walk the outline to check that it is a closed loop. */
+static void
+outline_verify(
+	const group_t * const group
+)
+{
+	int e = group->outline_head;
+	for (int n = 0 ; n < group->outline_len ; n++)
+	{
+		const outline_edge_t * const o = &group->outline[e];
+		const outline_edge_t * const next = &group->outline[o->next];
+		const real_t * const end = o->g->p[(o->i + 1) % 3];
+		const real_t * const start = next->g->p[next->i];
+
+		if (next->prev != e
+		||  fabs(end[0] - start[0]) > 0.01
+		||  fabs(end[1] - start[1]) > 0.01)
+			errx(EXIT_FAILURE, "outline edge %d is not connected", e);
+
+		e = o->next;
+	}
+
+	if (e != group->outline_head)
+		errx(EXIT_FAILURE, "outline is not closed");
+}
+
 
 static inline int
 v2_eq(
-	const float p0[],
-	const float p1[]
+	const real_t p0[],
+	const real_t p1[]
 )
 {
-	const float dx = p0[0] - p1[0];
-	const float dy = p0[1] - p1[1];
+	const real_t dx = p0[0] - p1[0];
+	const real_t dy = p0[1] - p1[1];
 
 	// are the points within epsilon of each other?
 	if (-EPS < dx && dx < EPS
@@ -236,27 +502,27 @@ v2_eq(
 // intersect the intersection point may be stored in the floats i_x and i_y.
 int
 get_line_intersection(
-	float p0_x,
-	float p0_y,
-	float p1_x,
-	float p1_y, 
-	float p2_x,
-	float p2_y,
-	float p3_x,
-	float p3_y,
-	float *i_x,
-	float *i_y
-)
-{
-	float s1_x = p1_x - p0_x;
-	float s1_y = p1_y - p0_y;
-	float s2_x = p3_x - p2_x;
-	float s2_y = p3_y - p2_y;
-
-	float s = (-s1_y * (p0_x - p2_x) + s1_x * (p0_y - p2_y))
+	real_t p0_x,
+	real_t p0_y,
+	real_t p1_x,
+	real_t p1_y, 
+	real_t p2_x,
+	real_t p2_y,
+	real_t p3_x,
+	real_t p3_y,
+	real_t *i_x,
+	real_t *i_y
+)
+{
+	real_t s1_x = p1_x - p0_x;
+	real_t s1_y = p1_y - p0_y;
+	real_t s2_x = p3_x - p2_x;
+	real_t s2_y = p3_y - p2_y;
+
+	real_t s = (-s1_y * (p0_x - p2_x) + s1_x * (p0_y - p2_y))
 		/ (-s2_x * s1_y + s1_x * s2_y);
 
-	float t = ( s2_x * (p0_y - p2_y) - s2_y * (p0_x - p2_x))
+	real_t t = ( s2_x * (p0_y - p2_y) - s2_y * (p0_x - p2_x))
 		/ (-s2_x * s1_y + s1_x * s2_y);
 
 	if (s > EPS && s < 1-EPS && t > EPS && t < 1-EPS)
@@ -284,10 +550,10 @@ get_line_intersection(
 
 int
 intersect(
-	const float p00[],
-	const float p01[],
-	const float p10[],
-	const float p11[]
+	const real_t p00[],
+	const real_t p01[],
+	const real_t p10[],
+	const real_t p11[]
 )
 {
 	// special case; if this is the same line, it does not intersect
@@ -343,26 +609,96 @@ overlap_poly(
 }
 
 
-/** Check to see if any triangles overlap */
+/** Check to see if any triangles in the current group overlap
+ * \return the id of the face that it overlaps, or -1 if none.
+ */
 int
 overlap_check(
-	const poly_t * g,
+	const group_t * const group,
 	const poly_t * const new_g
 )
 {
-	// special case -- if the root is the same as the one that we
-	// are checking, then it does not overlap
-	if (g == new_g)
-		return 0;
+	const int k = simd_overlap(
+		(const real_t * const (*)[2]) group->placed,
+		group->count,
+		(const real_t (*)[2]) new_g->p
+	);
 
-	while (g)
+	return k < 0 ? -1 : group->placed_face[k];
+}
+
+
+/** Grow the group's bounding box to hold g. */
+static void
+group_extend(
+	group_t * const group,
+	const poly_t * const g
+)
+{
+	for (int i = 0 ; i < 3 ; i++)
 	{
-		if (overlap_poly(g, new_g))
-			return 1;
-		g = g->work_next;
+		const real_t px = g->p[i][0];
+		const real_t py = g->p[i][1];
+
+		if (px < group->min[0]) group->min[0] = px;
+		if (px > group->max[0]) group->max[0] = px;
+
+		if (py < group->min[1]) group->min[1] = py;
+		if (py > group->max[1]) group->max[1] = py;
 	}
+}
 
-	return 0;
+
+/** Position a new triangle for the face across edge i of g,
+ * with its own edge 0 along that edge.
+ */
+static poly_t *
+poly_neighbor(
+	const poly_t * const g,
+	const int i
+)
+{
+	const face_t * const f = g->face;
+	const int edge = (i + g->start_edge) % 3;
+
+	// create a group that translates and rotates
+	// such that it lines up with this edge
+	real_t trans_x, trans_y, rotate;
+	if (i == 0)
+	{
+		trans_x = g->a;
+		trans_y = 0;
+		rotate = M_PI;
+	} else
+	if (i == 1)
+	{
+		trans_x = g->x2;
+		trans_y = g->y2;
+		rotate = -atan2(g->y2, g->a - g->x2);
+	} else
+	if (i == 2)
+	{
+		trans_x = 0;
+		trans_y = 0;
+		rotate = atan2(g->y2, g->x2);
+	} else {
+		errx(EXIT_FAILURE, "edge %d invalid?\n", i);
+	}
+
+	// position this one translated and rotated
+	poly_t * const g2 = calloc(1, sizeof(*g2));
+	g2->face = f->next[edge];
+	g2->start_edge = f->next_edge[edge];
+
+	poly_position(
+		g2,
+		g,
+		rotate, 
+		trans_x,
+		trans_y
+	);
+
+	return g2;
 }
 
 
@@ -372,30 +708,18 @@ overlap_check(
  */
 int
 poly_build(
+	group_t * const group,
 	poly_t * const g
 )
 {
 	face_t * const f = g->face;
 	const int start_edge = g->start_edge;
 	f->used = 1;
-
-	// update the group's bounding box
-	for (int i = 0 ; i < 3 ; i++)
-	{
-		const float px = g->p[i][0];
-		const float py = g->p[i][1];
-
-		if (px < poly_min[0]) poly_min[0] = px;
-		if (px > poly_max[0]) poly_max[0] = px;
-
-		if (py < poly_min[1]) poly_min[1] = py;
-		if (py > poly_max[1]) poly_max[1] = py;
-	}
-		
+	group_extend(group, g);
 
 	if (debug) fprintf(stderr, "%p: adding to poly\n", f);
 
-   for(int pass = 0 ; pass < 2 ; pass++)
+   for(int pass = params.folds_first ? 0 : 1 ; pass < 2 ; pass++)
    {
 	// for each edge, find the triangle that matches
 	for (int i = 0 ; i < 3 ; i++)
@@ -408,57 +732,28 @@ poly_build(
 		if (pass == 0 && f->coplanar[edge] == 0)
 			continue;
 
-		// create a group that translates and rotates
-		// such that it lines up with this edge
-		float trans_x, trans_y, rotate;
-		if (i == 0)
-		{
-			trans_x = g->a;
-			trans_y = 0;
-			rotate = M_PI;
-		} else
-		if (i == 1)
-		{
-			trans_x = g->x2;
-			trans_y = g->y2;
-			rotate = -atan2(g->y2, g->a - g->x2);
-		} else
-		if (i == 2)
-		{
-			trans_x = 0;
-			trans_y = 0;
-			rotate = atan2(g->y2, g->x2);
-		} else {
-			errx(EXIT_FAILURE, "edge %d invalid?\n", i);
-		}
-
-		// position this one translated and rotated
-		poly_t * const g2 = calloc(1, sizeof(*g2));
-		g2->face = f2;
-		g2->start_edge = f->next_edge[edge];
-
-		poly_position(
-			g2,
-			g,
-			rotate, 
-			trans_x,
-			trans_y
-		);
-
-		if (overlap_check(poly_root, g2))
+		poly_t * const g2 = poly_neighbor(g, i);
+		const int conflict = overlap_check(group, g2);
+		if (conflict >= 0)
 		{
+			trace_event(TRACE_OVERLAP, f2->id, f->id, edge,
+				f->coplanar[edge] == 0, conflict);
 			free(g2);
 			continue;
 		}
 
+		trace_event(TRACE_ACCEPT, f2->id, f->id, edge,
+			f->coplanar[edge] == 0, -1);
+
 		// no overlap, add it to the current group
+		group_attach(group, g, i, g2);
 		g->next[i] = g2;
 		g2->next[0] = g;
 		f2->used = 1;
 
 		// if g2 is a coplanar triangle, process it now rather than
 		// defering the work.
-		if (f->coplanar[edge] == 0)
+		if (f->coplanar[edge] == 0 && params.coplanar_now)
 			enqueue(g, g2, 1);
 		else
 			enqueue(g, g2, 0);
@@ -469,34 +764,199 @@ poly_build(
 }
 
 
+// label glyphs are 1.5 mm tall, this far inside the cut line
+#define LABEL_SIZE	1.5
+#define LABEL_MARGIN	0.5
+#define LABEL_MIN_SCALE	0.25
+
+// which glyphs have been used and need to be written in the <defs>
+static unsigned char glyph_used[128];
+static int labels_skipped;
+
+
+typedef struct
+{
+	real_t origin[2];
+	real_t e[2];	// along the baseline
+	real_t n[2];	// up from the baseline
+	real_t scale;
+	real_t x;	// of the current glyph
+} label_frame_t;
+
+
+/** Add one stroke of a label glyph to the cost estimate. */
+static void
+label_line(
+	void * const arg,
+	const double x1,
+	const double y1,
+	const double x2,
+	const double y2
+)
+{
+	const label_frame_t * const lf = arg;
+	const real_t unit = lf->scale * LABEL_SIZE / FONT_HEIGHT;
+	const real_t u1 = lf->x + x1 * unit;
+	const real_t u2 = lf->x + x2 * unit;
+	const real_t v1 = (FONT_HEIGHT - y1) * unit;
+	const real_t v2 = (FONT_HEIGHT - y2) * unit;
+
+	cost_line(cost_sheet, COST_LABEL,
+		lf->origin[0] + u1 * lf->e[0] + v1 * lf->n[0],
+		lf->origin[1] + u1 * lf->e[1] + v1 * lf->n[1],
+		lf->origin[0] + u2 * lf->e[0] + v2 * lf->n[0],
+		lf->origin[1] + u2 * lf->e[1] + v2 * lf->n[1]
+	);
+}
+
+
+/** Label edge i of triangle g with single stroke glyphs.
+ *
+ * The label sits along the inside of the edge, reading upright, and
+ * is shrunk until it fits inside the triangle so that it can never
+ * cross a cut line.  If it would have to be smaller than
+ * LABEL_MIN_SCALE it is left off.
+ */
 void
-svg_text(
-	float x,
-	float y,
-	float angle,
+svg_label(
+	FILE * const out,
+	const poly_t * const g,
+	const int i,
 	const char * fmt,
 	...
 )
 {
+	char text[32];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(text, sizeof(text), fmt, ap);
+	va_end(ap);
+
+	const real_t * p1 = g->p[i];
+	const real_t * p2 = g->p[(i+1) % 3];
+	const real_t * const apex = g->p[(i+2) % 3];
+
+	real_t dx = p2[0] - p1[0];
+	real_t dy = p2[1] - p1[1];
+	const real_t len = sqrt(dx*dx + dy*dy);
+	if (len <= 0)
+		return;
+
+	label_frame_t lf = {
+		.e = { dx / len, dy / len },
+	};
+
+	// read along whichever direction leaves the apex above the
+	// baseline; with y down that is the edge rotated by -90 degrees.
+	lf.n[0] = lf.e[1];
+	lf.n[1] = -lf.e[0];
+	if ((apex[0] - p1[0]) * lf.n[0] + (apex[1] - p1[1]) * lf.n[1] < 0)
+	{
+		const real_t * const tmp = p1;
+		p1 = p2;
+		p2 = tmp;
+		lf.e[0] = -lf.e[0];
+		lf.e[1] = -lf.e[1];
+		lf.n[0] = -lf.n[0];
+		lf.n[1] = -lf.n[1];
+	}
+
+	// apex in the frame of the edge
+	const real_t ax = (apex[0] - p1[0]) * lf.e[0] + (apex[1] - p1[1]) * lf.e[1];
+	const real_t ay = (apex[0] - p1[0]) * lf.n[0] + (apex[1] - p1[1]) * lf.n[1];
+
+	// at height v above the edge the triangle runs from ax*v/ay to
+	// len + (ax-len)*v/ay, so the box fits where the spans at its
+	// bottom and top overlap by at least its width.  if the angle
+	// at either end is obtuse the spans shift, so shrink until it fits.
+	const real_t w = font_width(text) * LABEL_SIZE / FONT_HEIGHT;
+	const real_t h = LABEL_SIZE;
+	real_t scale = 1;
+	real_t u0 = 0;
+
+	for ( ; scale >= LABEL_MIN_SCALE ; scale *= 0.9)
+	{
+		if (ay <= LABEL_MARGIN + scale * h)
+			continue;
+
+		const real_t v1 = LABEL_MARGIN;
+		const real_t v2 = LABEL_MARGIN + scale * h;
+		const real_t left = fmax(ax * v1 / ay, ax * v2 / ay);
+		const real_t right = fmin(
+			len + (ax - len) * v1 / ay,
+			len + (ax - len) * v2 / ay
+		);
 
-	printf("<g transform=\"translate(%f %f) rotate(%f)\">",
-		x,
-		y,
-		angle
+		if (right - left < scale * w)
+			continue;
+
+		u0 = (left + right - scale * w) / 2;
+		break;
+	}
+
+	if (scale < LABEL_MIN_SCALE)
+	{
+		labels_skipped++;
+		return;
+	}
+
+	lf.scale = scale;
+	lf.origin[0] = p1[0] + u0 * lf.e[0] + LABEL_MARGIN * lf.n[0];
+	lf.origin[1] = p1[1] + u0 * lf.e[1] + LABEL_MARGIN * lf.n[1];
+
+	fprintf(out, "<g transform=\"translate(%f %f) rotate(%f) scale(%f)\">",
+		lf.origin[0],
+		lf.origin[1],
+		atan2(lf.e[1], lf.e[0]) * 180 / M_PI,
+		scale
 	);
 
-	printf("<text x=\"-2\" y=\"1.5\" style=\"font-size:1.5px;\">");
+	for (int k = 0 ; text[k] ; k++)
+	{
+		const int c = text[k] & 0x7F;
+		if (!font_has(c))
+			continue;
 
-	va_list ap;
-	va_start(ap, fmt);
-	vprintf(fmt, ap);
-	va_end(ap);
+		glyph_used[c] = 1;
+		fprintf(out, "<use xlink:href=\"#glyph-%d\" x=\"%g\"/>",
+			c,
+			k * FONT_ADVANCE * LABEL_SIZE / FONT_HEIGHT
+		);
 
-	printf("</text></g>\n");
+		if (cost_sheet)
+		{
+			lf.x = k * FONT_ADVANCE * scale * LABEL_SIZE / FONT_HEIGHT;
+			font_lines(c, label_line, &lf);
+		}
+	}
+
+	fprintf(out, "</g>\n");
+}
+
+
+/** Write each glyph that a label used once, for the <use> elements
+ * to refer to.  The caller wraps them in <defs>.
+ */
+static void
+svg_glyph_defs(
+	FILE * const out
+)
+{
+	for (int c = 0 ; c < 128 ; c++)
+	{
+		if (!glyph_used[c])
+			continue;
+
+		fprintf(out, "<path id=\"glyph-%d\" d=\"", c);
+		font_path(out, c, LABEL_SIZE / FONT_HEIGHT);
+		fprintf(out, "\" stroke=\"#0000FF\" stroke-width=\"0.1px\" fill=\"none\" vector-effect=\"non-scaling-stroke\"/>\n");
+	}
 }
 
+
 void
 poly_print(
+	FILE * const out,
 	poly_t * const g
 )
 {
@@ -509,7 +969,7 @@ poly_print(
 	// if the edge is an outside, which means that the group
 	// has no next element, draw a cut line.  If there is an
 	// adjacent neighbor and it is not coplanar, draw a score line
-printf("<g><!-- %p %d %f %f->%p %f->%p %f->%p -->\n",
+fprintf(out, "<g><!-- %p %d %f %f->%p %f->%p %f->%p -->\n",
 	f,
 	g->start_edge, g->rot * 180/M_PI,
 	f->sides[0],
@@ -521,7 +981,6 @@ printf("<g><!-- %p %d %f %f->%p %f->%p %f->%p -->\n",
 );
 
 	int cut_lines = 0;
-	const uintptr_t a1 = (0x7FFFF & (uintptr_t) f) >> 3;
 
 	for (int i = 0 ; i < 3 ; i++)
 	{
@@ -531,24 +990,16 @@ printf("<g><!-- %p %d %f %f->%p %f->%p %f->%p -->\n",
 		if (!next)
 		{
 			// draw a cut line
-			const float * const p1 = g->p[i];
-			const float * const p2 = g->p[(i+1) % 3];
-			const float cx = (p2[0] + p1[0]) / 2;
-			const float cy = (p2[1] + p1[1]) / 2;
-			const float dx = (p2[0] - p1[0]);
-			const float dy = (p2[1] - p1[1]);
-			const float angle = atan2(dy, dx) * 180 / M_PI;
-
-			svg_line("#FF0000", p1, p2, 0);
+			svg_line(out, COST_CUT, g->p[i], g->p[(i+1) % 3]);
 			cut_lines++;
 
-			// use the lower address as the label
+			// both sides of the edge get the lower of the
+			// two half-edge numbers as the label
 			if (draw_labels)
 			{
-				uintptr_t a2 = (0x7FFFF & (uintptr_t) f->next[edge]) >> 3;
-				if (a2 > a1)
-					a2 = a1;
-				svg_text(cx, cy, angle, "%04x", a2);
+				const int e1 = 3 * f->id + edge;
+				const int e2 = 3 * f->next[edge]->id + f->next_edge[edge];
+				svg_label(out, g, i, "%d", e1 < e2 ? e1 : e2);
 			}
 
 			continue;
@@ -560,29 +1011,19 @@ printf("<g><!-- %p %d %f %f->%p %f->%p %f->%p -->\n",
 		if (f->coplanar[edge] < 0)
 		{
 			// draw a mountain score line since they are not coplanar
-			svg_line("#00FF00", g->p[i], g->p[(i+1) % 3], 1);
+			svg_line(out, COST_MOUNTAIN, g->p[i], g->p[(i+1) % 3]);
 		} else
 		if (f->coplanar[edge] > 0)
 		{
 			// draw a valley score line since they are not coplanar
-			svg_line("#00FF00", g->p[i], g->p[(i+1) % 3], 0);
+			svg_line(out, COST_VALLEY, g->p[i], g->p[(i+1) % 3]);
 		} else {
 			// draw a shadow line since they are coplanar
-			//svg_line("#F0F0F0", g->p[i], g->p[(i+1) % 3]);
+			//svg_line(out, "#F0F0F0", g->p[i], g->p[(i+1) % 3]);
 		}
 	}
 
-/*
-	// only draw labels if requested and if there are any cut-edges
-	// on this polygon.
-	const float tx = (g->p[0][0] + g->p[1][0] + g->p[2][0]) / 3.0;
-	const float ty = (g->p[0][1] + g->p[1][1] + g->p[2][1]) / 3.0;
-	if (draw_labels && cut_lines > 0)
-	svg_text(tx, ty, 0, "%04x",
-		(0x7FFFF & (uintptr_t) f) >> 3);
-*/
-
-printf("</g>\n");
+fprintf(out, "</g>\n");
 
 	for (int i = 0 ; i < 3 ; i++)
 	{
@@ -590,16 +1031,14 @@ printf("</g>\n");
 		if (!next || next->printed)
 			continue;
 
-		poly_print(next);
+		poly_print(out, next);
 	}
 }
 
 
-/* Returns the 0 for coplanar, negative for mountain, positive for valley.
- * (approximates the angle between two triangles that share one edge).
- */
-int
-coplanar_check(
+/** Find the point of f2 that is not shared with f1. */
+static v3_t
+coplanar_point(
 	const stl_face_t * const f1,
 	const stl_face_t * const f2
 )
@@ -622,98 +1061,1100 @@ coplanar_check(
 		break;
 	}
 
-	// (x3-x1) . ((x2-x1) X (x4-x3)) == 0
-	v3_t dx31 = v3_sub(x3, x1);
-	v3_t dx21 = v3_sub(x2, x1);
-	v3_t dx43 = v3_sub(x4, x3);
-	v3_t cross = v3_cross(dx21, dx43);
-	float dot = v3_dot(dx31, cross);
-	
-	int check = -EPS < dot && dot < +EPS;
-	if (debug) fprintf( stderr, "%p %p %s: %f\n", f1, f2, check ? "yes" : "no", dot);
-	return (int) dot;
+	return x4;
 }
 
 
-/** Translate a list of STL triangles into a connected graph of faces.
+/* Set the coplanar field for each pair of matched edges:
+ * 0 for coplanar, negative for mountain, positive for valley.
+ * (approximates the angle between two triangles that share one edge).
  *
- * If there are any triangles that do not have three connected edges,
- * the first error will be reported and NULL will be returned.
+ * pairs[] holds the first face index and edge of each match; the
+ * triple products are computed in one batch by the SIMD kernel.
  */
-face_t *
-stl2faces(
+static void
+coplanar_check(
 	const stl_face_t * const stl_faces,
-	const int num_triangles
+	face_t * const faces,
+	const int * const pairs,
+	const int num_pairs
 )
 {
-	face_t * const faces = calloc(num_triangles, sizeof(*faces));
-
-	// convert the stl triangles into faces
-	for (int i = 0 ; i < num_triangles ; i++)
+	const int n = num_pairs;
+	real_t * const buf = calloc(13 * n + 1, sizeof(*buf));
+	real_t * const dot = buf + 12 * n;
+	real_t * p[4][3];
+	for (int k = 0 ; k < 4 ; k++)
+		for (int c = 0 ; c < 3 ; c++)
+			p[k][c] = buf + (3*k + c) * n;
+
+	for (int i = 0 ; i < n ; i++)
 	{
-		const stl_face_t * const stl = &stl_faces[i];
-		face_t * const f = &faces[i];
+		const face_t * const f = &faces[pairs[2*i+0]];
+		const int edge = pairs[2*i+1];
+		const stl_face_t * const f1 = &stl_faces[f - faces];
+		const stl_face_t * const f2 = &stl_faces[f->next[edge] - faces];
+		const v3_t x4 = coplanar_point(f1, f2);
 
-		f->sides[0] = v3_len(&stl->p[0], &stl->p[1]);
-		f->sides[1] = v3_len(&stl->p[1], &stl->p[2]);
-		f->sides[2] = v3_len(&stl->p[2], &stl->p[0]);
-		if (debug) fprintf(stderr, "%p %f %f %f\n",
-			f, f->sides[0], f->sides[1], f->sides[2]);
+		for (int c = 0 ; c < 3 ; c++)
+		{
+			p[0][c][i] = f1->p[0].p[c];
+			p[1][c][i] = f1->p[1].p[c];
+			p[2][c][i] = f1->p[2].p[c];
+			p[3][c][i] = x4.p[c];
+		}
 	}
 
-	// look to see if there is a matching point
-	// in the faces that we've already built
-	for (int i = 0 ; i < num_triangles ; i++)
+	simd_dihedral(n, (const real_t * const (*)[3]) p, dot);
+
+	for (int i = 0 ; i < n ; i++)
 	{
-		const stl_face_t * const stl = &stl_faces[i];
-		face_t * const f = &faces[i];
+		face_t * const f = &faces[pairs[2*i+0]];
+		const int edge = pairs[2*i+1];
+		face_t * const f2 = f->next[edge];
+		const real_t d = dot[i];
 
-		for (int j = 0 ; j < num_triangles ; j++)
-		{
-			if (i == j)
-				continue;
+		int check = -EPS < d && d < +EPS;
+		if (debug) fprintf( stderr, "%p %p %s: %f\n", f, f2, check ? "yes" : "no", d);
 
-			const stl_face_t * const stl2 = &stl_faces[j];
-			face_t * const f2 = &faces[j];
+		f->coplanar[edge] =
+		f2->coplanar[f->next_edge[edge]] = (int) d;
+	}
+
+	free(buf);
+}
+
+
+typedef struct
+{
+	const v3_soa_t * v;
+	const v3_soa_t * d;
+	real_t * len;
+	int num_triangles;
+	face_t * faces;
+} stl2faces_t;
+
+
+/** Compute the side lengths of the triangles in [start,end). */
+static void
+stl2faces_sides(
+	void * const arg_ptr,
+	const int start,
+	const int end
+)
+{
+	const stl2faces_t * const arg = arg_ptr;
+	const int n = end - start;
+
+	for (int k = 0 ; k < 3 ; k++)
+	{
+		const v3_soa_t * const v0 = &arg->v[k];
+		const v3_soa_t * const v1 = &arg->v[(k+1) % 3];
+		const v3_soa_t a = { v0->x + start, v0->y + start, v0->z + start };
+		const v3_soa_t b = { v1->x + start, v1->y + start, v1->z + start };
+		const v3_soa_t d = { arg->d->x + start, arg->d->y + start, arg->d->z + start };
+		real_t * const len = arg->len + k * arg->num_triangles + start;
+
+		v3_batch_sub(n, &a, &b, &d);
+		v3_batch_mag(n, &d, len);
+	}
+
+	for (int i = start ; i < end ; i++)
+	{
+		face_t * const f = &arg->faces[i];
+		f->id = i;
+		for (int k = 0 ; k < 3 ; k++)
+			f->sides[k] = arg->len[k * arg->num_triangles + i];
+		if (debug) fprintf(stderr, "%p %f %f %f\n",
+			f, f->sides[0], f->sides[1], f->sides[2]);
+	}
+}
+
+
+/** Translate a list of STL triangles into a connected graph of faces.
+ *
+ * If there are any triangles that do not have three connected edges,
+ * the first error will be reported and NULL will be returned.
+ */
+face_t *
+stl2faces(
+	const stl_face_t * const stl_faces,
+	const int num_triangles
+)
+{
+	face_t * const faces = calloc(num_triangles, sizeof(*faces));
+
+	// SoA copy of the vertices for the batch operations
+	v3_soa_t v[3];
+	for (int k = 0 ; k < 3 ; k++)
+	{
+		v[k] = v3_soa_alloc(num_triangles);
+		for (int i = 0 ; i < num_triangles ; i++)
+			v3_soa_set(&v[k], i, stl_faces[i].p[k]);
+	}
+
+	// convert the stl triangles into faces
+	v3_soa_t d = v3_soa_alloc(num_triangles);
+	stl2faces_t arg = {
+		.v		= v,
+		.d		= &d,
+		.len		= calloc(3 * num_triangles, sizeof(real_t)),
+		.num_triangles	= num_triangles,
+		.faces		= faces,
+	};
+	pool_for(0, num_triangles, 1024, stl2faces_sides, &arg);
+	free(arg.len);
+	v3_soa_free(&d);
+
+	const real_t * const p[3][3] = {
+		{ v[0].x, v[0].y, v[0].z },
+		{ v[1].x, v[1].y, v[1].z },
+		{ v[2].x, v[2].y, v[2].z },
+	};
+
+	int * const pairs = calloc(3 * num_triangles, 2 * sizeof(*pairs));
+	int num_pairs = 0;
+
+	// look to see if there is a matching edge, running in the
+	// opposite direction, in the other faces.
+	progress_start("pair edges", num_triangles);
+	for (int i = 0 ; i < num_triangles ; i++)
+	{
+		const stl_face_t * const stl = &stl_faces[i];
+		face_t * const f = &faces[i];
+		progress_add(1);
+
+		for (int edge = 0 ; edge < 3 ; edge++)
+		{
+			if (f->next[edge])
+				continue;
+
+			const v3_t a = stl->p[edge];
+			const v3_t b = stl->p[(edge+1) % 3];
+			int edges;
 
-			for (int edge = 0 ; edge < 3 ; edge++)
+			for (int j = 0 ; j < num_triangles ; j++)
 			{
-				if (f->next[edge])
+				j = simd_match_edge(
+					p,
+					j,
+					num_triangles,
+					a.p,
+					b.p,
+					&edges
+				);
+				if (j < 0)
+					break;
+				if (i == j)
 					continue;
 
-				for (int edge2 = 0 ; edge2 < 3 ; edge2++)
-				{
-					if (f2->next[edge2])
-						continue;
-
-					if (!edge_eq2(stl, stl2, edge, edge2))
-						continue;
+				face_t * const f2 = &faces[j];
+				int edge2;
+				for (edge2 = 0 ; edge2 < 3 ; edge2++)
+					if ((edges & (1 << edge2)) && !f2->next[edge2])
+						break;
+				if (edge2 == 3)
+					continue;
 
-					f->next[edge] = f2;
-					f->next_edge[edge] = edge2;
-					f2->next[edge2] = f;
-					f2->next_edge[edge2] = edge;
+				f->next[edge] = f2;
+				f->next_edge[edge] = edge2;
+				f2->next[edge2] = f;
+				f2->next_edge[edge2] = edge;
 
-					f->coplanar[edge] =
-					f2->coplanar[edge2] = coplanar_check(stl, stl2);
-				}
+				pairs[2*num_pairs+0] = i;
+				pairs[2*num_pairs+1] = edge;
+				num_pairs++;
+				break;
 			}
 		}
 
 		// all three edges should be matched
 		if (f->next[0] && f->next[1] && f->next[2])
 			continue;
+		progress_clear();
 		fprintf(stderr, "%d missing edges?\n", i);
 		free(faces);
 		return NULL;
 	}
 
+	coplanar_check(stl_faces, faces, pairs, num_pairs);
+	progress_end();
+
+	free(pairs);
+	for (int k = 0 ; k < 3 ; k++)
+		v3_soa_free(&v[k]);
+
 	return faces;
 }
 
 
-int main(void)
+/** Developable strips.
+ *
+ * Cylinders, cones and twisted bands are made of faces joined by
+ * shallow folds whose vertices either have an angle sum of 2 pi or
+ * sit on a sharp crease, such as the rim of a cylinder.  Such a run
+ * of faces unfolds flat, so it is grown by breadth first search,
+ * laid out once and checked with the sweep.  The longest prefix
+ * that does not overlap itself is then placed as the start of a
+ * group without testing each triangle against the group.
+ */
+#define STRIP_MIN	4		// shorter strips are left to poly_build
+
+typedef struct
+{
+	int count;
+	int * start;		// strip s is face[start[s]] to face[start[s+1]]
+	int * face;		// in the order that they unfold
+	int * parent;		// by face id, the face it unfolds from or -1
+	int * parent_edge;	// by face id, the edge of the parent it is across
+	int * strip;		// by face id, the strip it is in or -1
+} strips_t;
+
+
+/** Interior angle at vertex k of a face, between edges k and k+2. */
+static real_t
+corner_angle(
+	const face_t * const f,
+	const int k
+)
+{
+	const real_t a = f->sides[k];
+	const real_t b = f->sides[(k+2) % 3];
+	const real_t c = f->sides[(k+1) % 3];
+	real_t cos_angle = (a*a + b*b - c*c) / (2*a*b);
+	if (cos_angle > 1) cos_angle = 1;
+	if (cos_angle < -1) cos_angle = -1;
+	return acos(cos_angle);
+}
+
+
+/** Mark the corners whose vertex can be inside a strip.
+ *
+ * Stepping from edge k of a face across to its neighbor reaches the
+ * next face around vertex k, so the corners around each vertex are
+ * found without welding the vertices.  A vertex is developable if its
+ * angle deficit is zero or if one of its edges is a crease.
+ */
+static int *
+strip_corners(
+	const face_t * const faces,
+	const int num_triangles,
+	const real_t * const fold
+)
+{
+	const int n = 3 * num_triangles;
+	int * const developable = calloc(n, sizeof(*developable));
+	int * const seen = calloc(n, sizeof(*seen));
+	int * const fan = calloc(n, sizeof(*fan));
+
+	for (int c0 = 0 ; c0 < n ; c0++)
+	{
+		if (seen[c0])
+			continue;
+
+		real_t sum = 0;
+		int crease = 0;
+		int count = 0;
+		int c = c0;
+
+		// stepping across the edges is a permutation of the
+		// corners, so this always comes back around to c0
+		do {
+			const face_t * const f = &faces[c / 3];
+			const int k = c % 3;
+			seen[c] = 1;
+			fan[count++] = c;
+			sum += corner_angle(f, k);
+			if (fold[c] >= params.strip_fold * M_PI / 180)
+				crease = 1;
+
+			c = 3 * f->next[k]->id + (f->next_edge[k] + 1) % 3;
+		} while (c != c0);
+
+		const int ok = crease || fabs(sum - 2 * M_PI) < params.strip_flat;
+		for (int j = 0 ; j < count ; j++)
+			developable[fan[j]] = ok;
+	}
+
+	free(seen);
+	free(fan);
+	return developable;
+}
+
+
+/** Lay out the faces of a strip from its root, which is at the
+ * origin as a group root would be.
+ */
+static poly_t *
+strip_layout(
+	const strips_t * const strips,
+	face_t * const faces,
+	const int s,
+	poly_t ** const poly_of
+)
+{
+	const int start = strips->start[s];
+	const int count = strips->start[s+1] - start;
+	const poly_t origin = { };
+	poly_t * const polys = calloc(count, sizeof(*polys));
+
+	for (int j = 0 ; j < count ; j++)
+	{
+		const int id = strips->face[start + j];
+		const int parent = strips->parent[id];
+		poly_t * const g = &polys[j];
+
+		if (parent < 0)
+		{
+			g->face = &faces[id];
+			poly_position(g, &origin, 0, 0, 0);
+		} else {
+			const poly_t * const gp = poly_of[parent];
+			const int i = (strips->parent_edge[id] - gp->start_edge + 3) % 3;
+			poly_t * const g2 = poly_neighbor(gp, i);
+			*g = *g2;
+			free(g2);
+		}
+
+		poly_of[id] = g;
+	}
+
+	return polys;
+}
+
+
+/** Find the developable strips, grown from seeds in the order
+ * that the groups would be started.
+ */
+static void
+strips_find(
+	strips_t * const strips,
+	const stl_face_t * const stl_faces,
+	face_t * const faces,
+	const int num_triangles,
+	const int offset
+)
+{
+	*strips = (strips_t) {
+		.start		= calloc(num_triangles + 1, sizeof(int)),
+		.face		= calloc(num_triangles, sizeof(int)),
+		.parent		= calloc(num_triangles, sizeof(int)),
+		.parent_edge	= calloc(num_triangles, sizeof(int)),
+		.strip		= calloc(num_triangles, sizeof(int)),
+	};
+
+	// fold angle across each edge, from the face normals
+	v3_t * const normal = calloc(num_triangles, sizeof(*normal));
+	for (int i = 0 ; i < num_triangles ; i++)
+	{
+		const v3_t * const p = stl_faces[i].p;
+		normal[i] = v3_norm(v3_cross(
+			v3_sub(p[1], p[0]),
+			v3_sub(p[2], p[0])
+		));
+		strips->strip[i] = -1;
+	}
+
+	real_t * const fold = calloc(3 * num_triangles, sizeof(*fold));
+	for (int i = 0 ; i < num_triangles ; i++)
+	{
+		for (int e = 0 ; e < 3 ; e++)
+		{
+			real_t d = v3_dot(normal[i], normal[faces[i].next[e]->id]);
+			if (d > 1) d = 1;
+			if (d < -1) d = -1;
+			fold[3*i+e] = acos(d);
+		}
+	}
+
+	int * const developable = strip_corners(faces, num_triangles, fold);
+	poly_t ** const poly_of = calloc(num_triangles, sizeof(*poly_of));
+	sweep_tri_t * const tris = calloc(num_triangles, sizeof(*tris));
+	int used = 0;
+
+	for (int i = 0 ; i < num_triangles ; i++)
+	{
+		const int seed = (i + offset) % num_triangles;
+		if (strips->strip[seed] >= 0)
+			continue;
+
+		const int s = strips->count;
+		const int start = used;
+		strips->start[s] = start;
+		strips->face[used++] = seed;
+		strips->parent[seed] = -1;
+		strips->strip[seed] = s;
+
+		// grow across the shallow folds that have a
+		// developable vertex at either end
+		for (int j = start ; j < used ; j++)
+		{
+			const int id = strips->face[j];
+			const face_t * const f = &faces[id];
+
+			for (int e = 0 ; e < 3 ; e++)
+			{
+				const int id2 = f->next[e]->id;
+				if (strips->strip[id2] >= 0)
+					continue;
+				if (!(fold[3*id+e] < params.strip_fold * M_PI / 180))
+					continue;
+				if (!developable[3*id+e]
+				&&  !developable[3*id+(e+1) % 3])
+					continue;
+
+				strips->face[used++] = id2;
+				strips->parent[id2] = id;
+				strips->parent_edge[id2] = e;
+				strips->strip[id2] = s;
+			}
+		}
+
+		// keep the faces before the first one that overlaps
+		// an earlier one in the layout
+		strips->start[s+1] = used;
+		poly_t * const polys = strip_layout(strips, faces, s, poly_of);
+		const int count = used - start;
+		for (int j = 0 ; j < count ; j++)
+		{
+			tris[j] = (sweep_tri_t) { .id = j };
+			memcpy(tris[j].p, polys[j].p, sizeof(tris[j].p));
+		}
+		free(polys);
+
+		int * pairs;
+		const int num_pairs = sweep_overlaps(tris, count, 0.01, &pairs);
+		int keep = count;
+		for (int k = 0 ; k < num_pairs ; k++)
+			if (pairs[2*k+1] < keep)
+				keep = pairs[2*k+1];
+		free(pairs);
+
+		if (keep < STRIP_MIN)
+			keep = 0;
+
+		// the rest are free to seed or join later strips
+		for (int j = start + keep ; j < used ; j++)
+			strips->strip[strips->face[j]] = -1;
+		used = start + keep;
+
+		if (keep)
+			strips->start[++strips->count] = used;
+	}
+
+	free(normal);
+	free(fold);
+	free(developable);
+	free(poly_of);
+	free(tris);
+}
+
+
+/** Place the faces of strip s that are still free in the group
+ * started at root, without testing them for overlap since the
+ * strip is known not to overlap itself.  They are queued after
+ * the root so that poly_build() grows the rest of the group from
+ * every one of them.
+ */
+static void
+strip_place(
+	group_t * const group,
+	const strips_t * const strips,
+	face_t * const faces,
+	const int s,
+	poly_t * const root,
+	poly_t ** const poly_of
+)
+{
+	poly_t * last = root;
+	root->face->used = 1;
+	poly_of[root->face->id] = root;
+
+	for (int j = strips->start[s] + 1 ; j < strips->start[s+1] ; j++)
+	{
+		const int id = strips->face[j];
+		poly_t * const gp = poly_of[strips->parent[id]];
+		poly_of[id] = NULL;
+
+		// taken by an earlier group, or cut off from the root
+		if (faces[id].used || !gp)
+			continue;
+
+		const int edge = strips->parent_edge[id];
+		const int i = (edge - gp->start_edge + 3) % 3;
+		poly_t * const g2 = poly_neighbor(gp, i);
+
+		trace_event(TRACE_ACCEPT, id, gp->face->id, edge,
+			gp->face->coplanar[edge] == 0, -1);
+
+		group_attach(group, gp, i, g2);
+		gp->next[i] = g2;
+		g2->next[0] = gp;
+		faces[id].used = 1;
+
+		enqueue(last, g2, 1);
+		last = g2;
+		poly_of[id] = g2;
+	}
+}
+
+
+/** Concurrent growth of several groups.
+ *
+ * K seeds are picked by farthest point sampling on the face graph
+ * and each grows its own group, up to SEEDS_BATCH faces per round,
+ * on the thread pool.  In a round every group finds the next faces
+ * that it can attach without overlap and claims them with an atomic
+ * minimum on the claim array; the lowest numbered group wins a
+ * contested face, so the result does not depend on the threads or
+ * their timing.  The winners attach their faces after every claim
+ * has been made, checking each against the ones attached before it
+ * in the same batch.
+ */
+#define SEEDS_BATCH 8
+
+typedef struct
+{
+	group_t * group;
+	poly_t * root;
+
+	// where poly_build() would be: the triangle being grown
+	// from, which pass and which of its edges is next
+	poly_t * iter;
+	int pass;
+	int i;
+
+	// the faces proposed in this round, across edge cand_i
+	// of cand, in the order poly_build() would attach them
+	int num_cand;
+	poly_t * cand[SEEDS_BATCH];
+	int cand_i[SEEDS_BATCH];
+	poly_t * g2[SEEDS_BATCH];
+} seed_t;
+
+
+typedef struct
+{
+	seed_t * seeds;
+	int num_seeds;
+	int round;
+	int64_t * claim;
+} seeds_arg_t;
+
+
+/** Breadth first distance from the seed, keeping the least distance
+ * to any seed so far in dist.
+ */
+static void
+seeds_distance(
+	const face_t * const faces,
+	const int seed,
+	int * const dist,
+	int * const queue
+)
+{
+	int head = 0;
+	int tail = 0;
+	dist[seed] = 0;
+	queue[tail++] = seed;
+
+	while (head < tail)
+	{
+		const int id = queue[head++];
+		for (int e = 0 ; e < 3 ; e++)
+		{
+			const int id2 = faces[id].next[e]->id;
+			if (dist[id2] <= dist[id] + 1)
+				continue;
+			dist[id2] = dist[id] + 1;
+			queue[tail++] = id2;
+		}
+	}
+}
+
+
+/** Pick up to k seeds, each as far as it can be from the others,
+ * starting from the offset face.  Ties go to the first face after
+ * the offset.
+ * \return the number of seeds.
+ */
+static int
+seeds_pick(
+	const face_t * const faces,
+	const int num_triangles,
+	const int offset,
+	const int k,
+	int * const seed
+)
+{
+	int * const dist = calloc(num_triangles, sizeof(*dist));
+	int * const queue = calloc(num_triangles, sizeof(*queue));
+	for (int i = 0 ; i < num_triangles ; i++)
+		dist[i] = num_triangles;
+
+	int count = 0;
+	seed[count++] = offset % num_triangles;
+
+	while (count < k)
+	{
+		seeds_distance(faces, seed[count-1], dist, queue);
+
+		int best = -1;
+		for (int i = 0 ; i < num_triangles ; i++)
+		{
+			const int id = (i + offset) % num_triangles;
+			if (best < 0 || dist[id] > dist[best])
+				best = id;
+		}
+
+		// every face is already a seed or next to one
+		if (dist[best] < 2)
+			break;
+		seed[count++] = best;
+	}
+
+	free(dist);
+	free(queue);
+	return count;
+}
+
+
+/** Find the next faces that seed s can attach without overlap and
+ * claim them, following the same order as poly_build().
+ *
+ * A batch stops at the end of the work list, or before moving on
+ * from a triangle that will have a face put at the head of the list,
+ * since poly_build() would visit the new faces next.
+ */
+static void
+seeds_propose(
+	void * const arg_ptr,
+	const int start,
+	const int end
+)
+{
+	seeds_arg_t * const arg = arg_ptr;
+
+	// the claims of earlier rounds are all less than this round's,
+	// so they are replaced.
+	const int64_t round = (int64_t) arg->round * arg->num_seeds;
+
+	for (int s = start ; s < end ; s++)
+	{
+		seed_t * const seed = &arg->seeds[s];
+		const int64_t mine = round + s;
+		int at_head = 0;
+		seed->num_cand = 0;
+
+		while (seed->iter && seed->num_cand < SEEDS_BATCH)
+		{
+			poly_t * const g = seed->iter;
+			const face_t * const f = g->face;
+
+			if (seed->i == 3 && seed->pass == 0)
+			{
+				seed->i = 0;
+				seed->pass = 1;
+				continue;
+			}
+
+			if (seed->i == 3)
+			{
+				if (seed->num_cand && (at_head || !g->work_next))
+					break;
+
+				// on to the next triangle in the work list
+				seed->i = 0;
+				seed->pass = params.folds_first ? 0 : 1;
+				seed->iter = g->work_next;
+				if (seed->iter)
+					group_extend(seed->group, seed->iter);
+				continue;
+			}
+
+			const int i = seed->i++;
+			const int edge = (i + g->start_edge) % 3;
+			const face_t * const f2 = f->next[edge];
+			if (f2->used)
+				continue;
+			if (seed->pass == 0 && f->coplanar[edge] == 0)
+				continue;
+
+			poly_t * const g2 = poly_neighbor(g, i);
+			const int conflict = overlap_check(seed->group, g2);
+			if (conflict >= 0)
+			{
+				trace_event(TRACE_OVERLAP, f2->id, f->id, edge,
+					f->coplanar[edge] == 0, conflict);
+				free(g2);
+				continue;
+			}
+
+			const int c = seed->num_cand++;
+			seed->cand[c] = g;
+			seed->cand_i[c] = i;
+			seed->g2[c] = g2;
+			at_head |= f->coplanar[edge] == 0 && params.coplanar_now;
+
+			int64_t * const claim = &arg->claim[f2->id];
+			int64_t old = __atomic_load_n(claim, __ATOMIC_RELAXED);
+			while ((old < round || mine < old)
+			&& !__atomic_compare_exchange_n(claim, &old, mine,
+				0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				;
+		}
+	}
+}
+
+
+/** Attach the faces that each seed won in this round. */
+static void
+seeds_commit(
+	void * const arg_ptr,
+	const int start,
+	const int end
+)
+{
+	seeds_arg_t * const arg = arg_ptr;
+
+	for (int s = start ; s < end ; s++)
+	{
+		seed_t * const seed = &arg->seeds[s];
+		const int64_t mine = (int64_t) arg->round * arg->num_seeds + s;
+		int attached = 0;
+
+		for (int c = 0 ; c < seed->num_cand ; c++)
+		{
+			poly_t * const g = seed->cand[c];
+			poly_t * const g2 = seed->g2[c];
+			face_t * const f = g->face;
+			face_t * const f2 = g2->face;
+			const int i = seed->cand_i[c];
+			const int edge = (i + g->start_edge) % 3;
+
+			// lost to a lower numbered seed, or proposed twice
+			// from two triangles of this group
+			if (arg->claim[f2->id] != mine || f2->used)
+			{
+				free(g2);
+				continue;
+			}
+
+			if (attached)
+			{
+				const int conflict = overlap_check(seed->group, g2);
+				if (conflict >= 0)
+				{
+					trace_event(TRACE_OVERLAP, f2->id, f->id, edge,
+						f->coplanar[edge] == 0, conflict);
+					free(g2);
+					continue;
+				}
+			}
+
+			trace_event(TRACE_ACCEPT, f2->id, f->id, edge,
+				f->coplanar[edge] == 0, -1);
+
+			group_attach(seed->group, g, i, g2);
+			g->next[i] = g2;
+			g2->next[0] = g;
+			f2->used = 1;
+			attached = 1;
+			progress_add(1);
+
+			if (f->coplanar[edge] == 0 && params.coplanar_now)
+				enqueue(g, g2, 1);
+			else
+				enqueue(g, g2, 0);
+		}
+	}
+}
+
+
+/** Grow groups from up to k seeds at once.
+ * \return the number of groups, which are in *seeds_out.
+ */
+static int
+seeds_grow(
+	face_t * const faces,
+	const int num_triangles,
+	const int offset,
+	const int k,
+	seed_t ** const seeds_out
+)
+{
+	int * const picked = calloc(k, sizeof(*picked));
+	const int num_seeds = seeds_pick(faces, num_triangles, offset, k, picked);
+	seed_t * const seeds = calloc(num_seeds, sizeof(*seeds));
+	const poly_t origin = { };
+
+	for (int s = 0 ; s < num_seeds ; s++)
+	{
+		seed_t * const seed = &seeds[s];
+		face_t * const f = &faces[picked[s]];
+
+		seed->group = group_alloc(num_triangles);
+		seed->root = calloc(1, sizeof(*seed->root));
+		seed->root->face = f;
+		poly_position(seed->root, &origin, 0, 0, 0);
+		group_start(seed->group, seed->root);
+		group_extend(seed->group, seed->root);
+		seed->iter = seed->root;
+		seed->pass = params.folds_first ? 0 : 1;
+		f->used = 1;
+		progress_add(1);
+		trace_event(TRACE_GROUP, f->id, -1, 0, 0, -1);
+	}
+
+	seeds_arg_t arg = {
+		.seeds		= seeds,
+		.num_seeds	= num_seeds,
+		.claim		= calloc(num_triangles, sizeof(*arg.claim)),
+	};
+
+	for (arg.round = 1 ; ; arg.round++)
+	{
+		pool_for(0, num_seeds, 1, seeds_propose, &arg);
+
+		int active = 0;
+		for (int s = 0 ; s < num_seeds ; s++)
+			active |= seeds[s].num_cand != 0;
+		if (!active)
+			break;
+
+		pool_for(0, num_seeds, 1, seeds_commit, &arg);
+	}
+
+	free(arg.claim);
+	free(picked);
+	*seeds_out = seeds;
+	return num_seeds;
+}
+
+
+typedef struct
+{
+	real_t area;
+	int rank;
+	int id;
+} root_area_t;
+
+
+static int
+root_area_cmp(
+	const void * const a_ptr,
+	const void * const b_ptr
+)
+{
+	const root_area_t * const a = a_ptr;
+	const root_area_t * const b = b_ptr;
+
+	if (a->area != b->area)
+		return a->area < b->area ? 1 : -1;
+	return a->rank - b->rank;
+}
+
+
+/** Reorder the roots so the largest faces come first, keeping the
+ * order from the start face between faces of the same area.
+ */
+static void
+roots_by_area(
+	const face_t * const faces,
+	int * const roots,
+	const int n
+)
 {
+	root_area_t * const r = calloc(n, sizeof(*r));
+	for (int i = 0 ; i < n ; i++)
+	{
+		const real_t * const s = faces[roots[i]].sides;
+		const real_t p = (s[0] + s[1] + s[2]) / 2;
+		const real_t a2 = p * (p - s[0]) * (p - s[1]) * (p - s[2]);
+		r[i].area = a2 > 0 ? sqrt(a2) : 0;
+		r[i].rank = i;
+		r[i].id = roots[i];
+	}
+
+	qsort(r, n, sizeof(*r), root_area_cmp);
+	for (int i = 0 ; i < n ; i++)
+		roots[i] = r[i].id;
+	free(r);
+}
+
+
+/** Draw the mesh colored by group next to the layout, with each
+ * group's triangles in the same color in both.
+ */
+static void
+unfold_thumb(
+	const char * const filename,
+	const stl_face_t * const stl_faces,
+	const int num_triangles,
+	const sweep_tri_t * const layout,
+	const int * const layout_group,
+	const int layout_count
+)
+{
+	thumb_t * const thumb = thumb_alloc(2);
+	int * const group_of = calloc(num_triangles, sizeof(*group_of));
+	for (int i = 0 ; i < layout_count ; i++)
+		group_of[layout[i].id] = layout_group[i];
+
+	double min[3] = { INFINITY, INFINITY, INFINITY };
+	double max[3] = { -INFINITY, -INFINITY, -INFINITY };
+	for (int i = 0 ; i < num_triangles ; i++)
+		for (int k = 0 ; k < 3 ; k++)
+			for (int c = 0 ; c < 3 ; c++)
+			{
+				min[c] = fmin(min[c], stl_faces[i].p[k].p[c]);
+				max[c] = fmax(max[c], stl_faces[i].p[k].p[c]);
+			}
+
+	thumb_view_t view;
+	thumb_view(&view, 0, 1, min, max);
+	for (int i = 0 ; i < num_triangles ; i++)
+	{
+		double p[3][3];
+		for (int k = 0 ; k < 3 ; k++)
+		{
+			const double q[3] = {
+				stl_faces[i].p[k].p[0],
+				stl_faces[i].p[k].p[1],
+				stl_faces[i].p[k].p[2],
+			};
+			thumb_project(&view, q, p[k]);
+		}
+		thumb_triangle(thumb, p, thumb_color(group_of[i]));
+	}
+
+	// the layout is flat, at z = 0
+	min[0] = min[1] = INFINITY;
+	max[0] = max[1] = -INFINITY;
+	min[2] = max[2] = 0;
+	for (int i = 0 ; i < layout_count ; i++)
+		for (int k = 0 ; k < 3 ; k++)
+			for (int c = 0 ; c < 2 ; c++)
+			{
+				const double x = layout[i].p[k][c] + layout[i].off[c];
+				min[c] = fmin(min[c], x);
+				max[c] = fmax(max[c], x);
+			}
+
+	thumb_view(&view, 1, 0, min, max);
+	for (int i = 0 ; i < layout_count ; i++)
+	{
+		double xy[6];
+		for (int k = 0 ; k < 3 ; k++)
+		{
+			const double q[3] = {
+				layout[i].p[k][0] + layout[i].off[0],
+				layout[i].p[k][1] + layout[i].off[1],
+				0,
+			};
+			double out[3];
+			thumb_project(&view, q, out);
+			xy[2*k+0] = out[0];
+			xy[2*k+1] = out[1];
+		}
+		thumb_polygon(thumb, xy, 3, thumb_color(layout_group[i]));
+	}
+
+	if (thumb_write(thumb, filename) < 0)
+		err(EXIT_FAILURE, "%s", filename);
+
+	free(group_of);
+	thumb_free(thumb);
+}
+
+
+/** The class of the mesh, for picking its parameters. */
+static const char *
+faces_class(
+	const face_t * const faces,
+	const int num_triangles
+)
+{
+	int flat = 0;
+	for (int i = 0 ; i < num_triangles ; i++)
+		for (int e = 0 ; e < 3 ; e++)
+			flat += faces[i].coplanar[e] == 0;
+
+	return params_class(num_triangles, flat / (3.0 * num_triangles));
+}
+
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+"usage: unfold [-j threads] [-v] [-l] [-s] [-k seeds] [-p params] [-o pieces] [-t thumb.png] [-e estimate.json [-m profile]] < file.stl > file.svg\n"
+"\n"
+"-j N          Use N threads\n"
+"-l            Engrave matching labels on both sides of each cut edge\n"
+"-s            Start the pieces with developable strips, such as the\n"
+"              sides of cylinders and cones, each laid out whole\n"
+"-k N          Grow N groups at once from well separated faces\n"
+"-p file       Read the heuristic parameters for this class of mesh\n"
+"              from a file written by tune\n"
+"-v            Verify that no triangles overlap in the finished layout;\n"
+"              report any that do and exit with an error\n"
+"-o file       Write the outline and drawing of each piece for nest\n"
+"-t file       Draw a PNG thumbnail of the mesh and the layout\n"
+"-e file       Write the laser time and material estimate as JSON\n"
+"-m profile    Material and machine speeds for the estimate\n"
+	);
+	exit(EXIT_FAILURE);
+}
+
+
+int main(
+	int argc,
+	char ** argv
+)
+{
+	int verify = 0;
+	int use_strips = -1;
+	int num_seeds_wanted = -1;
+	const char * params_file = NULL;
+	const char * thumb_file = NULL;
+	FILE * pieces = NULL;
+	const char * estimate_file = NULL;
+	cost_profile_t profile;
+	cost_profile_default(&profile);
+
+	int opt;
+	while ((opt = getopt(argc, argv, "j:vlsk:p:o:t:e:m:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'j': pool_init(atoi(optarg)); break;
+		case 'v': verify = 1; break;
+		case 'l': draw_labels = 1; break;
+		case 's': use_strips = 1; break;
+		case 'k': num_seeds_wanted = atoi(optarg); break;
+		case 'p': params_file = optarg; break;
+		case 'o':
+			pieces = fopen(optarg, "w");
+			if (!pieces)
+				err(EXIT_FAILURE, "%s", optarg);
+			pieces_header(pieces);
+			break;
+		case 't': thumb_file = optarg; break;
+		case 'e': estimate_file = optarg; break;
+		case 'm':
+			if (cost_profile_load(&profile, optarg) < 0)
+				err(EXIT_FAILURE, "%s", optarg);
+			break;
+		default: usage();
+		}
+	}
+
+	cost_sheet_t sheet;
+	cost_sheet_init(&sheet);
+	if (estimate_file)
+		cost_sheet = &sheet;
+
 	const size_t max_len = 1 << 20;
 	uint8_t * const buf = calloc(max_len, 1);
 
@@ -722,23 +2163,55 @@ int main(void)
 		return EXIT_FAILURE;
 
 	const stl_header_t * const hdr = (const void*) buf;
-	const stl_face_t * const stl_faces = (const void*)(hdr+1);
 	const int num_triangles = hdr->num_triangles;
+	const stl_face_t * const stl_faces = stl_faces_load(
+		(const void*)(hdr+1),
+		num_triangles
+	);
 
 	fprintf(stderr, "header: '%s'\n", hdr->header);
 	fprintf(stderr, "num: %d\n", num_triangles);
 
 	face_t * const faces = stl2faces(stl_faces, num_triangles);
+	if (!faces)
+		return EXIT_FAILURE;
+
+	// the options on the command line win over the parameter file
+	params_default(&params);
+	if (params_file)
+	{
+		const char * const cls = faces_class(faces, num_triangles);
+		fprintf(stderr, "class: %s\n", cls);
+		if (params_load(&params, params_file, cls) < 0)
+			err(EXIT_FAILURE, "%s", params_file);
+	}
+	if (use_strips >= 0)
+		params.strips = use_strips;
+	if (num_seeds_wanted >= 0)
+		params.seeds = num_seeds_wanted;
+	if (params.strips && params.seeds)
+		errx(EXIT_FAILURE, "strips and seeds can not be used together");
+
+	group_t * const main_group = group_alloc(num_triangles);
+
+	// every triangle in its final position on the sheet
+	sweep_tri_t * const layout = calloc(num_triangles, sizeof(*layout));
+	int * const layout_group = calloc(num_triangles, sizeof(*layout_group));
+	int layout_count = 0;
 
 	// we now have a graph that shows the connection between
 	// all of the faces and their sizes. start trying to build
 	// non-overlapping groups of them
 	
-	printf("<svg xmlns=\"http://www.w3.org/2000/svg\">\n");
+	if (draw_labels)
+		printf("<svg xmlns=\"http://www.w3.org/2000/svg\""
+			" xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n");
+	else
+		printf("<svg xmlns=\"http://www.w3.org/2000/svg\">\n");
 	poly_t origin = { };
 
-	float last_x = 0;
-	float last_y = 0;
+	real_t last_x = 0;
+	real_t last_y = 0;
 
 	srand48(getpid());
 
@@ -750,40 +2223,101 @@ int main(void)
 	else
 		offset = lrand48();
 	fprintf(stderr, "Starting at poly %d\n", offset % num_triangles);
-	int group_count = 0;
+
+	// the roots of the groups: the strips, if they are in use,
+	// then every face in turn from the offset.
+	int * const roots = calloc(2 * num_triangles, sizeof(*roots));
+	int num_roots = 0;
+	strips_t strips = { 0 };
+	poly_t ** const poly_of = calloc(num_triangles, sizeof(*poly_of));
+
+	if (params.strips)
+	{
+		strips_find(&strips, stl_faces, faces, num_triangles, offset);
+		for (int s = 0 ; s < strips.count ; s++)
+			roots[num_roots++] = strips.face[strips.start[s]];
+		fprintf(stderr, "strips: %d developable, %d triangles\n",
+			strips.count,
+			strips.count ? strips.start[strips.count] : 0
+		);
+	}
 
 	for (int i = 0 ; i < num_triangles ; i++)
+		roots[num_roots++] = (i + offset) % num_triangles;
+	if (params.start == PARAMS_START_LARGEST)
+		roots_by_area(faces, roots + num_roots - num_triangles,
+			num_triangles);
+
+	int group_count = 0;
+
+	// each group is rendered to a buffer so that the output
+	// size can be reported as it goes.
+	char * group_buf = NULL;
+	size_t group_len = 0;
+
+	progress_start("place", num_triangles);
+
+	// the seeded groups are already grown, so they come first
+	seed_t * seeds = NULL;
+	const int num_seeds = params.seeds
+		? seeds_grow(faces, num_triangles, offset, params.seeds, &seeds)
+		: 0;
+
+	for (int i = 0 ; i < num_seeds + num_roots ; i++)
 	{
-		face_t * const f = &faces[(i+offset) % num_triangles];
-		if (f->used)
-			continue;
-		poly_t g = {
-			.face	= f,
-			.start_edge	= 0,
-		};
-		poly_position(&g, &origin, 0, 0, 0);
-
-		// set the root of the new group
-		poly_root = &g;
-		poly_min[0] = poly_min[1] = 0;
-		poly_max[0] = poly_max[1] = 0;
-
-		poly_t * iter = &g;
+		group_t * group = main_group;
+		poly_t * root;
 		int poly_count = 0;
-		group_count++;
-
-		if (debug) fprintf(stderr, "****** %d: New group %p\n",
-			group_count, poly_root);
 
-		while (iter)
+		if (i < num_seeds)
 		{
-			poly_build(iter);
-			iter = iter->work_next;
-			poly_count++;
+			group = seeds[i].group;
+			root = seeds[i].root;
+			poly_count = group->count;
+			group_count++;
+		} else {
+			face_t * const f = &faces[roots[i - num_seeds]];
+			if (f->used)
+				continue;
+			root = calloc(1, sizeof(*root));
+			root->face = f;
+			poly_position(root, &origin, 0, 0, 0);
+
+			// set the root of the new group
+			group_start(group, root);
+			trace_event(TRACE_GROUP, f->id, -1, 0, 0, -1);
+
+			if (params.strips && strips.strip[f->id] >= 0
+			&& strips.parent[f->id] < 0)
+				strip_place(group, &strips, faces,
+					strips.strip[f->id], root, poly_of);
+
+			poly_t * iter = root;
+			group_count++;
+
+			if (debug) fprintf(stderr, "****** %d: New group %p\n",
+				group_count, group->root);
+
+			while (iter)
+			{
+				poly_build(group, iter);
+				iter = iter->work_next;
+				poly_count++;
+				progress_add(1);
+			}
 		}
 
-		fprintf(stderr, "group %d: %d triangles\n",
-			group_count, poly_count);
+		if (debug)
+			outline_verify(group);
+
+		progress_clear();
+		fprintf(stderr, "group %d: %d triangles, %d outline edges, area %.2f, perimeter %.2f\n",
+			group_count,
+			poly_count,
+			group->outline_len,
+			group->area,
+			group->perimeter
+		);
 
 		// todo: walk the generated polygon and attempt to add tabs
 		// to edges where they fit
@@ -791,19 +2325,105 @@ int main(void)
 
 		// offset the poly so that it doesn't overlap the ones
 		// we've already generated. only shift in Y.
-		float off_x = last_x - poly_min[0];
-		float off_y = last_y - poly_min[1];
-		last_y = off_y + poly_max[1];
+		real_t off_x = last_x - group->min[0];
+		real_t off_y = last_y - group->min[1];
+		last_y = off_y + group->max[1];
 
 		// \todo: generate lots of poly sets before we print
 		// to find a minimal set. perhaps vary the search rules?
 
+		for (poly_t * p = root ; p ; p = p->work_next)
+		{
+			layout_group[layout_count] = group_count;
+			sweep_tri_t * const t = &layout[layout_count++];
+			t->id = p->face - faces;
+			t->off[0] = off_x;
+			t->off[1] = off_y;
+			memcpy(t->p, p->p, sizeof(t->p));
+		}
+
+		sheet.offset[0] = off_x;
+		sheet.offset[1] = off_y;
+		cost_part(&sheet, group->area);
+
+		FILE * const out = open_memstream(&group_buf, &group_len);
+		poly_print(out, root);
+		fclose(out);
+
 		printf("<g transform=\"translate(%f %f)\">\n", off_x, off_y);
-		poly_print(&g);
+		fwrite(group_buf, 1, group_len, stdout);
 		printf("</g>\n");
+		progress_emit(group_len);
+
+		if (pieces)
+			group_piece(pieces, group, group_count, group_buf, group_len);
+	}
+
+	if (draw_labels)
+	{
+		printf("<defs>\n");
+		svg_glyph_defs(stdout);
+		printf("</defs>\n");
+
+		if (pieces)
+		{
+			char * defs = NULL;
+			size_t defs_len = 0;
+			FILE * const out = open_memstream(&defs, &defs_len);
+			svg_glyph_defs(out);
+			fclose(out);
+			pieces_defs(pieces, defs, defs_len);
+			free(defs);
+		}
+
+		if (labels_skipped)
+			fprintf(stderr, "%d edges too short to label\n",
+				labels_skipped);
 	}
 
 	printf("</svg>\n");
+	progress_end();
+	free(group_buf);
 
-	return 0;
+	if (pieces)
+		fclose(pieces);
+
+	if (estimate_file)
+	{
+		FILE * const f = fopen(estimate_file, "w");
+		if (!f)
+			err(EXIT_FAILURE, "%s", estimate_file);
+		cost_json(f, &profile, &sheet, 1);
+		fclose(f);
+	}
+
+	if (thumb_file)
+		unfold_thumb(thumb_file, stl_faces, num_triangles,
+			layout, layout_group, layout_count);
+
+	if (!verify)
+		return 0;
+
+	// the positions are built up by chains of rotations in
+	// single precision, so neighbors can be off by more than EPS.
+	// anything under 10 microns is far below the laser kerf.
+	int * pairs;
+	const int num_pairs = sweep_overlaps(
+		layout,
+		layout_count,
+		0.01,
+		&pairs
+	);
+	for (int i = 0 ; i < num_pairs ; i++)
+		fprintf(stderr, "overlap: face %d and face %d\n",
+			pairs[2*i+0],
+			pairs[2*i+1]
+		);
+
+	fprintf(stderr, "layout: %d triangles, %d overlapping pairs\n",
+		layout_count,
+		num_pairs
+	);
+
+	return num_pairs ? EXIT_FAILURE : 0;
 }
@@ -8,13 +8,24 @@
 
 #define EPS 0.0001
 
+/** The geometry is computed in single precision by default, which
+ * is fast and compact for small meshes.  Building with
+ * -DPAPERCRAFT_DOUBLE switches every v3_t and kernel to double
+ * precision for large models far from the origin.
+ */
+#ifdef PAPERCRAFT_DOUBLE
+typedef double real_t;
+#else
+typedef float real_t;
+#endif
+
 #ifndef M_PI
 #define 	M_PI   3.1415926535897932384
 #endif
 
-static inline float
+static inline real_t
 sign(
-	const float x
+	const real_t x
 )
 {
 	if (x < 0)
@@ -28,19 +39,47 @@ sign(
 
 typedef struct
 {
-	float p[3];
+	real_t p[3];
 } v3_t;
 
 
+/** Single precision vector, as stored in STL files. */
+typedef struct
+{
+	float p[3];
+} v3f_t;
+
+
+static inline v3_t
+v3f_load(
+	const v3f_t v
+)
+{
+	v3_t c = { .p = { v.p[0], v.p[1], v.p[2] } };
+	return c;
+}
+
+
+/** Structure-of-arrays storage for batches of vectors.
+ * See v3_batch.h for the operations on them.
+ */
+typedef struct
+{
+	real_t * x;
+	real_t * y;
+	real_t * z;
+} v3_soa_t;
+
+
 static inline int
 v3_eq(
 	const v3_t * v1,
 	const v3_t * v2
 )
 {
-	float dx = v1->p[0] - v2->p[0];
-	float dy = v1->p[1] - v2->p[1];
-	float dz = v1->p[2] - v2->p[2];
+	real_t dx = v1->p[0] - v2->p[0];
+	real_t dy = v1->p[1] - v2->p[1];
+	real_t dz = v1->p[2] - v2->p[2];
 
 	if (-EPS < dx && dx < EPS
 	&&  -EPS < dy && dy < EPS
@@ -57,9 +96,9 @@ v3_len(
 	const v3_t * const v1
 )
 {
-	float dx = v0->p[0] - v1->p[0];
-	float dy = v0->p[1] - v1->p[1];
-	float dz = v0->p[2] - v1->p[2];
+	real_t dx = v0->p[0] - v1->p[0];
+	real_t dy = v0->p[1] - v1->p[1];
+	real_t dz = v0->p[2] - v1->p[2];
 
 	return sqrt(dx*dx + dy*dy + dz*dz);
 }
@@ -69,9 +108,9 @@ v3_mag(
 	const v3_t v0
 )
 {
-	float dx = v0.p[0];
-	float dy = v0.p[1];
-	float dz = v0.p[2];
+	real_t dx = v0.p[0];
+	real_t dy = v0.p[1];
+	real_t dz = v0.p[2];
 
 	return sqrt(dx*dx + dy*dy + dz*dz);
 }
@@ -109,7 +148,7 @@ v3_sub(
 static inline v3_t
 v3_scale(
 	v3_t a,
-	float s
+	real_t s
 )
 {
 	v3_t c = { .p = {
@@ -149,7 +188,7 @@ v3_mid(
 
 
 
-static inline float
+static inline real_t
 v3_dot(
 	v3_t a,
 	v3_t b
@@ -165,13 +204,13 @@ v3_cross(
 	v3_t v
 )
 {
-	float u1 = u.p[0];
-	float u2 = u.p[1];
-	float u3 = u.p[2];
+	real_t u1 = u.p[0];
+	real_t u2 = u.p[1];
+	real_t u3 = u.p[2];
 
-	float v1 = v.p[0];
-	float v2 = v.p[1];
-	float v3 = v.p[2];
+	real_t v1 = v.p[0];
+	real_t v2 = v.p[1];
+	real_t v3 = v.p[2];
 
 	v3_t c = { .p = {
 		u2*v3 - u3*v2,
@@ -0,0 +1,159 @@
+/** \file
+ * Batch 3D vector operations on structure-of-arrays storage.
+ *
+ * These are the v3.h operations applied to n vectors at a time,
+ * dispatched to the SIMD kernels in simd.c.  Each one computes
+ * exactly the same values as the scalar function it is
+ * named after.  The output may be the same arrays as an input.
+ */
+#ifndef _papercraft_v3_batch_h_
+#define _papercraft_v3_batch_h_
+
+#include <stdlib.h>
+#include "v3.h"
+#include "simd.h"
+
+
+static inline v3_soa_t
+v3_soa_alloc(
+	const int n
+)
+{
+	real_t * const buf = calloc(3 * (n ? n : 1), sizeof(*buf));
+	v3_soa_t v = {
+		.x = buf + 0 * n,
+		.y = buf + 1 * n,
+		.z = buf + 2 * n,
+	};
+	return v;
+}
+
+
+static inline void
+v3_soa_free(
+	v3_soa_t * const v
+)
+{
+	free(v->x);
+	v->x = v->y = v->z = NULL;
+}
+
+
+static inline void
+v3_soa_set(
+	const v3_soa_t * const v,
+	const int i,
+	const v3_t p
+)
+{
+	v->x[i] = p.p[0];
+	v->y[i] = p.p[1];
+	v->z[i] = p.p[2];
+}
+
+
+static inline v3_t
+v3_soa_get(
+	const v3_soa_t * const v,
+	const int i
+)
+{
+	v3_t p = { .p = { v->x[i], v->y[i], v->z[i] } };
+	return p;
+}
+
+
+/** out = a + b */
+static inline void
+v3_batch_add(
+	const int n,
+	const v3_soa_t * const a,
+	const v3_soa_t * const b,
+	const v3_soa_t * const out
+)
+{
+	simd_ops->v3_add(n, a, b, out);
+}
+
+
+/** out = a - b */
+static inline void
+v3_batch_sub(
+	const int n,
+	const v3_soa_t * const a,
+	const v3_soa_t * const b,
+	const v3_soa_t * const out
+)
+{
+	simd_ops->v3_sub(n, a, b, out);
+}
+
+
+/** out = a X b */
+static inline void
+v3_batch_cross(
+	const int n,
+	const v3_soa_t * const a,
+	const v3_soa_t * const b,
+	const v3_soa_t * const out
+)
+{
+	simd_ops->v3_cross(n, a, b, out);
+}
+
+
+/** out = a . b */
+static inline void
+v3_batch_dot(
+	const int n,
+	const v3_soa_t * const a,
+	const v3_soa_t * const b,
+	real_t * const out
+)
+{
+	simd_ops->v3_dot(n, a, b, out);
+}
+
+
+/** out = |a|, the length of each vector. */
+static inline void
+v3_batch_mag(
+	const int n,
+	const v3_soa_t * const a,
+	real_t * const out
+)
+{
+	simd_ops->v3_mag(n, a, out);
+}
+
+
+/** out = a / |a| */
+static inline void
+v3_batch_norm(
+	const int n,
+	const v3_soa_t * const a,
+	const v3_soa_t * const out
+)
+{
+	simd_ops->v3_norm(n, a, out);
+}
+
+
+/** Project points onto the plane with the given origin and
+ * x and y axes, as v3_project() does for one point.
+ */
+static inline void
+v3_batch_project(
+	const int n,
+	const v3_t * const origin,
+	const v3_t * const x,
+	const v3_t * const y,
+	const v3_soa_t * const p,
+	real_t * const x_out,
+	real_t * const y_out
+)
+{
+	simd_ops->v3_project(n, origin, x, y, p, x_out, y_out);
+}
+
+#endif
@@ -11,6 +11,12 @@
 #include <err.h>
 #include <assert.h>
 #include "v3.h"
+#include "pool.h"
+#include "progress.h"
+#include "orient.h"
+#include "cutlist.h"
+#include "simd.h"
+#include "thumb.h"
 
 #ifndef M_PI
 #define 	M_PI   3.1415926535897932384
@@ -29,11 +35,36 @@ stl_header_t;
 
 typedef struct
 {
-	v3_t normal;
-	v3_t p[3];
+	v3f_t normal;
+	v3f_t p[3];
 	uint16_t attr;
 } __attribute__((__packed__))
-stl_face_t;
+stl_file_face_t;
+
+
+/** In-memory triangle, in the working precision. */
+typedef struct
+{
+	v3_t normal;
+	v3_t p[3];
+} stl_face_t;
+
+
+static stl_face_t *
+stl_faces_load(
+	const stl_file_face_t * const ft,
+	const int num_triangles
+)
+{
+	stl_face_t * const f = calloc(num_triangles, sizeof(*f));
+	for (int i = 0 ; i < num_triangles ; i++)
+	{
+		f[i].normal = v3f_load(ft[i].normal);
+		for (int j = 0 ; j < 3 ; j++)
+			f[i].p[j] = v3f_load(ft[i].p[j]);
+	}
+	return f;
+}
 
 
 #define MAX_VERTEX 64
@@ -42,6 +73,7 @@ typedef struct stl_vertex stl_vertex_t;
 
 struct stl_vertex
 {
+	int id;
 	v3_t p;
 	int num_edges;
 	stl_vertex_t * edges[MAX_VERTEX];
@@ -110,7 +142,7 @@ coplanar_check(
 	v3_t dx21 = v3_sub(x2, x1);
 	v3_t dx43 = v3_sub(x4, x3);
 	v3_t cross = v3_cross(dx21, dx43);
-	float dot = v3_dot(dx31, cross);
+	real_t dot = v3_dot(dx31, cross);
 
 	if (debug)
 	fprintf(stderr, "dot %f:\n %f,%f,%f\n %f,%f,%f\n %f,%f,%f\n %f,%f,%f\n",
@@ -171,22 +203,22 @@ stl_edge_insert(
 }
 
 
+/** Find or create a vertex.
+ * xyz[] mirrors the vertex positions for the SIMD search.
+ */
 stl_vertex_t *
 stl_vertex_find(
 	stl_vertex_t ** const vertices,
+	real_t * const xyz[3],
 	int * num_vertex_ptr,
 	const v3_t * const p
 )
 {
 	const int num_vertex = *num_vertex_ptr;
 
-	for (int x = 0 ; x < num_vertex ; x++)
-	{
-		stl_vertex_t * const v = vertices[x];
-
-		if (v3_eq(&v->p, p))
-			return v;
-	}
+	const int x = simd_find_point(xyz[0], xyz[1], xyz[2], num_vertex, p->p);
+	if (x >= 0)
+		return vertices[x];
 
 	if (debug)
 	fprintf(stderr, "%d: %f,%f,%f\n",
@@ -204,14 +236,387 @@ stl_vertex_find(
 	);
 
 	stl_vertex_t * const v = vertices[(*num_vertex_ptr)++] = calloc(1, sizeof(*v));
+	v->id = num_vertex;
 	v->p = *p;
+	xyz[0][num_vertex] = p->p[0];
+	xyz[1][num_vertex] = p->p[1];
+	xyz[2][num_vertex] = p->p[2];
 	return v;
 }
 
 
 
-int main(void)
+typedef struct
+{
+	const stl_face_t * stl_faces;
+	int num_triangles;
+	uint8_t * coplanar_mask;
+} coplanar_arg_t;
+
+
+/** Compute the coplanar edge mask of each triangle in [start,end). */
+static void
+coplanar_masks(
+	void * const arg_ptr,
+	const int start,
+	const int end
+)
+{
+	const coplanar_arg_t * const arg = arg_ptr;
+
+	for (int i = start ; i < end ; i++)
+	{
+		// walk all of other triangles to figure out if
+		// any of the triangles are coplanar and have shared
+		// edges.
+		uint8_t coplanar_mask = 0;
+		for (int j = 0 ; j < arg->num_triangles ; j++)
+		{
+			if (j == i)
+				continue;
+
+			if (debug)
+			fprintf(stderr, "check %d -> %d\n", i, j);
+
+			coplanar_mask |= coplanar_check(
+				&arg->stl_faces[i], &arg->stl_faces[j]);
+		}
+
+		arg->coplanar_mask[i] = coplanar_mask;
+		progress_add(1);
+	}
+}
+
+
+typedef struct
+{
+	stl_vertex_t ** vertices;
+	real_t thick;
+	int do_square;
+
+	// if laying the connectors out to print, the orientation of
+	// each and the spacing of the grid they are placed on
+	orient_t * orient;
+	int columns;
+	real_t spacing;
+} connector_arg_t;
+
+
+/** Describe the connector at vertex i, relative to the vertex,
+ * for the orientation search.
+ */
+static void
+connector_part(
+	const connector_arg_t * const arg,
+	const int i,
+	orient_part_t * const part
+)
+{
+	const stl_vertex_t * const v = arg->vertices[i];
+	const real_t r = arg->thick/2 + 2;
+	const v3_t origin = {{ 0, 0, 0 }};
+
+	orient_sphere(part, origin, r);
+
+	for (int j = 0 ; j < v->num_edges ; j++)
+	{
+		const v3_t d = v3_sub(v->edges[j]->p, v->p);
+		const real_t len = v3_mag(d);
+		const v3_t axis = v3_scale(d, 1 / len);
+
+		if (arg->do_square)
+			orient_cylinder(part, origin, axis, r, 2 * arg->thick);
+		else
+			orient_cylinder(part, origin, axis, 1, len * .45);
+	}
+}
+
+
+/** Find the best print orientation of each connector in [start,end). */
+static void
+connector_orient(
+	void * const arg_ptr,
+	const int start,
+	const int end
+)
+{
+	const connector_arg_t * const arg = arg_ptr;
+
+	for (int i = start ; i < end ; i++)
+	{
+		orient_part_t part;
+		orient_part_init(&part);
+		connector_part(arg, i, &part);
+		arg->orient[i] = orient_best(&part);
+		orient_part_free(&part);
+		progress_add(1);
+	}
+}
+
+
+/** Generate the connector for one vertex. */
+static void
+connector_print(
+	void * const arg_ptr,
+	const int i,
+	FILE * const out
+)
+{
+	const connector_arg_t * const arg = arg_ptr;
+	const real_t thick = arg->thick;
+	stl_vertex_t * const v = arg->vertices[i];
+
+	if (arg->orient)
+	{
+		// on a grid on the print bed, in its best orientation
+		orient_multmatrix(out, &arg->orient[i],
+			(i % arg->columns) * arg->spacing,
+			(i / arg->columns) * arg->spacing
+		);
+		fprintf(out, "{\n");
+	} else
+	fprintf(out, "translate([%f,%f,%f]) {\n",
+		v->p.p[0],
+		v->p.p[1],
+		v->p.p[2]
+	);
+	
+	fprintf(out, "sphere(r=%f); // %d %p\n", thick/2+2, i, v);
+
+	for (int j = 0 ; j < v->num_edges ; j++)
+	{
+		stl_vertex_t * const v2 = v->edges[j];
+		const v3_t d = v3_sub(v2->p, v->p);
+		const real_t len = v3_len(&v2->p, &v->p);
+
+		const real_t b = acos(d.p[2] / len) * 180/M_PI;
+		const real_t c = d.p[0] == 0 ? sign(d.p[1]) * 90 : atan2(d.p[1], d.p[0]) * 180/M_PI;
+//
+		fprintf(out, "rotate([0,%f,%f]) ", b, c);
+
+		if (arg->do_square)
+			fprintf(out, "connector(%f);\n", len);
+		else
+			fprintf(out, " cylinder(r=1, h=%f); // %p\n",
+				len*.45,
+				v2
+			);
+	}
+
+	fprintf(out, "}\n");
+}
+
+
+/** Each edge between two vertices, once. */
+typedef struct
+{
+	stl_vertex_t * v1;
+	stl_vertex_t * v2;
+	double target;		// center to center, after clustering
+} strut_t;
+
+
+static int
+struts_find(
+	stl_vertex_t ** const vertices,
+	const int num_vertex,
+	strut_t ** const struts_out
+)
 {
+	int num_struts = 0;
+	for (int i = 0 ; i < num_vertex ; i++)
+		num_struts += vertices[i]->num_edges;
+
+	strut_t * const struts = calloc(num_struts + 1, sizeof(*struts));
+	num_struts = 0;
+
+	for (int i = 0 ; i < num_vertex ; i++)
+	{
+		stl_vertex_t * const v = vertices[i];
+		for (int j = 0 ; j < v->num_edges ; j++)
+		{
+			stl_vertex_t * const v2 = v->edges[j];
+
+			// the other end lists it too, unless the edges
+			// were only inserted one way around
+			int back = 0;
+			for (int k = 0 ; k < v2->num_edges ; k++)
+				if (v2->edges[k] == v)
+					back = 1;
+			if (back && v2->id < v->id)
+				continue;
+
+			struts[num_struts++] = (strut_t) {
+				.v1	= v,
+				.v2	= v2,
+			};
+		}
+	}
+
+	*struts_out = struts;
+	return num_struts;
+}
+
+
+/** Move the vertices so that each strut is as close as possible to
+ * its target length, by repeatedly splitting the error of each
+ * strut between its two ends.
+ * \return the largest remaining error.
+ */
+static double
+struts_adjust(
+	strut_t * const struts,
+	const int num_struts,
+	stl_vertex_t ** const vertices,
+	const int num_vertex,
+	const double tol
+)
+{
+	v3_t * const delta = calloc(num_vertex + 1, sizeof(*delta));
+	int * const count = calloc(num_vertex + 1, sizeof(*count));
+	double max_err = 0;
+
+	for (int iter = 0 ; iter < 1000 ; iter++)
+	{
+		max_err = 0;
+		for (int i = 0 ; i < num_vertex ; i++)
+		{
+			delta[i] = (v3_t) {{ 0, 0, 0 }};
+			count[i] = 0;
+		}
+
+		for (int i = 0 ; i < num_struts ; i++)
+		{
+			const strut_t * const s = &struts[i];
+			const v3_t d = v3_sub(s->v2->p, s->v1->p);
+			const double len = v3_mag(d);
+			const double e = len - s->target;
+			if (fabs(e) > max_err)
+				max_err = fabs(e);
+
+			const v3_t move = v3_scale(d, e / len / 2);
+			delta[s->v1->id] = v3_add(delta[s->v1->id], move);
+			delta[s->v2->id] = v3_sub(delta[s->v2->id], move);
+			count[s->v1->id]++;
+			count[s->v2->id]++;
+		}
+
+		if (max_err < tol / 100)
+			break;
+
+		for (int i = 0 ; i < num_vertex ; i++)
+			if (count[i])
+				vertices[i]->p = v3_add(vertices[i]->p,
+					v3_scale(delta[i], 1.0 / count[i]));
+	}
+
+	free(delta);
+	free(count);
+	return max_err;
+}
+
+
+/** Draw the mesh in grey with the struts, the edges that are not
+ * flat, over it in black.
+ */
+static void
+wireframe_thumb(
+	const char * const filename,
+	const stl_face_t * const stl_faces,
+	const uint8_t * const coplanar_mask,
+	const int num_triangles
+)
+{
+	thumb_t * const thumb = thumb_alloc(1);
+
+	double min[3] = { INFINITY, INFINITY, INFINITY };
+	double max[3] = { -INFINITY, -INFINITY, -INFINITY };
+	for (int i = 0 ; i < num_triangles ; i++)
+		for (int k = 0 ; k < 3 ; k++)
+			for (int c = 0 ; c < 3 ; c++)
+			{
+				min[c] = fmin(min[c], stl_faces[i].p[k].p[c]);
+				max[c] = fmax(max[c], stl_faces[i].p[k].p[c]);
+			}
+
+	thumb_view_t view;
+	thumb_view(&view, 0, 1, min, max);
+
+	double (* const p)[3][3] = calloc(num_triangles + 1, sizeof(*p));
+	for (int i = 0 ; i < num_triangles ; i++)
+	{
+		for (int k = 0 ; k < 3 ; k++)
+		{
+			const double q[3] = {
+				stl_faces[i].p[k].p[0],
+				stl_faces[i].p[k].p[1],
+				stl_faces[i].p[k].p[2],
+			};
+			thumb_project(&view, q, p[i][k]);
+		}
+		thumb_triangle(thumb, p[i], 0xD0D0D0);
+	}
+
+	for (int i = 0 ; i < num_triangles ; i++)
+		for (int j = 0 ; j < 3 ; j++)
+			if ((coplanar_mask[i] & (1 << j)) == 0)
+				thumb_edge(thumb, p[i][j], p[i][(j+1) % 3], 1, 0x202020);
+
+	if (thumb_write(thumb, filename) < 0)
+		err(EXIT_FAILURE, "%s", filename);
+
+	free(p);
+	thumb_free(thumb);
+}
+
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+"usage: wireframe [-j threads] [-p] [-b bom.tsv [-t mm] [-a]] [-i thumb.png] < file.stl > file.scad\n"
+"\n"
+"-j N          Use N threads\n"
+"-p            Lay the connectors out on the print bed, each turned to\n"
+"              need the least support, instead of in place on the model\n"
+"-b file       Write the strut cut list, with the lengths grouped into\n"
+"              as few sizes as the tolerance allows\n"
+"-t mm         Tolerance for grouping strut lengths (default 0.5)\n"
+"-a            Move the vertices so the struts are the grouped lengths\n"
+"-i file       Draw a PNG thumbnail of the mesh and its struts\n"
+	);
+	exit(EXIT_FAILURE);
+}
+
+
+int main(
+	int argc,
+	char ** argv
+)
+{
+	int print_layout = 0;
+	const char * bom_file = NULL;
+	double tolerance = 0.5;
+	int adjust = 0;
+	const char * thumb_file = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:pb:t:ai:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'j': pool_init(atoi(optarg)); break;
+		case 'p': print_layout = 1; break;
+		case 'b': bom_file = optarg; break;
+		case 't': tolerance = atof(optarg); break;
+		case 'a': adjust = 1; break;
+		case 'i': thumb_file = optarg; break;
+		default: usage();
+		}
+	}
+
+	if (adjust && !bom_file)
+		usage();
+
 	const size_t max_len = 1 << 20;
 	uint8_t * const buf = calloc(max_len, 1);
 
@@ -220,9 +625,12 @@ int main(void)
 		return EXIT_FAILURE;
 
 	const stl_header_t * const hdr = (const void*) buf;
-	const stl_face_t * const stl_faces = (const void*)(hdr+1);
 	const int num_triangles = hdr->num_triangles;
-	const float thick = 7.8;
+	const stl_face_t * const stl_faces = stl_faces_load(
+		(const void*)(hdr+1),
+		num_triangles
+	);
+	const real_t thick = 7.8;
 	const int do_square = 1;
 
 	fprintf(stderr, "header: '%s'\n", hdr->header);
@@ -233,35 +641,37 @@ int main(void)
 	stl_vertex_t ** const vertices = calloc(3*num_triangles, sizeof(*vertices));
 
 	int num_vertex = 0;
-
+	real_t * const xyz[3] = {
+		calloc(3*num_triangles, sizeof(real_t)),
+		calloc(3*num_triangles, sizeof(real_t)),
+		calloc(3*num_triangles, sizeof(real_t)),
+	};
+
+	// the coplanar checks only read the triangles, so they
+	// can all be done in parallel before building the edges.
+	coplanar_arg_t coplanar_arg = {
+		.stl_faces	= stl_faces,
+		.num_triangles	= num_triangles,
+		.coplanar_mask	= calloc(num_triangles, sizeof(uint8_t)),
+	};
+	progress_start("coplanar", num_triangles);
+	pool_for(0, num_triangles, 8, coplanar_masks, &coplanar_arg);
+
+	progress_start("weld", num_triangles);
 	for(int i = 0 ; i < num_triangles ; i++)
 	{
 		if (debug) fprintf(stderr, "---------- triangle %d (%d)\n", i, num_vertex);
+		progress_add(1);
 
 		stl_vertex_t * vp[3] = {};
 
 		for (int j = 0 ; j < 3 ; j++)
 		{
 			const v3_t * const p = &stl_faces[i].p[j];
-			vp[j] = stl_vertex_find(vertices, &num_vertex, p);
+			vp[j] = stl_vertex_find(vertices, xyz, &num_vertex, p);
 		}
 
-		// walk all of other triangles to figure out if
-		// any of the triangles are coplanar and have shared
-		// edges.
-
-		uint8_t coplanar_mask = 0;
-		for (int j = 0 ; j < num_triangles ; j++)
-		{
-			if (j == i)
-				continue;
-
-			if (debug)
-			fprintf(stderr, "%d: check %d -> %d\n", num_vertex, i, j);
-
-			coplanar_mask |= coplanar_check(
-				&stl_faces[i], &stl_faces[j]);
-		}
+		const uint8_t coplanar_mask = coplanar_arg.coplanar_mask[i];
 
 		if (debug)
 			fprintf(stderr, "mask %d\n", coplanar_mask);
@@ -294,7 +704,74 @@ int main(void)
 		}
 	}
 
+	progress_end();
 	fprintf(stderr, "%d unique vertices\n", num_vertex);
+
+	if (thumb_file)
+		wireframe_thumb(thumb_file, stl_faces,
+			coplanar_arg.coplanar_mask, num_triangles);
+
+	if (bom_file)
+	{
+		// the dowels stop at the bottom of each socket's bore
+		const double allowance = 2 * (thick/2 + 2);
+
+		strut_t * struts;
+		const int num_struts = struts_find(vertices, num_vertex, &struts);
+		double * const len = calloc(num_struts + 1, sizeof(*len));
+		int * const bin = calloc(num_struts + 1, sizeof(*bin));
+		int * const cut = calloc(num_struts + 1, sizeof(*cut));
+
+		// struts that do not reach past both bores have nothing to
+		// cut; they are reported and kept out of the bins.
+		int num_cut = 0;
+		for (int i = 0 ; i < num_struts ; i++)
+		{
+			const double l = v3_len(&struts[i].v1->p, &struts[i].v2->p);
+			if (l > allowance)
+			{
+				cut[num_cut] = i;
+				len[num_cut++] = l - allowance;
+				continue;
+			}
+
+			warnx("strut %d-%d is %.2f mm, shorter than the %.2f mm the sockets take",
+				struts[i].v1->id,
+				struts[i].v2->id,
+				l, allowance);
+		}
+
+		cutlist_bin_t * bins;
+		const int num_bins = cutlist_cluster(len, num_cut, tolerance, bin, &bins);
+		fprintf(stderr, "cut list: %d struts in %d lengths, %d too short\n",
+			num_cut, num_bins, num_struts - num_cut);
+
+		FILE * const f = fopen(bom_file, "w");
+		if (!f)
+			err(EXIT_FAILURE, "%s", bom_file);
+		cutlist_print(f, bins, num_bins, tolerance, allowance);
+		fclose(f);
+
+		if (adjust)
+		{
+			// the short struts are held at their own length
+			for (int i = 0 ; i < num_struts ; i++)
+				struts[i].target = v3_len(&struts[i].v1->p, &struts[i].v2->p);
+			for (int i = 0 ; i < num_cut ; i++)
+				struts[cut[i]].target = bins[bin[i]].length + allowance;
+
+			const double max_err = struts_adjust(struts, num_struts,
+				vertices, num_vertex, tolerance);
+			fprintf(stderr, "adjusted vertices: largest strut error %.3f mm\n",
+				max_err);
+		}
+
+		free(struts);
+		free(len);
+		free(bin);
+		free(cut);
+		free(bins);
+	}
 	printf("thick=%f;\n"
 		"module connector(len) {\n"
 		"  render() difference() {\n"
@@ -308,39 +785,58 @@ int main(void)
 		thick
 	);
 
-	for (int i = 0 ; i < num_vertex ; i++)
-	{
-		stl_vertex_t * const v = vertices[i];
-		printf("translate([%f,%f,%f]) {\n",
-			v->p.p[0],
-			v->p.p[1],
-			v->p.p[2]
-		);
-		
-		printf("sphere(r=%f); // %d %p\n", thick/2+2, i, v);
+	connector_arg_t connector_arg = {
+		.vertices	= vertices,
+		.thick		= thick,
+		.do_square	= do_square,
+	};
 
-		for (int j = 0 ; j < v->num_edges ; j++)
+	if (print_layout)
+	{
+		connector_arg.orient = calloc(num_vertex + 1, sizeof(*connector_arg.orient));
+		progress_start("orient", num_vertex);
+		pool_for(0, num_vertex, 1, connector_orient, &connector_arg);
+
+		// compare against printing them as they sit in the model
+		real_t support = 0, height = 0;
+		real_t base_support = 0, base_height = 0;
+		real_t size = 0;
+		for (int i = 0 ; i < num_vertex ; i++)
 		{
-			stl_vertex_t * const v2 = v->edges[j];
-			const v3_t d = v3_sub(v2->p, v->p);
-			const float len = v3_len(&v2->p, &v->p);
+			const orient_t * const o = &connector_arg.orient[i];
+			orient_part_t part;
+			orient_part_init(&part);
+			connector_part(&connector_arg, i, &part);
+			const orient_t base = orient_score(&part, (v3_t) {{ 0, 0, 1 }});
+
+			// room for it to turn on the spot
+			for (int k = 0 ; k < part.num_point ; k++)
+			{
+				const real_t d = v3_mag(part.point[k]);
+				if (d > size)
+					size = d;
+			}
+			orient_part_free(&part);
 
-			const float b = acos(d.p[2] / len) * 180/M_PI;
-			const float c = d.p[0] == 0 ? sign(d.p[1]) * 90 : atan2(d.p[1], d.p[0]) * 180/M_PI;
-//
-			printf("rotate([0,%f,%f]) ", b, c);
-
-			if (do_square)
-				printf("connector(%f);\n", len);
-			else
-				printf(" cylinder(r=1, h=%f); // %p\n",
-					len*.45,
-					v2
-				);
+			support += o->support;
+			height += o->height;
+			base_support += base.support;
+			base_height += base.height;
 		}
 
-		printf("}\n");
+		fprintf(stderr, "orient: support %.0f -> %.0f mm^3, total height %.0f -> %.0f mm\n",
+			base_support, support,
+			base_height, height
+		);
+
+		connector_arg.spacing = 2 * size + 5;
+		connector_arg.columns = ceil(sqrt(num_vertex));
+		if (connector_arg.columns < 1)
+			connector_arg.columns = 1;
 	}
+	progress_start("connectors", num_vertex);
+	pool_print(num_vertex, connector_print, &connector_arg, stdout);
+	progress_end();
 
 	return 0;
 }